@@ -1,6 +1,6 @@
 QT       += core gui
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent network
 
 CONFIG += c++11
 
@@ -15,12 +15,41 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Compiles out the timing scopes of trace.h.
+#DEFINES += OUTLINEFLOW_NO_TRACE
+
+include(core.pri)
+
 SOURCES += \
     main.cpp \
-    outlineFlow.cpp
+    autoTracer.cpp \
+    batchRunner.cpp \
+    edgeSnapper.cpp \
+    floor.cpp \
+    geometryWorker.cpp \
+    imageLoader.cpp \
+    liveStream.cpp \
+    outlineFlow.cpp \
+    overlayRasterizer.cpp \
+    planCache.cpp \
+    planView.cpp \
+    redrawScheduler.cpp \
+    traceHud.cpp
 
 HEADERS += \
-    outlineFlow.h
+    autoTracer.h \
+    batchRunner.h \
+    edgeSnapper.h \
+    floor.h \
+    geometryWorker.h \
+    imageLoader.h \
+    liveStream.h \
+    outlineFlow.h \
+    overlayRasterizer.h \
+    planCache.h \
+    planView.h \
+    redrawScheduler.h \
+    traceHud.h
 
 FORMS +=
 
@@ -0,0 +1,516 @@
+#include "autoTracer.h"
+#include "polygonSimplifier.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QtConcurrent>
+#include <climits>
+#include <functional>
+#include "trace.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OUTLINEFLOW_SSE2
+#endif
+
+namespace {
+
+const int bandRows = 128;
+
+enum Edge { Top, Right, Bottom, Left };
+
+// Segments of every marching squares case as (from edge, to edge) pairs,
+// with the floor on the left when walking in image coordinates. Corner
+// bits: a top left 8, b top right 4, c bottom right 2, d bottom left 1.
+// Saddles keep the two floor corners apart.
+const signed char segments[16][4] = {
+    { -1, -1, -1, -1 },
+    { Bottom, Left, -1, -1 },
+    { Right, Bottom, -1, -1 },
+    { Right, Left, -1, -1 },
+    { Top, Right, -1, -1 },
+    { Top, Right, Bottom, Left },
+    { Top, Bottom, -1, -1 },
+    { Top, Left, -1, -1 },
+    { Left, Top, -1, -1 },
+    { Bottom, Top, -1, -1 },
+    { Left, Top, Right, Bottom },
+    { Right, Top, -1, -1 },
+    { Left, Right, -1, -1 },
+    { Bottom, Right, -1, -1 },
+    { Left, Bottom, -1, -1 },
+    { -1, -1, -1, -1 },
+};
+
+// An outline piece in doubled coordinates, every point is the middle of a
+// pixel edge.
+struct Chain
+{
+    QVector<QPoint> points;
+};
+
+struct Band
+{
+    int first = 0;      // first cell row, cell rows start at -1
+    int last = 0;       // one past the last cell row
+    QList<QPolygon> rooms;
+    QVector<Chain> open;
+};
+
+bool isDirectFormat(QImage::Format format)
+{
+    return format == QImage::Format_Grayscale8 || format == QImage::Format_RGB32
+        || format == QImage::Format_ARGB32 || format == QImage::Format_ARGB32_Premultiplied;
+}
+
+inline int luminance(QRgb p)
+{
+    return (qRed(p) * 77 + qGreen(p) * 150 + qBlue(p) * 29) >> 8;
+}
+
+// 1 for floor (gray level at or above threshold), 0 for walls.
+void binarizeRow(const uchar *line, QImage::Format format, int width, int threshold, uchar *out)
+{
+    int x = 0;
+    if (format == QImage::Format_Grayscale8)
+    {
+#ifdef OUTLINEFLOW_SSE2
+        const __m128i t = _mm_set1_epi8(char(threshold));
+        const __m128i one = _mm_set1_epi8(1);
+        for (; x + 16 <= width; x += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line + x));
+            const __m128i floor = _mm_cmpeq_epi8(_mm_max_epu8(v, t), v);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), _mm_and_si128(floor, one));
+        }
+#endif
+        for (; x < width; x++)
+            out[x] = line[x] >= threshold;
+        return;
+    }
+
+    const QRgb *pixels = reinterpret_cast<const QRgb *>(line);
+#ifdef OUTLINEFLOW_SSE2
+    // Same integer weights as luminance(), four pixels at a time.
+    const __m128i low = _mm_set1_epi32(0xff);
+    const __m128i wr = _mm_set1_epi32(77);
+    const __m128i wg = _mm_set1_epi32(150);
+    const __m128i wb = _mm_set1_epi32(29);
+    const __m128i t = _mm_set1_epi32(threshold);
+    for (; x + 4 <= width; x += 4)
+    {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x));
+        const __m128i b = _mm_and_si128(p, low);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), low);
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+        __m128i y = _mm_add_epi32(_mm_mullo_epi16(r, wr), _mm_mullo_epi16(g, wg));
+        y = _mm_srli_epi32(_mm_add_epi32(y, _mm_mullo_epi16(b, wb)), 8);
+        const int wall = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(y, t)));
+        out[x] = !(wall & 1);
+        out[x + 1] = !(wall & 2);
+        out[x + 2] = !(wall & 4);
+        out[x + 3] = !(wall & 8);
+    }
+#endif
+    for (; x < width; x++)
+        out[x] = luminance(pixels[x]) >= threshold;
+}
+
+QPoint edgePoint(int cx, int cy, int edge)
+{
+    switch (edge)
+    {
+    case Top:
+        return QPoint(2 * cx + 1, 2 * cy);
+    case Right:
+        return QPoint(2 * cx + 2, 2 * cy + 1);
+    case Bottom:
+        return QPoint(2 * cx + 1, 2 * cy + 2);
+    default:
+        return QPoint(2 * cx, 2 * cy + 1);
+    }
+}
+
+// Straight runs keep only their ends.
+void appendPoint(QVector<QPoint> &points, const QPoint &p)
+{
+    const int n = points.length();
+    if (n >= 2)
+    {
+        const QPoint &a = points.at(n - 2);
+        const QPoint &b = points.at(n - 1);
+        if (qint64(b.x() - a.x()) * (p.y() - b.y()) == qint64(b.y() - a.y()) * (p.x() - b.x()))
+        {
+            points[n - 1] = p;
+            return;
+        }
+    }
+    points.append(p);
+}
+
+quint64 pointKey(const QPoint &p)
+{
+    return quint64(quint32(p.x())) << 32 | quint32(p.y());
+}
+
+// Turns a closed outline into a room polygon, or rejects it.
+bool finishOutline(const QVector<QPoint> &points, const AutoTracer::Options &options,
+                   int width, int height, QPolygon *room)
+{
+    if (points.length() < 3)
+        return false;
+
+    // The shoelace sum is eight times the pixel area here. Outer outlines
+    // run with the floor on the left, which makes them negative, holes in a
+    // floor region come out positive.
+    qint64 sum = 0;
+    int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+    for (int i = 0; i < points.length(); i++)
+    {
+        const QPoint &p = points.at(i);
+        const QPoint &q = points.at(i + 1 < points.length() ? i + 1 : 0);
+        sum += qint64(p.x()) * q.y() - qint64(q.x()) * p.y();
+        minX = qMin(minX, p.x());
+        minY = qMin(minY, p.y());
+        maxX = qMax(maxX, p.x());
+        maxY = qMax(maxY, p.y());
+    }
+    if (-sum / 8.0 < options.minArea)
+        return false;
+    // Floor reaching the image border is the outside of the building.
+    if (minX < 0 || minY < 0 || maxX > 2 * (width - 1) || maxY > 2 * (height - 1))
+        return false;
+
+    const QPolygon simplified = PolygonSimplifier::douglasPeucker(QPolygon(points), 2 * options.tolerance);
+    room->clear();
+    for (const QPoint &p : simplified)
+    {
+        const QPoint pixel(qRound(p.x() / 2.0), qRound(p.y() / 2.0));
+        if (room->isEmpty() || room->last() != pixel)
+            *room << pixel;
+    }
+    while (room->length() > 1 && room->last() == room->first())
+        room->removeLast();
+    return room->length() >= 3;
+}
+
+void traceBand(const QImage &image, int threshold, const AutoTracer::Options &options,
+               const QAtomicInt *cancel, Band *band)
+{
+    if (cancel && cancel->loadAcquire())
+        return;
+    TRACE_SCOPE("traceBand");
+
+    const int width = image.width();
+    const int height = image.height();
+    const int rows = band->last - band->first;
+    const int stride = width + 2;
+
+    // Pixel rows first .. last with a blank column on either side, rows
+    // outside the image stay wall, so every outline closes.
+    QVector<uchar> mask(stride * (rows + 1), 0);
+    const bool direct = isDirectFormat(image.format());
+    const int top = qMax(0, band->first);
+    const int bottom = qMin(height - 1, band->last);
+    QImage converted;
+    if (!direct)
+        converted = image.copy(0, top, width, bottom - top + 1).convertToFormat(QImage::Format_Grayscale8);
+    for (int r = 0; r <= rows; r++)
+    {
+        const int y = band->first + r;
+        if (y < 0 || y >= height)
+            continue;
+        if (direct)
+            binarizeRow(image.constScanLine(y), image.format(), width, threshold, mask.data() + r * stride + 1);
+        else
+            binarizeRow(converted.constScanLine(y - top), QImage::Format_Grayscale8, width, threshold,
+                        mask.data() + r * stride + 1);
+    }
+
+    // Case of every cell, cell columns -1 .. width - 1. Bits 4 and 5 mark
+    // the cell's first and second segment as traced.
+    const int columns = width + 1;
+    QVector<uchar> cases(columns * rows);
+    for (int r = 0; r < rows; r++)
+    {
+        const uchar *up = mask.constData() + r * stride;
+        const uchar *down = up + stride;
+        uchar *out = cases.data() + r * columns;
+        for (int i = 0; i < columns; i++)
+            out[i] = uchar(up[i] << 3 | up[i + 1] << 2 | down[i + 1] << 1 | down[i]);
+    }
+    mask.clear();
+    mask.squeeze();
+
+    // Walks from segment s of cell (i, r) until the outline leaves the band
+    // or comes back to a traced segment. Returns true for the latter.
+    auto follow = [&](int i, int r, int s, QVector<QPoint> &points) -> bool {
+        for (;;)
+        {
+            uchar &cell = cases[r * columns + i];
+            cell |= uchar(16 << s);
+            const int to = segments[cell & 15][2 * s + 1];
+            appendPoint(points, edgePoint(i - 1, band->first + r, to));
+
+            int from;
+            switch (to)
+            {
+            case Top:
+                r--;
+                from = Bottom;
+                break;
+            case Right:
+                i++;
+                from = Left;
+                break;
+            case Bottom:
+                r++;
+                from = Top;
+                break;
+            default:
+                i--;
+                from = Right;
+                break;
+            }
+            if (r < 0 || r >= rows)
+                return false;
+
+            const uchar next = cases.at(r * columns + i);
+            s = segments[next & 15][0] == from ? 0 : 1;
+            if (next & (16 << s))
+                return true;
+        }
+    };
+
+    // Pieces coming in from the bands above and below, they end where they
+    // leave the band again.
+    for (int edgeRow = 0; edgeRow < 2; edgeRow++)
+    {
+        const int r = edgeRow == 0 ? 0 : rows - 1;
+        const int edge = edgeRow == 0 ? Top : Bottom;
+        for (int i = 0; i < columns; i++)
+        {
+            for (int s = 0; s < 2; s++)
+            {
+                const uchar cell = cases.at(r * columns + i);
+                if (segments[cell & 15][2 * s] != edge || (cell & (16 << s)))
+                    continue;
+                Chain chain;
+                chain.points.append(edgePoint(i - 1, band->first + r, edge));
+                follow(i, r, s, chain.points);
+                band->open.append(chain);
+            }
+        }
+    }
+
+    // Everything left closes inside the band.
+    QVector<QPoint> points;
+    for (int r = 0; r < rows; r++)
+    {
+        if (cancel && cancel->loadAcquire())
+            return;
+        for (int i = 0; i < columns; i++)
+        {
+            for (int s = 0; s < 2; s++)
+            {
+                const uchar cell = cases.at(r * columns + i);
+                const int from = segments[cell & 15][2 * s];
+                if (from < 0 || (cell & (16 << s)))
+                    continue;
+                points.clear();
+                points.append(edgePoint(i - 1, band->first + r, from));
+                follow(i, r, s, points);
+                if (points.length() > 1 && points.last() == points.first())
+                    points.removeLast();
+
+                QPolygon room;
+                if (finishOutline(points, options, width, height, &room))
+                    band->rooms.append(room);
+            }
+        }
+    }
+}
+
+}
+
+AutoTracer::AutoTracer(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(1);
+}
+
+AutoTracer::~AutoTracer()
+{
+    cancel();
+    pool.waitForDone();
+}
+
+void AutoTracer::trace(const QImage &image, const Options &options)
+{
+    cancel();
+
+    const quint64 job = ++currentJob;
+    const QSharedPointer<QAtomicInt> flag(new QAtomicInt(0));
+    cancelled = flag;
+    running = true;
+
+    QtConcurrent::run(&pool, [this, job, flag, image, options]() {
+        QElapsedTimer timer;
+        timer.start();
+        const QList<QPolygon> polygons = traceImage(image, options, flag.data());
+        if (flag->loadAcquire())
+            return;
+        const qint64 elapsed = timer.elapsed();
+        QMetaObject::invokeMethod(this, [this, job, polygons, elapsed]() {
+            deliver(job, polygons, elapsed);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void AutoTracer::cancel()
+{
+    if (cancelled)
+        cancelled->storeRelease(1);
+    cancelled.reset();
+    running = false;
+}
+
+void AutoTracer::deliver(quint64 job, const QList<QPolygon> &polygons, qint64 elapsedMs)
+{
+    if (job != currentJob || !running)
+        return;
+
+    running = false;
+    emit finished(polygons, elapsedMs);
+}
+
+int AutoTracer::otsuThreshold(const QImage &image)
+{
+    // Every fourth row is plenty for the histogram.
+    QVector<qint64> histogram(256, 0);
+    const bool direct = isDirectFormat(image.format());
+    for (int y = 0; y < image.height(); y += 4)
+    {
+        if (image.format() == QImage::Format_Grayscale8 || !direct)
+        {
+            const QImage row = direct ? QImage() : image.copy(0, y, image.width(), 1)
+                                                   .convertToFormat(QImage::Format_Grayscale8);
+            const uchar *line = direct ? image.constScanLine(y) : row.constScanLine(0);
+            for (int x = 0; x < image.width(); x++)
+                histogram[line[x]]++;
+        }
+        else
+        {
+            const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+            for (int x = 0; x < image.width(); x++)
+                histogram[luminance(line[x])]++;
+        }
+    }
+
+    qint64 total = 0;
+    double sum = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        total += histogram.at(i);
+        sum += double(i) * histogram.at(i);
+    }
+    if (total == 0)
+        return 128;
+
+    // Split that maximizes the variance between the two classes.
+    qint64 below = 0;
+    double sumBelow = 0;
+    double best = -1;
+    int threshold = 128;
+    for (int t = 1; t < 256; t++)
+    {
+        below += histogram.at(t - 1);
+        sumBelow += double(t - 1) * histogram.at(t - 1);
+        const qint64 above = total - below;
+        if (below == 0 || above == 0)
+            continue;
+        const double meanBelow = sumBelow / below;
+        const double meanAbove = (sum - sumBelow) / above;
+        const double between = double(below) * above * (meanBelow - meanAbove) * (meanBelow - meanAbove);
+        if (between > best)
+        {
+            best = between;
+            threshold = t;
+        }
+    }
+    return threshold;
+}
+
+QList<QPolygon> AutoTracer::traceImage(const QImage &image, const Options &options, const QAtomicInt *cancel)
+{
+    TRACE_SCOPE("traceImage");
+    if (image.isNull())
+        return QList<QPolygon>();
+
+    const int threshold = qBound(1, options.threshold >= 0 ? options.threshold : otsuThreshold(image), 255);
+
+    QVector<Band> bands;
+    for (int first = -1; first < image.height(); first += bandRows)
+    {
+        Band band;
+        band.first = first;
+        band.last = qMin(first + bandRows, image.height());
+        bands.append(band);
+    }
+
+    const std::function<void(Band &)> work = [&image, threshold, &options, cancel](Band &band) {
+        traceBand(image, threshold, options, cancel, &band);
+    };
+    QtConcurrent::blockingMap(bands, work);
+    if (cancel && cancel->loadAcquire())
+        return QList<QPolygon>();
+
+    QList<QPolygon> rooms;
+    QVector<const Chain *> open;
+    for (const Band &band : bands)
+    {
+        rooms += band.rooms;
+        for (const Chain &chain : band.open)
+            open.append(&chain);
+    }
+
+    // Join the pieces that crossed band borders: each one ends where the
+    // next one starts.
+    QHash<quint64, int> starts;
+    for (int i = 0; i < open.length(); i++)
+        starts.insert(pointKey(open.at(i)->points.first()), i);
+
+    QVector<bool> used(open.length(), false);
+    QVector<QPoint> points;
+    for (int i = 0; i < open.length(); i++)
+    {
+        if (used.at(i))
+            continue;
+        used[i] = true;
+        points = open.at(i)->points;
+
+        bool closed = false;
+        for (;;)
+        {
+            const int next = starts.value(pointKey(points.last()), -1);
+            if (next == i)
+            {
+                closed = true;
+                break;
+            }
+            if (next < 0 || used.at(next))
+                break;
+            used[next] = true;
+            const QVector<QPoint> &more = open.at(next)->points;
+            for (int k = 1; k < more.length(); k++)
+                appendPoint(points, more.at(k));
+        }
+        if (!closed)
+            continue;
+
+        points.removeLast();
+        QPolygon room;
+        if (finishOutline(points, options, image.width(), image.height(), &room))
+            rooms.append(room);
+    }
+    return rooms;
+}
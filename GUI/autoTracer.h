@@ -0,0 +1,57 @@
+#ifndef AUTOTRACER_H
+#define AUTOTRACER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QPolygon>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+// Finds room outlines in a plan image. The image is binarized into dark
+// walls and bright floor, marching squares traces the outline of every
+// bright region and the outlines are simplified into polygons. Regions
+// touching the image border (the outside) and small ones (text, noise) are
+// dropped.
+//
+// The image is cut into bands of rows that are binarized and traced on all
+// cores, outlines crossing band borders are joined afterwards.
+class AutoTracer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        int threshold = -1;         // gray level of floor, -1 picks one (Otsu)
+        int minArea = 400;          // square pixels
+        double tolerance = 1.5;     // pixels, for the simplification
+    };
+
+    explicit AutoTracer(QObject *parent = nullptr);
+    ~AutoTracer();
+
+    void trace(const QImage &image, const Options &options);
+    void cancel();
+    bool isRunning() const { return running; }
+
+    // The synchronous engine. Returns early with an empty list once cancel
+    // becomes non-zero.
+    static QList<QPolygon> traceImage(const QImage &image, const Options &options,
+                                      const QAtomicInt *cancel = nullptr);
+    static int otsuThreshold(const QImage &image);
+
+signals:
+    void finished(const QList<QPolygon> &polygons, qint64 elapsedMs);
+
+private:
+    void deliver(quint64 job, const QList<QPolygon> &polygons, qint64 elapsedMs);
+
+    QThreadPool pool;
+    QSharedPointer<QAtomicInt> cancelled;
+    quint64 currentJob = 0;
+    bool running = false;
+};
+
+#endif // AUTOTRACER_H
@@ -0,0 +1,496 @@
+#include "autosave.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include "trace.h"
+
+namespace {
+
+const char journalMagic[4] = { 'O', 'F', 'J', 'L' };
+// Version 2 added replace polygon records. Older journals are a subset,
+// an older reader refuses a newer journal rather than stop at its records.
+const quint16 journalVersion = 2;
+const int journalHeaderBytes = 16;
+// Small journals replay in no time, they are not worth a snapshot.
+const qint64 minCompactBytes = 256 * 1024;
+
+enum Op : quint8 { InsertPolygon = 1, RemovePolygon, InsertVertex, MoveVertex, RemoveVertex, ReplacePolygon };
+
+void put16(QByteArray *out, quint16 value)
+{
+    uchar bytes[2];
+    qToLittleEndian<quint16>(value, bytes);
+    out->append(reinterpret_cast<const char *>(bytes), 2);
+}
+
+void put32(QByteArray *out, quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    out->append(reinterpret_cast<const char *>(bytes), 4);
+}
+
+// u32 count, then count i32 x, i32 y.
+void putPolygon(QByteArray *out, const QPolygon &poly)
+{
+    put32(out, quint32(poly.length()));
+    for (const QPoint &point : poly)
+    {
+        put32(out, quint32(point.x()));
+        put32(out, quint32(point.y()));
+    }
+}
+
+QString fileName(const QString &base, quint32 generation, const char *suffix)
+{
+    return QStringLiteral("%1.%2.%3").arg(base).arg(generation).arg(QLatin1String(suffix));
+}
+
+void removeFiles(const QString &base)
+{
+    const QFileInfo info(base);
+    QDir dir = info.dir();
+    for (const QString &name : dir.entryList(QStringList() << info.fileName() + ".*", QDir::Files))
+        dir.remove(name);
+}
+
+QByteArray journalHeader(quint32 generation, const QString &imageFile)
+{
+    const QByteArray path = imageFile.toUtf8();
+    QByteArray header(journalMagic, 4);
+    put16(&header, journalVersion);
+    put16(&header, 0);
+    put32(&header, generation);
+    put32(&header, quint32(path.size()));
+    header.append(path);
+    return header;
+}
+
+bool applyRecord(ProjectData *data, const uchar *record, quint32 size)
+{
+    if (size < 2 || record[1] > 1)
+        return false;
+
+    const quint8 op = record[0];
+    const bool rooms = record[1] == 0;
+    QList<QPolygon> &polygons = rooms ? data->polygons : data->doors;
+    const uchar *p = record + 2;
+    const uchar *const end = record + size;
+    auto need = [&p, end](quint64 bytes) { return quint64(end - p) >= bytes; };
+    auto take = [&p]() {
+        const qint32 value = qFromLittleEndian<qint32>(p);
+        p += 4;
+        return value;
+    };
+
+    auto takePoints = [&need, &take](QPolygon *poly) -> bool {
+        if (!need(4))
+            return false;
+        const quint32 count = quint32(take());
+        if (!need(quint64(count) * 8))
+            return false;
+        poly->resize(int(count));
+        for (quint32 i = 0; i < count; i++)
+        {
+            const int x = take();
+            const int y = take();
+            (*poly)[int(i)] = QPoint(x, y);
+        }
+        return true;
+    };
+
+    switch (op)
+    {
+    case InsertPolygon:
+    {
+        if (!need(8))
+            return false;
+        const int index = take();
+        const quint32 colorBytes = quint32(take());
+        if (index < 0 || index > polygons.length() || !need(quint64(colorBytes) + 4))
+            return false;
+        const QString color = QString::fromUtf8(reinterpret_cast<const char *>(p), int(colorBytes));
+        p += colorBytes;
+        QPolygon poly;
+        if (!takePoints(&poly))
+            return false;
+        polygons.insert(index, poly);
+        if (rooms)
+            data->colors.insert(index, color);
+        return true;
+    }
+    case RemovePolygon:
+    {
+        if (!need(4))
+            return false;
+        const int index = take();
+        if (index < 0 || index >= polygons.length())
+            return false;
+        polygons.removeAt(index);
+        if (rooms)
+            data->colors.removeAt(index);
+        return true;
+    }
+    case ReplacePolygon:
+    {
+        if (!need(4))
+            return false;
+        const int index = take();
+        if (index < 0 || index >= polygons.length())
+            return false;
+        return takePoints(&polygons[index]);
+    }
+    case InsertVertex:
+    case MoveVertex:
+    case RemoveVertex:
+    {
+        if (!need(op == RemoveVertex ? 8 : 16))
+            return false;
+        const int index = take();
+        const int vertex = take();
+        if (index < 0 || index >= polygons.length() || vertex < 0)
+            return false;
+
+        QPolygon &poly = polygons[index];
+        if (op == InsertVertex)
+        {
+            if (vertex > poly.length())
+                return false;
+            const int x = take();
+            const int y = take();
+            poly.insert(vertex, QPoint(x, y));
+            return true;
+        }
+        if (vertex >= poly.length())
+            return false;
+        if (op == MoveVertex)
+        {
+            const int x = take();
+            const int y = take();
+            poly[vertex] = QPoint(x, y);
+        }
+        else
+        {
+            poly.remove(vertex);
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+// Reads the header and, with data, replays the records onto it.
+bool readJournal(const QString &path, ProjectData *data, QString *imageFile)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QByteArray bytes = file.readAll();
+    const uchar *base = reinterpret_cast<const uchar *>(bytes.constData());
+    const qint64 size = bytes.size();
+    if (size < journalHeaderBytes || std::memcmp(base, journalMagic, 4) != 0
+            || qFromLittleEndian<quint16>(base + 4) == 0
+            || qFromLittleEndian<quint16>(base + 4) > journalVersion)
+        return false;
+
+    const quint32 pathBytes = qFromLittleEndian<quint32>(base + 12);
+    if (journalHeaderBytes + qint64(pathBytes) > size)
+        return false;
+    *imageFile = QString::fromUtf8(bytes.constData() + journalHeaderBytes, int(pathBytes));
+    if (!data)
+        return true;
+
+    // A crash may cut the last record short, everything before it counts.
+    qint64 at = journalHeaderBytes + pathBytes;
+    while (size - at >= 6)
+    {
+        const quint32 n = qFromLittleEndian<quint32>(base + at);
+        if (n > quint64(size - at - 6))
+            break;
+        const uchar *record = base + at + 4;
+        if (qChecksum(reinterpret_cast<const char *>(record), n) != qFromLittleEndian<quint16>(record + n))
+            break;
+        if (!applyRecord(data, record, n))
+            break;
+        at += 4 + qint64(n) + 2;
+    }
+    return true;
+}
+
+} // namespace
+
+Autosave::Autosave(const PolygonDocument *document, const QString &base, QObject *parent)
+    : QObject(parent), document(document), basePath(base), state(new State)
+{
+    pool.setMaxThreadCount(1);
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(500);
+    connect(&flushTimer, &QTimer::timeout, this, &Autosave::flush);
+
+    connect(document, &PolygonDocument::polygonInserted, this, &Autosave::polygonInserted);
+    connect(document, &PolygonDocument::polygonRemoved, this, &Autosave::polygonRemoved);
+    connect(document, &PolygonDocument::polygonReplaced, this, &Autosave::polygonReplaced);
+    connect(document, &PolygonDocument::vertexInserted, this, &Autosave::vertexInserted);
+    connect(document, &PolygonDocument::vertexMoved, this, &Autosave::vertexMoved);
+    connect(document, &PolygonDocument::vertexRemoved, this, &Autosave::vertexRemoved);
+    // A replaced document is no delta, it goes into a snapshot.
+    connect(document, &PolygonDocument::documentReset, this, &Autosave::compact);
+
+    compact();
+}
+
+Autosave::~Autosave()
+{
+    flushTimer.stop();
+    const QSharedPointer<State> worker = state;
+    const QString base = basePath;
+    QtConcurrent::run(&pool, [worker, base]() {
+        worker->journal.reset();
+        removeFiles(base);
+    });
+    pool.waitForDone();
+}
+
+void Autosave::setImageFile(const QString &fileName)
+{
+    if (image == fileName)
+        return;
+    image = fileName;
+    compact();
+}
+
+void Autosave::flush()
+{
+    sendPending();
+    // Replaying a journal longer than the snapshot would take longer than
+    // reading a new snapshot.
+    if (journalBytes > qMax(minCompactBytes, snapshotBytes))
+        compact();
+}
+
+void Autosave::compact()
+{
+    sendPending();
+
+    const quint32 next = ++generation;
+    const ProjectData data = document->toProjectData();
+    snapshotBytes = document->vertexCount() * 8 + (data.polygons.length() + data.doors.length()) * 24;
+    journalBytes = 0;
+
+    const QSharedPointer<State> worker = state;
+    const QString base = basePath;
+    const QString imageFile = image;
+    QtConcurrent::run(&pool, [this, worker, base, imageFile, next, data]() {
+        TRACE_SCOPE("autosaveCompact");
+        const QString snapshot = fileName(base, next, "ofb");
+        const QString part = snapshot + ".part";
+        QString error;
+        if (!ProjectIO::writeBinary(part, data, &error) || !QFile::rename(part, snapshot))
+        {
+            QFile::remove(part);
+            reportError(error.isEmpty() ? QStringLiteral("cannot write %1").arg(snapshot) : error);
+            return;
+        }
+
+        QScopedPointer<QFile> journal(new QFile(fileName(base, next, "ofj")));
+        const QByteArray header = journalHeader(next, imageFile);
+        if (!journal->open(QIODevice::WriteOnly | QIODevice::Truncate)
+                || journal->write(header) != header.size() || !journal->flush())
+        {
+            // Without its journal the snapshot would hide the edits still
+            // going to the old one.
+            reportError(journal->errorString());
+            journal->remove();
+            QFile::remove(snapshot);
+            return;
+        }
+
+        const quint32 previous = worker->generation;
+        worker->journal.swap(journal);
+        worker->generation = next;
+        journal.reset();
+        if (previous > 0)
+        {
+            QFile::remove(fileName(base, previous, "ofb"));
+            QFile::remove(fileName(base, previous, "ofj"));
+        }
+    });
+}
+
+void Autosave::sendPending()
+{
+    flushTimer.stop();
+    lastMove = -1;
+    if (pending.isEmpty())
+        return;
+
+    const QByteArray records = pending;
+    pending.clear();
+    journalBytes += records.size();
+
+    const QSharedPointer<State> worker = state;
+    QtConcurrent::run(&pool, [this, worker, records]() {
+        if (!worker->journal)
+            return;
+        TRACE_SCOPE("autosaveAppend");
+        if (worker->journal->write(records) != records.size() || !worker->journal->flush())
+            reportError(worker->journal->errorString());
+    });
+}
+
+void Autosave::reportError(const QString &error)
+{
+    // Called on the worker.
+    QMetaObject::invokeMethod(this, [this, error]() {
+        emit failed(error);
+    }, Qt::QueuedConnection);
+}
+
+void Autosave::beginRecord(quint8 op, PolygonDocument::Layer layer)
+{
+    lastMove = -1;
+    recordStart = pending.size();
+    put32(&pending, 0);
+    pending.append(char(op));
+    pending.append(char(layer == PolygonDocument::Rooms ? 0 : 1));
+}
+
+void Autosave::endRecord()
+{
+    const int size = pending.size() - recordStart - 4;
+    qToLittleEndian<quint32>(quint32(size), reinterpret_cast<uchar *>(pending.data() + recordStart));
+    put16(&pending, qChecksum(pending.constData() + recordStart + 4, uint(size)));
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void Autosave::polygonInserted(PolygonDocument::Layer layer, int index)
+{
+    const QPolygon &poly = document->polygon(layer, index);
+    const QByteArray color = layer == PolygonDocument::Rooms ? document->colors().at(index).toUtf8() : QByteArray();
+
+    beginRecord(InsertPolygon, layer);
+    put32(&pending, quint32(index));
+    put32(&pending, quint32(color.size()));
+    pending.append(color);
+    putPolygon(&pending, poly);
+    endRecord();
+}
+
+void Autosave::polygonRemoved(PolygonDocument::Layer layer, int index)
+{
+    beginRecord(RemovePolygon, layer);
+    put32(&pending, quint32(index));
+    endRecord();
+}
+
+void Autosave::polygonReplaced(PolygonDocument::Layer layer, int index)
+{
+    beginRecord(ReplacePolygon, layer);
+    put32(&pending, quint32(index));
+    putPolygon(&pending, document->polygon(layer, index));
+    endRecord();
+}
+
+void Autosave::vertexInserted(PolygonDocument::Layer layer, int index, int vertex)
+{
+    const QPoint &pos = document->polygon(layer, index).at(vertex);
+    beginRecord(InsertVertex, layer);
+    put32(&pending, quint32(index));
+    put32(&pending, quint32(vertex));
+    put32(&pending, quint32(pos.x()));
+    put32(&pending, quint32(pos.y()));
+    endRecord();
+}
+
+void Autosave::vertexMoved(PolygonDocument::Layer layer, int index, int vertex)
+{
+    const QPoint &pos = document->polygon(layer, index).at(vertex);
+
+    // A drag moves one vertex many times, only the last position matters.
+    if (lastMove >= 0)
+    {
+        uchar *record = reinterpret_cast<uchar *>(pending.data() + lastMove);
+        if (record[5] == (layer == PolygonDocument::Rooms ? 0 : 1)
+                && qFromLittleEndian<qint32>(record + 6) == index
+                && qFromLittleEndian<qint32>(record + 10) == vertex)
+        {
+            qToLittleEndian<qint32>(pos.x(), record + 14);
+            qToLittleEndian<qint32>(pos.y(), record + 18);
+            qToLittleEndian<quint16>(qChecksum(reinterpret_cast<const char *>(record + 4), 18), record + 22);
+            return;
+        }
+    }
+
+    beginRecord(MoveVertex, layer);
+    put32(&pending, quint32(index));
+    put32(&pending, quint32(vertex));
+    put32(&pending, quint32(pos.x()));
+    put32(&pending, quint32(pos.y()));
+    endRecord();
+    lastMove = recordStart;
+}
+
+void Autosave::vertexRemoved(PolygonDocument::Layer layer, int index, int vertex)
+{
+    beginRecord(RemoveVertex, layer);
+    put32(&pending, quint32(index));
+    put32(&pending, quint32(vertex));
+    endRecord();
+}
+
+QStringList Autosave::bases(const QString &dir)
+{
+    const QDir directory(dir);
+    QStringList result;
+    for (const QString &name : directory.entryList(QStringList() << "*.ofb" << "*.ofj", QDir::Files))
+    {
+        const QString base = directory.filePath(name.left(name.indexOf('.')));
+        if (!result.contains(base))
+            result << base;
+    }
+    // Numbered names, floor2 comes before floor10.
+    std::sort(result.begin(), result.end(), [](const QString &a, const QString &b) {
+        return a.length() != b.length() ? a.length() < b.length() : a < b;
+    });
+    return result;
+}
+
+bool Autosave::recover(const QString &base, ProjectData *data, QString *imageFile, QString *error)
+{
+    const QFileInfo info(base);
+    const QString prefix = info.fileName() + ".";
+    QList<quint32> generations;
+    for (const QString &name : info.dir().entryList(QStringList() << prefix + "*.ofb", QDir::Files))
+    {
+        bool ok = false;
+        const quint32 g = name.mid(prefix.length(), name.length() - prefix.length() - 4).toUInt(&ok);
+        if (ok)
+            generations << g;
+    }
+    std::sort(generations.begin(), generations.end(), std::greater<quint32>());
+
+    // The newest snapshot that reads, a crash during compaction leaves the
+    // one before it with its journal.
+    for (int i = 0; i < generations.length(); i++)
+    {
+        if (!ProjectIO::readBinary(fileName(base, generations.at(i), "ofb"), data, error))
+            continue;
+
+        imageFile->clear();
+        readJournal(fileName(base, generations.at(i), "ofj"), data, imageFile);
+        // A snapshot whose journal was not started yet: the image path is
+        // in the older one.
+        for (int j = i + 1; j < generations.length() && imageFile->isEmpty(); j++)
+            readJournal(fileName(base, generations.at(j), "ofj"), nullptr, imageFile);
+        return true;
+    }
+
+    *error = QStringLiteral("%1: no complete snapshot").arg(info.fileName());
+    return false;
+}
@@ -0,0 +1,107 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QObject>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include "polygonDocument.h"
+#include "projectIO.h"
+
+// Crash protection for one document. Every edit is encoded on the GUI
+// thread as a small binary record, in O(size of the edit), and appended to
+// a journal file on a worker thread. Once the journal outgrows a full
+// snapshot, or the whole document is replaced, it is folded into a new
+// snapshot. A clean exit removes the files; after a crash recover()
+// rebuilds the document from the newest snapshot and the records after it.
+//
+// Files of generation g, base being a path without suffix:
+//
+// <base>.<g>.ofb  snapshot, see ProjectIO. Written under another name and
+//                 renamed once complete, so a torn one is never read.
+// <base>.<g>.ofj  journal of the edits after that snapshot, little endian:
+//       header    "OFJL", u16 version (2; 1 had no op 6), u16 reserved,
+//                 u32 generation, u32 image path bytes, UTF-8 path of
+//                 the plan image
+//       records   u32 size, then size bytes of u8 op, u8 layer (0 rooms,
+//                 1 doors), payload, then u16 CRC-16 of those bytes:
+//                 1 insert polygon  i32 index, u32 color bytes, UTF-8
+//                                   color, u32 count, count i32 x, i32 y
+//                 2 remove polygon  i32 index
+//                 3 insert vertex   i32 index, i32 vertex, i32 x, i32 y
+//                 4 move vertex     i32 index, i32 vertex, i32 x, i32 y
+//                 5 remove vertex   i32 index, i32 vertex
+//                 6 replace polygon i32 index, u32 count, count i32 x, i32 y
+//
+// Replay stops at the first torn or damaged record.
+class Autosave : public QObject
+{
+    Q_OBJECT
+
+public:
+    Autosave(const PolygonDocument *document, const QString &base, QObject *parent = nullptr);
+    // Removes the files, nothing needs recovering after a clean exit.
+    ~Autosave();
+
+    QString base() const { return basePath; }
+    // Stored with every snapshot, so a recovered floor finds its plan.
+    void setImageFile(const QString &fileName);
+
+    // Hands the records collected so far to the worker. Runs by itself
+    // shortly after an edit; consecutive moves of one vertex are merged
+    // until then.
+    void flush();
+    // Writes a full snapshot and starts a new journal.
+    void compact();
+
+    // Bases with files in dir, in the order they were created.
+    static QStringList bases(const QString &dir);
+    static bool recover(const QString &base, ProjectData *data, QString *imageFile, QString *error);
+
+signals:
+    void failed(const QString &error);
+
+private:
+    // Worker side, only touched by the single pool thread.
+    struct State
+    {
+        QScopedPointer<QFile> journal;
+        quint32 generation = 0;
+    };
+
+    void polygonInserted(PolygonDocument::Layer layer, int index);
+    void polygonRemoved(PolygonDocument::Layer layer, int index);
+    void polygonReplaced(PolygonDocument::Layer layer, int index);
+    void vertexInserted(PolygonDocument::Layer layer, int index, int vertex);
+    void vertexMoved(PolygonDocument::Layer layer, int index, int vertex);
+    void vertexRemoved(PolygonDocument::Layer layer, int index, int vertex);
+
+    void beginRecord(quint8 op, PolygonDocument::Layer layer);
+    void endRecord();
+    void sendPending();
+    void reportError(const QString &error);
+
+    const PolygonDocument *document;
+    QString basePath;
+    QString image;
+
+    QByteArray pending;
+    int recordStart = 0;
+    // Offset of the last record in pending when it is a move, or -1.
+    int lastMove = -1;
+    QTimer flushTimer;
+
+    quint32 generation = 0;
+    qint64 journalBytes = 0;
+    qint64 snapshotBytes = 0;
+
+    QThreadPool pool;
+    QSharedPointer<State> state;
+};
+
+#endif // AUTOSAVE_H
@@ -0,0 +1,274 @@
+#include "batchRunner.h"
+#include "polygonDocument.h"
+#include "polygonValidator.h"
+#include "roomAnalytics.h"
+#include <QCommandLineParser>
+#include <QColor>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <functional>
+
+int BatchRunner::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Converts, validates and normalizes OutlineFlow project files without a display.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("batch", "Selects the headless mode.");
+    parser.addPositionalArgument("files", "Project files (.dat or .ofb).", "files...");
+
+    QCommandLineOption convertOption(QStringList() << "c" << "convert",
+            "Converts every file to <format> (dat or ofb).", "format");
+    QCommandLineOption normalizeOption(QStringList() << "n" << "normalize",
+            "Rewrites every file without empty polygons, incomplete doors and repeated points.");
+    QCommandLineOption outputOption(QStringList() << "o" << "output-dir",
+            "Writes results to <dir> instead of next to the input.", "dir");
+    QCommandLineOption simplifyOption(QStringList() << "s" << "simplify",
+            "Drops polygon points closer than <tolerance> pixels to the outline, with --convert or --normalize.", "tolerance");
+    QCommandLineOption methodOption(QStringList() << "m" << "method",
+            "Simplification method, dp (Douglas-Peucker, default) or vw (Visvalingam-Whyatt).", "method");
+    QCommandLineOption analyticsOption(QStringList() << "a" << "analytics",
+            "Also writes room areas, perimeters, door assignment and adjacency to <name>.rooms.json.");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+            "Number of worker threads, defaults to one per core.", "n");
+    parser.addOption(convertOption);
+    parser.addOption(normalizeOption);
+    parser.addOption(outputOption);
+    parser.addOption(simplifyOption);
+    parser.addOption(methodOption);
+    parser.addOption(analyticsOption);
+    parser.addOption(jobsOption);
+    parser.process(arguments);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList files = parser.positionalArguments();
+    if (!files.isEmpty())
+        files.removeFirst();
+    if (files.isEmpty())
+    {
+        err << "No input files given.\n";
+        return 2;
+    }
+
+    Options options;
+    if (parser.isSet(convertOption))
+    {
+        options.mode = Convert;
+        options.suffix = parser.value(convertOption).toLower();
+        if (options.suffix != "dat" && options.suffix != "ofb")
+        {
+            err << "Unknown format " << options.suffix << ", expected dat or ofb.\n";
+            return 2;
+        }
+    }
+    else if (parser.isSet(normalizeOption))
+    {
+        options.mode = Normalize;
+    }
+
+    if (parser.isSet(simplifyOption))
+    {
+        bool ok = false;
+        options.tolerance = parser.value(simplifyOption).toDouble(&ok);
+        if (!ok || options.tolerance <= 0)
+        {
+            err << "Invalid tolerance " << parser.value(simplifyOption) << ".\n";
+            return 2;
+        }
+        if (options.mode == Validate)
+        {
+            err << "--simplify needs --convert or --normalize.\n";
+            return 2;
+        }
+    }
+
+    if (parser.isSet(methodOption))
+    {
+        const QString method = parser.value(methodOption).toLower();
+        if (method == "vw")
+            options.method = PolygonSimplifier::VisvalingamWhyatt;
+        else if (method != "dp")
+        {
+            err << "Unknown method " << method << ", expected dp or vw.\n";
+            return 2;
+        }
+    }
+
+    options.analytics = parser.isSet(analyticsOption);
+
+    if (parser.isSet(outputOption))
+    {
+        options.outputDir = parser.value(outputOption);
+        if (!QDir().mkpath(options.outputDir))
+        {
+            err << "Cannot create " << options.outputDir << ".\n";
+            return 2;
+        }
+    }
+
+    if (parser.isSet(jobsOption))
+        QThreadPool::globalInstance()->setMaxThreadCount(qMax(1, parser.value(jobsOption).toInt()));
+
+    QElapsedTimer total;
+    total.start();
+
+    const std::function<Result(const QString &)> work = [options](const QString &fileName) {
+        return processFile(fileName, options);
+    };
+    QFuture<Result> future = QtConcurrent::mapped(files, work);
+
+    int failed = 0;
+    qint64 points = 0;
+    for (int i = 0; i < files.length(); i++)
+    {
+        // Results arrive in input order, each one as soon as it is done.
+        const Result r = future.resultAt(i);
+        points += r.points;
+        if (!r.ok)
+            failed++;
+
+        out << (r.ok ? "OK    " : "FAIL  ")
+            << "read " << QString::number(r.readMs, 'f', 1).rightJustified(8) << " ms  "
+            << "write " << QString::number(r.writeMs, 'f', 1).rightJustified(8) << " ms  "
+            << QString::number(r.polygons).rightJustified(6) << " polygons "
+            << QString::number(r.doors).rightJustified(5) << " doors "
+            << QString::number(r.points).rightJustified(9) << " points  "
+            << r.fileName;
+        if (!r.message.isEmpty())
+            out << "  " << r.message;
+        out << "\n";
+        out.flush();
+    }
+
+    out << files.length() << " files, " << failed << " failed, " << points << " points in "
+        << total.elapsed() << " ms on " << QThreadPool::globalInstance()->maxThreadCount()
+        << " threads\n";
+
+    return failed == 0 ? 0 : 1;
+}
+
+BatchRunner::Result BatchRunner::processFile(const QString &fileName, const Options &options)
+{
+    Result r;
+    r.fileName = fileName;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ProjectData data;
+    QString error;
+    const bool read = ProjectIO::read(fileName, &data, &error);
+    r.readMs = timer.nsecsElapsed() / 1e6;
+    if (!read)
+    {
+        r.message = error;
+        return r;
+    }
+
+    if (options.mode == Normalize)
+        normalize(&data);
+    if (options.tolerance > 0 && options.mode != Validate)
+        data.polygons = PolygonSimplifier::simplify(data.polygons, options.method, options.tolerance);
+
+    r.polygons = data.polygons.length();
+    r.doors = data.doors.length();
+    for (const QPolygon &poly : data.polygons)
+        r.points += poly.length();
+    for (const QPolygon &door : data.doors)
+        r.points += door.length();
+
+    const QFileInfo info(fileName);
+    const QString dir = options.outputDir.isEmpty() ? info.absolutePath() : options.outputDir;
+
+    QString analyticsMessage;
+    if (options.analytics)
+    {
+        const QString target = QDir(dir).filePath(info.completeBaseName() + ".rooms.json");
+        if (!writeAnalytics(target, data, &error))
+        {
+            r.message = error;
+            return r;
+        }
+        analyticsMessage = "-> " + target;
+    }
+
+    if (options.mode == Validate)
+    {
+        QStringList warnings;
+        for (int i = 0; i < data.polygons.length(); i++)
+        {
+            if (!QColor::isValidColor(data.colors.at(i)))
+                warnings << QStringLiteral("polygon %1 has unknown color %2").arg(i).arg(data.colors.at(i));
+            if (data.polygons.at(i).length() < 3)
+                warnings << QStringLiteral("polygon %1 has %2 points").arg(i).arg(data.polygons.at(i).length());
+        }
+        for (int i = 0; i < data.doors.length(); i++)
+            if (data.doors.at(i).length() != 2)
+                warnings << QStringLiteral("door %1 has %2 points").arg(i).arg(data.doors.at(i).length());
+        for (const PolygonValidator::Issue &issue : PolygonValidator::validate(data.polygons))
+            warnings << PolygonValidator::describe(issue);
+
+        // A file with problems fails, so scripts can rely on the exit code.
+        r.ok = warnings.isEmpty();
+        if (!analyticsMessage.isEmpty())
+            warnings << analyticsMessage;
+        r.message = warnings.join("; ");
+        return r;
+    }
+
+    const QString suffix = options.mode == Convert ? options.suffix : info.suffix();
+    const QString target = QDir(dir).filePath(info.completeBaseName() + "." + suffix);
+
+    timer.restart();
+    const bool written = ProjectIO::write(target, data, &error);
+    r.writeMs = timer.nsecsElapsed() / 1e6;
+
+    r.ok = written;
+    r.message = written ? "-> " + target : error;
+    if (written && !analyticsMessage.isEmpty())
+        r.message += "  " + analyticsMessage;
+    return r;
+}
+
+bool BatchRunner::writeAnalytics(const QString &fileName, const ProjectData &data, QString *error)
+{
+    PolygonDocument document;
+    document.setProjectData(data);
+    RoomAnalytics analytics(&document);
+    return analytics.exportJson(fileName, error);
+}
+
+void BatchRunner::normalize(ProjectData *data)
+{
+    auto dropRepeats = [](QPolygon &poly) {
+        int n = 0;
+        for (int i = 0; i < poly.length(); i++)
+            if (n == 0 || poly.at(i) != poly.at(n - 1))
+                poly[n++] = poly.at(i);
+        while (n > 1 && poly.at(n - 1) == poly.at(0))
+            n--;
+        poly.resize(n);
+    };
+
+    for (int i = data->polygons.length() - 1; i >= 0; i--)
+    {
+        dropRepeats(data->polygons[i]);
+        if (data->polygons.at(i).isEmpty())
+        {
+            data->polygons.removeAt(i);
+            data->colors.removeAt(i);
+        }
+    }
+
+    for (int i = data->doors.length() - 1; i >= 0; i--)
+    {
+        dropRepeats(data->doors[i]);
+        if (data->doors.at(i).length() < 2)
+            data->doors.removeAt(i);
+    }
+}
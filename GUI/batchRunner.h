@@ -0,0 +1,45 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QStringList>
+#include "polygonSimplifier.h"
+#include "projectIO.h"
+
+// Headless mode, started with "batch" as the first argument. Converts,
+// validates or normalizes many project files on a thread pool and prints
+// one line with timings per file.
+class BatchRunner
+{
+public:
+    enum Mode { Validate, Convert, Normalize };
+
+    struct Options
+    {
+        Mode mode = Validate;
+        QString suffix;
+        QString outputDir;
+        double tolerance = 0;       // simplifies polygons when above 0
+        PolygonSimplifier::Method method = PolygonSimplifier::DouglasPeucker;
+        bool analytics = false;     // writes <name>.rooms.json as well
+    };
+
+    struct Result
+    {
+        QString fileName;
+        bool ok = false;
+        QString message;
+        double readMs = 0;
+        double writeMs = 0;
+        int polygons = 0;
+        int doors = 0;
+        qint64 points = 0;
+    };
+
+    static int run(const QStringList &arguments);
+
+    static Result processFile(const QString &fileName, const Options &options);
+    static void normalize(ProjectData *data);
+    static bool writeAnalytics(const QString &fileName, const ProjectData &data, QString *error);
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,38 @@
+# Geometry, documents and file formats, without any widgets. Shared by the
+# editor, the benchmarks and the tests.
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/autosave.cpp \
+    $$PWD/editJournal.cpp \
+    $$PWD/geometryKernels.cpp \
+    $$PWD/imagePyramid.cpp \
+    $$PWD/overlayRenderer.cpp \
+    $$PWD/pointIndex.cpp \
+    $$PWD/polygonDocument.cpp \
+    $$PWD/polygonLod.cpp \
+    $$PWD/polygonSimplifier.cpp \
+    $$PWD/polygonValidator.cpp \
+    $$PWD/projectIO.cpp \
+    $$PWD/roomAnalytics.cpp \
+    $$PWD/segmentIndex.cpp \
+    $$PWD/trace.cpp
+
+HEADERS += \
+    $$PWD/autosave.h \
+    $$PWD/editJournal.h \
+    $$PWD/geometryKernels.h \
+    $$PWD/gridCell.h \
+    $$PWD/imagePyramid.h \
+    $$PWD/overlayRenderer.h \
+    $$PWD/pointIndex.h \
+    $$PWD/polygonDocument.h \
+    $$PWD/polygonLod.h \
+    $$PWD/polygonSimplifier.h \
+    $$PWD/polygonValidator.h \
+    $$PWD/projectIO.h \
+    $$PWD/roomAnalytics.h \
+    $$PWD/segmentIndex.h \
+    $$PWD/trace.h
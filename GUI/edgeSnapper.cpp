@@ -0,0 +1,345 @@
+#include "edgeSnapper.h"
+#include <QtConcurrent>
+#include "autoTracer.h"
+#include "trace.h"
+
+namespace {
+
+const int none = 0x3fff;
+const qint8 noOffset = -128;
+
+enum Feature { EdgeBit = 1, CornerBit = 2 };
+
+// Offset from every pixel to the nearest seed pixel, propagated in two
+// raster passes over the 8-neighbourhood (8SSEDT). Off by a fraction of a
+// pixel in rare cases, which does not matter for snapping.
+void nearestSeeds(const QVector<uchar> &features, uchar bit, int w, int h,
+                  QVector<short> *dx, QVector<short> *dy)
+{
+    dx->fill(none, w * h);
+    dy->fill(none, w * h);
+    short *x = dx->data();
+    short *y = dy->data();
+    for (int i = 0; i < w * h; i++)
+    {
+        if (features.at(i) & bit)
+        {
+            x[i] = 0;
+            y[i] = 0;
+        }
+    }
+
+    // n is the neighbour index, (ox, oy) its position relative to i.
+    auto relax = [x, y](int i, int n, int ox, int oy) {
+        if (x[n] == none)
+            return;
+        const int cx = x[n] + ox;
+        const int cy = y[n] + oy;
+        if (cx * cx + cy * cy < x[i] * x[i] + y[i] * y[i])
+        {
+            x[i] = short(cx);
+            y[i] = short(cy);
+        }
+    };
+
+    for (int row = 0; row < h; row++)
+    {
+        const int line = row * w;
+        for (int col = 0; col < w; col++)
+        {
+            const int i = line + col;
+            if (col > 0)
+                relax(i, i - 1, -1, 0);
+            if (row > 0)
+            {
+                if (col > 0)
+                    relax(i, i - w - 1, -1, -1);
+                relax(i, i - w, 0, -1);
+                if (col + 1 < w)
+                    relax(i, i - w + 1, 1, -1);
+            }
+        }
+        for (int col = w - 2; col >= 0; col--)
+            relax(line + col, line + col + 1, 1, 0);
+    }
+
+    for (int row = h - 1; row >= 0; row--)
+    {
+        const int line = row * w;
+        for (int col = w - 1; col >= 0; col--)
+        {
+            const int i = line + col;
+            if (col + 1 < w)
+                relax(i, i + 1, 1, 0);
+            if (row + 1 < h)
+            {
+                if (col + 1 < w)
+                    relax(i, i + w + 1, 1, 1);
+                relax(i, i + w, 0, 1);
+                if (col > 0)
+                    relax(i, i + w - 1, -1, 1);
+            }
+        }
+        for (int col = 1; col < w; col++)
+            relax(line + col, line + col - 1, -1, 0);
+    }
+}
+
+}
+
+EdgeSnapper::EdgeSnapper(int tileSize, int cacheKilobytes, QObject *parent)
+    : QObject(parent), tileSide(qMax(16, tileSize))
+{
+    // One thread keeps the GUI responsive and lets tiles share the lazily
+    // computed threshold without locking.
+    pool.setMaxThreadCount(1);
+    cache.setMaxCost(cacheKilobytes);
+}
+
+EdgeSnapper::~EdgeSnapper()
+{
+    clear();
+    pool.waitForDone();
+}
+
+void EdgeSnapper::setImage(const QImage &image)
+{
+    if (source)
+        source->cancelled.storeRelease(1);
+    source.reset();
+    generation++;
+    cache.clear();
+    pending.clear();
+
+    maxLevel = 0;
+    if (image.isNull())
+        return;
+
+    source.reset(new Source);
+    source->image = image;
+
+    int side = qMax(image.width(), image.height());
+    while (side > tileSide)
+    {
+        side /= 2;
+        maxLevel++;
+    }
+}
+
+void EdgeSnapper::clear()
+{
+    setImage(QImage());
+}
+
+void EdgeSnapper::setSnapRadius(int pixels)
+{
+    pixels = qBound(1, pixels, 63);
+    if (pixels == radius)
+        return;
+
+    // The tiles only hold offsets up to twice the radius.
+    radius = pixels;
+    generation++;
+    cache.clear();
+    pending.clear();
+}
+
+int EdgeSnapper::levelFor(qreal scale) const
+{
+    int level = 0;
+    while (level < maxLevel && scale * (2 << level) <= 1.0)
+        level++;
+    return level;
+}
+
+quint64 EdgeSnapper::tileKey(int level, int tx, int ty)
+{
+    return (quint64(level) << 56) | (quint64(quint32(ty) & 0xfffffff) << 28) | (quint32(tx) & 0xfffffff);
+}
+
+bool EdgeSnapper::snap(const QPoint &pos, qreal scale, QPoint *snapped)
+{
+    if (!source || scale <= 0 || !source->image.rect().contains(pos))
+        return false;
+
+    const int level = levelFor(scale);
+    const int lx = pos.x() >> level;
+    const int ly = pos.y() >> level;
+    const int tx = lx / tileSide;
+    const int ty = ly / tileSide;
+
+    const Tile *tile = cache.object(tileKey(level, tx, ty));
+    if (!tile)
+    {
+        request(level, tx, ty);
+        return false;
+    }
+
+    // The radius in pixels of this level, one level pixel is between half
+    // and one screen pixel when zoomed out.
+    const double reach = radius / (scale * (1 << level));
+    const double reach2 = reach * reach;
+
+    const qint8 *offsets = tile->offsets.constData()
+            + 4 * ((ly - ty * tileSide) * tileSide + (lx - tx * tileSide));
+    for (int feature = 1; feature >= 0; feature--)
+    {
+        const int dx = offsets[2 * feature];
+        const int dy = offsets[2 * feature + 1];
+        if (dx == noOffset || dx * dx + dy * dy > reach2)
+            continue;
+
+        const int half = (1 << level) >> 1;
+        *snapped = QPoint(((lx + dx) << level) + half, ((ly + dy) << level) + half);
+        return true;
+    }
+    return false;
+}
+
+void EdgeSnapper::prefetch(const QRect &area, qreal scale)
+{
+    if (!source || scale <= 0)
+        return;
+
+    const QRect visible = area.intersected(source->image.rect());
+    if (visible.isEmpty())
+        return;
+
+    const int level = levelFor(scale);
+    const int side = tileSide << level;
+    for (int ty = visible.top() / side; ty <= visible.bottom() / side; ty++)
+        for (int tx = visible.left() / side; tx <= visible.right() / side; tx++)
+            request(level, tx, ty);
+}
+
+void EdgeSnapper::request(int level, int tx, int ty)
+{
+    const quint64 key = tileKey(level, tx, ty);
+    if (cache.contains(key) || pending.contains(key))
+        return;
+    pending.insert(key);
+
+    const quint64 job = generation;
+    const QSharedPointer<Source> from = source;
+    const int side = tileSide;
+    const int reach = 2 * radius;
+    QtConcurrent::run(&pool, [this, job, key, from, level, tx, ty, side, reach]() {
+        if (from->cancelled.loadAcquire())
+            return;
+        const QSharedPointer<Tile> tile = computeTile(from.data(), level, tx, ty, side, reach);
+        if (!tile)
+            return;
+        QMetaObject::invokeMethod(this, [this, job, key, tile]() {
+            deliver(job, key, tile);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void EdgeSnapper::deliver(quint64 job, quint64 key, const QSharedPointer<Tile> &tile)
+{
+    if (job != generation)
+        return;
+
+    pending.remove(key);
+    cache.insert(key, new Tile(*tile), qMax(1, tile->offsets.size() / 1024));
+}
+
+QSharedPointer<EdgeSnapper::Tile> EdgeSnapper::computeTile(Source *source, int level, int tx, int ty,
+                                                          int tileSide, int reach)
+{
+    TRACE_SCOPE("edgeTile");
+    const QImage &image = source->image;
+    if (source->threshold < 0)
+        source->threshold = AutoTracer::otsuThreshold(image);
+
+    // The tile plus a margin of reach pixels, in pixels of this level.
+    const int scale = 1 << level;
+    const QRect levelRect(0, 0, (image.width() + scale - 1) >> level, (image.height() + scale - 1) >> level);
+    const QRect tileArea = QRect(tx * tileSide, ty * tileSide, tileSide, tileSide).intersected(levelRect);
+    if (tileArea.isEmpty())
+        return QSharedPointer<Tile>();
+    const QRect region = tileArea.adjusted(-reach, -reach, reach, reach).intersected(levelRect);
+    const QRect sourceArea = QRect(region.x() << level, region.y() << level,
+                                   region.width() << level, region.height() << level).intersected(image.rect());
+
+    QImage gray;
+    if (image.depth() >= 8)
+    {
+        // A view onto the source scanlines, only the conversion copies.
+        const int bytesPerPixel = image.depth() / 8;
+        gray = QImage(image.constScanLine(sourceArea.top()) + sourceArea.left() * bytesPerPixel,
+                      sourceArea.width(), sourceArea.height(), image.bytesPerLine(), image.format());
+        gray.setColorTable(image.colorTable());
+    }
+    else
+    {
+        gray = image.copy(sourceArea);
+    }
+    if (level > 0)
+        gray = gray.scaled(region.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    gray = gray.convertToFormat(QImage::Format_Grayscale8);
+
+    if (source->cancelled.loadAcquire())
+        return QSharedPointer<Tile>();
+
+    const int w = gray.width();
+    const int h = gray.height();
+    const int threshold = source->threshold;
+    QVector<uchar> wall(w * h);
+    for (int y = 0; y < h; y++)
+    {
+        const uchar *line = gray.constScanLine(y);
+        uchar *out = wall.data() + y * w;
+        for (int x = 0; x < w; x++)
+            out[x] = line[x] < threshold;
+    }
+
+    // Edges are wall pixels next to floor. Corners are pixels of either
+    // kind with the other kind both beside and above or below them, which
+    // catches the inner corner of a room as well as the outer corner of a
+    // wall.
+    QVector<uchar> features(w * h, 0);
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            const int i = y * w + x;
+            const uchar self = wall.at(i);
+            const bool left = x > 0 && wall.at(i - 1) != self;
+            const bool right = x + 1 < w && wall.at(i + 1) != self;
+            const bool up = y > 0 && wall.at(i - w) != self;
+            const bool down = y + 1 < h && wall.at(i + w) != self;
+            if (self && (left || right || up || down))
+                features[i] |= EdgeBit;
+            if ((left || right) && (up || down))
+                features[i] |= CornerBit;
+        }
+    }
+
+    QVector<short> edgeX, edgeY, cornerX, cornerY;
+    nearestSeeds(features, EdgeBit, w, h, &edgeX, &edgeY);
+    nearestSeeds(features, CornerBit, w, h, &cornerX, &cornerY);
+
+    QSharedPointer<Tile> tile(new Tile);
+    tile->offsets.fill(noOffset, 4 * tileSide * tileSide);
+    qint8 *out = tile->offsets.data();
+    const int reach2 = reach * reach;
+    auto store = [reach2](qint8 *to, int dx, int dy) {
+        if (dx != none && dx * dx + dy * dy <= reach2)
+        {
+            to[0] = qint8(dx);
+            to[1] = qint8(dy);
+        }
+    };
+    for (int y = tileArea.top(); y <= tileArea.bottom(); y++)
+    {
+        for (int x = tileArea.left(); x <= tileArea.right(); x++)
+        {
+            const int i = (y - region.top()) * w + (x - region.left());
+            qint8 *to = out + 4 * ((y - ty * tileSide) * tileSide + (x - tx * tileSide));
+            store(to, edgeX.at(i), edgeY.at(i));
+            store(to + 2, cornerX.at(i), cornerY.at(i));
+        }
+    }
+    return tile;
+}
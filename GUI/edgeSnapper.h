@@ -0,0 +1,83 @@
+#ifndef EDGESNAPPER_H
+#define EDGESNAPPER_H
+
+#include <QAtomicInt>
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+// Magnetic snapping onto the walls of a plan image. Walls are found by
+// binarizing the image, their outline pixels form the edge map and outline
+// pixels that turn a corner form the corner map. For every pixel the offset
+// to the nearest edge and corner is precomputed, so a snap query is a tile
+// lookup and one read.
+//
+// The fields are computed on a background thread in tiles, per zoom level
+// (level 0 is full resolution, every further level halves it) and kept in
+// an LRU cache. A query on a tile that is not ready yet misses and queues
+// the tile; prefetch() queues the visible ones ahead of time.
+class EdgeSnapper : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EdgeSnapper(int tileSize = 256, int cacheKilobytes = 64 * 1024, QObject *parent = nullptr);
+    ~EdgeSnapper();
+
+    // Drops every tile of the previous image, nothing is computed until
+    // tiles are asked for.
+    void setImage(const QImage &image);
+    void clear();
+    int cacheKilobytes() const { return cache.totalCost(); }
+
+    // Capture radius in screen pixels, at most 63.
+    void setSnapRadius(int pixels);
+    int snapRadius() const { return radius; }
+
+    int levelFor(qreal scale) const;
+
+    // Moves pos (image coordinates) onto the nearest wall corner within the
+    // snap radius at the given view scale, or else onto the nearest wall
+    // edge. Returns false and leaves snapped alone when there is nothing in
+    // reach or the tile is still being computed.
+    bool snap(const QPoint &pos, qreal scale, QPoint *snapped);
+
+    // Queues the tiles covering area, in image coordinates, at the level
+    // matching scale.
+    void prefetch(const QRect &area, qreal scale);
+
+private:
+    struct Source
+    {
+        QImage image;
+        int threshold = -1;
+        QAtomicInt cancelled;
+    };
+
+    // Per pixel of a tile, dx and dy to the nearest edge, then to the
+    // nearest corner. -128 marks nothing in range.
+    struct Tile
+    {
+        QVector<qint8> offsets;
+    };
+
+    static quint64 tileKey(int level, int tx, int ty);
+    void request(int level, int tx, int ty);
+    void deliver(quint64 generation, quint64 key, const QSharedPointer<Tile> &tile);
+    static QSharedPointer<Tile> computeTile(Source *source, int level, int tx, int ty,
+                                            int tileSide, int reach);
+
+    QThreadPool pool;
+    QSharedPointer<Source> source;
+    quint64 generation = 0;
+    int tileSide;
+    int maxLevel = 0;
+    int radius = 10;
+    QCache<quint64, Tile> cache;
+    QSet<quint64> pending;
+};
+
+#endif // EDGESNAPPER_H
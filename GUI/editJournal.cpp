@@ -0,0 +1,228 @@
+#include "editJournal.h"
+
+EditJournal::EditJournal(PolygonDocument *document, QObject *parent)
+    : QObject(parent), document(document)
+{
+    connect(document, &PolygonDocument::polygonInserted, this, &EditJournal::polygonInserted);
+    connect(document, &PolygonDocument::polygonRemoved, this, &EditJournal::polygonRemoved);
+    connect(document, &PolygonDocument::polygonReplaced, this, &EditJournal::polygonReplaced);
+    connect(document, &PolygonDocument::vertexInserted, this, &EditJournal::vertexInserted);
+    connect(document, &PolygonDocument::vertexMoved, this, &EditJournal::vertexMoved);
+    connect(document, &PolygonDocument::vertexRemoved, this, &EditJournal::vertexRemoved);
+    connect(document, &PolygonDocument::documentAboutToReset, this, &EditJournal::aboutToReset);
+    connect(document, &PolygonDocument::documentReset, this, &EditJournal::reset);
+}
+
+void EditJournal::beginCommand()
+{
+    commandOpen = true;
+    commandEntry = false;
+}
+
+void EditJournal::endCommand()
+{
+    commandOpen = false;
+    commandEntry = false;
+}
+
+void EditJournal::clear()
+{
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+    undoStack.clear();
+    redoStack.clear();
+    endCommand();
+    notify(couldUndo, couldRedo);
+}
+
+void EditJournal::undo()
+{
+    if (undoStack.isEmpty())
+        return;
+    endCommand();
+
+    const bool couldRedo = canRedo();
+    const Entry entry = undoStack.takeLast();
+    replaying = true;
+    for (int i = entry.length() - 1; i >= 0; i--)
+        apply(entry.at(i), false);
+    replaying = false;
+    redoStack.append(entry);
+
+    notify(true, couldRedo);
+}
+
+void EditJournal::redo()
+{
+    if (redoStack.isEmpty())
+        return;
+    endCommand();
+
+    const bool couldUndo = canUndo();
+    const Entry entry = redoStack.takeLast();
+    replaying = true;
+    for (const Change &c : entry)
+        apply(c, true);
+    replaying = false;
+    undoStack.append(entry);
+
+    notify(couldUndo, true);
+}
+
+void EditJournal::polygonInserted(PolygonDocument::Layer layer, int index)
+{
+    Change c = change(Change::InsertPolygon, layer, index);
+    c.points = document->polygon(layer, index);
+    if (layer == PolygonDocument::Rooms)
+        c.color = document->colors().at(index);
+    record(c);
+}
+
+void EditJournal::polygonRemoved(PolygonDocument::Layer layer, int index,
+                                 const QPolygon &points, const QString &color)
+{
+    Change c = change(Change::RemovePolygon, layer, index);
+    c.points = points;
+    c.color = color;
+    record(c);
+}
+
+void EditJournal::polygonReplaced(PolygonDocument::Layer layer, int index, const QPolygon &from)
+{
+    Change c = change(Change::ReplacePolygon, layer, index);
+    c.points = from;
+    c.replacement = document->polygon(layer, index);
+    record(c);
+}
+
+void EditJournal::vertexInserted(PolygonDocument::Layer layer, int index, int vertex)
+{
+    Change c = change(Change::InsertVertex, layer, index, vertex);
+    c.to = document->polygon(layer, index).at(vertex);
+    record(c);
+}
+
+void EditJournal::vertexMoved(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from)
+{
+    Change c = change(Change::MoveVertex, layer, index, vertex);
+    c.from = from;
+    c.to = document->polygon(layer, index).at(vertex);
+    record(c);
+}
+
+void EditJournal::vertexRemoved(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from)
+{
+    Change c = change(Change::RemoveVertex, layer, index, vertex);
+    c.from = from;
+    record(c);
+}
+
+void EditJournal::aboutToReset()
+{
+    if (!replaying)
+        beforeReset = document->toProjectData();
+}
+
+void EditJournal::reset()
+{
+    Change c = change(Change::Reset, PolygonDocument::Rooms, 0);
+    c.before = beforeReset;
+    c.after = document->toProjectData();
+    beforeReset = ProjectData();
+    record(c);
+}
+
+EditJournal::Change EditJournal::change(Change::Kind kind, PolygonDocument::Layer layer,
+                                        int index, int vertex) const
+{
+    Change c;
+    c.kind = kind;
+    c.layer = layer;
+    c.index = index;
+    c.vertex = vertex;
+    return c;
+}
+
+void EditJournal::record(const Change &c)
+{
+    if (replaying)
+        return;
+
+    const bool couldUndo = canUndo();
+    const bool couldRedo = canRedo();
+    redoStack.clear();
+
+    // The first change of a command opens its entry, without a command
+    // every change stands alone.
+    if (!commandEntry)
+    {
+        undoStack.append(Entry());
+        commandEntry = commandOpen;
+    }
+    Entry &entry = undoStack.last();
+
+    // A drag moves the same vertex over and over, only its first position
+    // and the latest one matter. A point placed right after it was added
+    // simply gets added there.
+    if (c.kind == Change::MoveVertex && !entry.isEmpty())
+    {
+        Change &last = entry.last();
+        if ((last.kind == Change::MoveVertex || last.kind == Change::InsertVertex)
+                && last.layer == c.layer && last.index == c.index && last.vertex == c.vertex)
+        {
+            last.to = c.to;
+            notify(couldUndo, couldRedo);
+            return;
+        }
+    }
+    entry.append(c);
+    notify(couldUndo, couldRedo);
+}
+
+void EditJournal::apply(const Change &c, bool forward)
+{
+    switch (c.kind)
+    {
+    case Change::InsertPolygon:
+        if (forward)
+            document->insertPolygon(c.layer, c.index, c.points, c.color);
+        else
+            document->removePolygon(c.layer, c.index);
+        break;
+    case Change::RemovePolygon:
+        if (forward)
+            document->removePolygon(c.layer, c.index);
+        else
+            document->insertPolygon(c.layer, c.index, c.points, c.color);
+        break;
+    case Change::ReplacePolygon:
+        document->replacePolygon(c.layer, c.index, forward ? c.replacement : c.points);
+        break;
+    case Change::InsertVertex:
+        if (forward)
+            document->insertVertex(c.layer, c.index, c.vertex, c.to);
+        else
+            document->removeVertex(c.layer, c.index, c.vertex);
+        break;
+    case Change::MoveVertex:
+        document->moveVertex(c.layer, c.index, c.vertex, forward ? c.to : c.from);
+        break;
+    case Change::RemoveVertex:
+        if (forward)
+            document->removeVertex(c.layer, c.index, c.vertex);
+        else
+            document->insertVertex(c.layer, c.index, c.vertex, c.from);
+        break;
+    case Change::Reset:
+        document->setProjectData(forward ? c.after : c.before);
+        break;
+    }
+}
+
+void EditJournal::notify(bool couldUndo, bool couldRedo)
+{
+    if (couldUndo != canUndo())
+        emit canUndoChanged(canUndo());
+    if (couldRedo != canRedo())
+        emit canRedoChanged(canRedo());
+}
@@ -0,0 +1,83 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QObject>
+#include <QVector>
+#include "polygonDocument.h"
+
+// Undo and redo for a PolygonDocument. The journal listens to the
+// document's change signals and keeps only what each edit touched, so its
+// size follows the edits, not the document. Undo and redo replay one entry
+// in O(size of that entry).
+//
+// Changes between beginCommand() and endCommand() form one entry, anything
+// else gets an entry of its own. Repeated moves of the same vertex inside
+// an entry collapse into a single change, a whole drag costs one.
+class EditJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EditJournal(PolygonDocument *document, QObject *parent = nullptr);
+
+    void beginCommand();
+    void endCommand();
+
+    bool canUndo() const { return !undoStack.isEmpty(); }
+    bool canRedo() const { return !redoStack.isEmpty(); }
+    void clear();
+
+public slots:
+    void undo();
+    void redo();
+
+signals:
+    void canUndoChanged(bool canUndo);
+    void canRedoChanged(bool canRedo);
+
+private:
+    struct Change
+    {
+        enum Kind { InsertPolygon, RemovePolygon, ReplacePolygon, InsertVertex, MoveVertex, RemoveVertex, Reset };
+
+        Kind kind;
+        PolygonDocument::Layer layer;
+        int index;
+        int vertex;
+        QPoint from;
+        QPoint to;
+        QPolygon points;
+        // ReplacePolygon only, points holds what it replaced.
+        QPolygon replacement;
+        QString color;
+        // Reset only, both share their lists with the document they were
+        // taken from.
+        ProjectData before;
+        ProjectData after;
+    };
+    typedef QVector<Change> Entry;
+
+    void polygonInserted(PolygonDocument::Layer layer, int index);
+    void polygonRemoved(PolygonDocument::Layer layer, int index, const QPolygon &points, const QString &color);
+    void polygonReplaced(PolygonDocument::Layer layer, int index, const QPolygon &from);
+    void vertexInserted(PolygonDocument::Layer layer, int index, int vertex);
+    void vertexMoved(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from);
+    void vertexRemoved(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from);
+    void aboutToReset();
+    void reset();
+
+    Change change(Change::Kind kind, PolygonDocument::Layer layer, int index, int vertex = 0) const;
+    void record(const Change &change);
+    void apply(const Change &change, bool forward);
+    void notify(bool couldUndo, bool couldRedo);
+
+    PolygonDocument *document;
+    QVector<Entry> undoStack;
+    QVector<Entry> redoStack;
+    bool commandOpen = false;
+    bool commandEntry = false;
+    bool replaying = false;
+    ProjectData beforeReset;
+};
+
+#endif // EDITJOURNAL_H
@@ -0,0 +1,43 @@
+#include "floor.h"
+#include <QFileInfo>
+
+Floor::Floor(const QString &autosaveBase, QObject *parent)
+    : QObject(parent)
+{
+    doc.appendPolygon(PolygonDocument::Rooms, QPolygon(), "blue");
+    edits = new EditJournal(&doc, this);
+    rooms = new RoomAnalytics(&doc, this);
+    checker = new PolygonValidator(&doc, this);
+    worker = new GeometryWorker(&doc, this);
+    // A full check or rebuild done by the worker spares the GUI thread one.
+    connect(worker, &GeometryWorker::refreshed, this,
+            [this](const QVector<PolygonValidator::Issue> &issues, const RoomAnalytics::Tables &tables) {
+        checker->setValidated(issues);
+        rooms->setTables(tables);
+    });
+    if (!autosaveBase.isEmpty())
+        saver = new Autosave(&doc, autosaveBase, this);
+}
+
+Floor::~Floor()
+{
+    // All of them hold the document, which goes before QObject deletes its
+    // children.
+    delete saver;
+    delete worker;
+    delete checker;
+    delete rooms;
+    delete edits;
+}
+
+void Floor::setImageFile(const QString &fileName)
+{
+    file = fileName;
+    if (saver)
+        saver->setImageFile(fileName);
+}
+
+QString Floor::name() const
+{
+    return file.isEmpty() ? tr("Empty floor") : QFileInfo(file).completeBaseName();
+}
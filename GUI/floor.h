@@ -0,0 +1,63 @@
+#ifndef FLOOR_H
+#define FLOOR_H
+
+#include <QObject>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include "autosave.h"
+#include "editJournal.h"
+#include "geometryWorker.h"
+#include "polygonDocument.h"
+#include "polygonValidator.h"
+#include "roomAnalytics.h"
+
+// One plan of the workspace: the image file it shows and its own document
+// with undo history, room analytics, validation and geometry worker. Open
+// floors keep all of it while another one is edited; the decoded image
+// lives in the shared PlanCache instead.
+class Floor : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Where the view was left, restored when the floor is shown again.
+    struct View
+    {
+        double scale = 1.0;
+        QPoint scroll;
+        QRect area;         // visible image area, null until first shown
+    };
+
+    // With a base path, every edit is journaled there, see Autosave.
+    explicit Floor(const QString &autosaveBase = QString(), QObject *parent = nullptr);
+    ~Floor();
+
+    QString imageFile() const { return file; }
+    void setImageFile(const QString &fileName);
+    // The image's base name, for menus and the window title.
+    QString name() const;
+
+    PolygonDocument *document() { return &doc; }
+    EditJournal *journal() const { return edits; }
+    RoomAnalytics *analytics() const { return rooms; }
+    PolygonValidator *validator() const { return checker; }
+    GeometryWorker *geometryWorker() const { return worker; }
+    // Null without a base path.
+    Autosave *autosave() const { return saver; }
+
+    const View &view() const { return lastView; }
+    void setView(const View &view) { lastView = view; }
+
+private:
+    QString file;
+    PolygonDocument doc;
+    EditJournal *edits;
+    RoomAnalytics *rooms;
+    PolygonValidator *checker;
+    GeometryWorker *worker;
+    Autosave *saver = nullptr;
+    View lastView;
+};
+
+#endif // FLOOR_H
@@ -0,0 +1,122 @@
+#include "geometryKernels.h"
+#include <QtMath>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OUTLINEFLOW_SSE2
+#endif
+
+float distToSegment(QPoint newPoint, QPoint p1, QPoint p2)
+{
+    int x1 = p1.x();
+    int y1 = p1.y();
+    int x2 = p2.x();
+    int y2 = p2.y();
+    int x3 = newPoint.x();
+    int y3 = newPoint.y();
+
+    float px=x2-x1;
+    float py=y2-y1;
+    float temp=(px*px)+(py*py);
+    float u = 0;
+    if(temp != 0)
+        u=((x3 - x1) * px + (y3 - y1) * py) / (temp);
+
+    if(u>1)
+    {
+        u=1;
+    }
+    else if(u<0)
+    {
+        u=0;
+    }
+
+    float x = x1 + u * px;
+    float y = y1 + u * py;
+
+    float dx = x - x3;
+    float dy = y - y3;
+
+    return qSqrt(dx*dx + dy*dy);
+}
+
+void distToSegments(QPoint newPoint, const float *x1, const float *y1,
+                    const float *x2, const float *y2, float *dist, int n)
+{
+    const float x3 = newPoint.x();
+    const float y3 = newPoint.y();
+    int i = 0;
+
+#ifdef OUTLINEFLOW_SSE2
+    const __m128 vx3 = _mm_set1_ps(x3);
+    const __m128 vy3 = _mm_set1_ps(y3);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 ax = _mm_loadu_ps(x1 + i);
+        __m128 ay = _mm_loadu_ps(y1 + i);
+        __m128 px = _mm_sub_ps(_mm_loadu_ps(x2 + i), ax);
+        __m128 py = _mm_sub_ps(_mm_loadu_ps(y2 + i), ay);
+        __m128 temp = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+
+        __m128 dot = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vx3, ax), px),
+                                _mm_mul_ps(_mm_sub_ps(vy3, ay), py));
+        // Lanes with a zero-length segment divide 0/0; mask them to u = 0.
+        __m128 u = _mm_andnot_ps(_mm_cmpeq_ps(temp, zero), _mm_div_ps(dot, temp));
+        u = _mm_min_ps(_mm_max_ps(u, zero), one);
+
+        __m128 dx = _mm_sub_ps(_mm_add_ps(ax, _mm_mul_ps(u, px)), vx3);
+        __m128 dy = _mm_sub_ps(_mm_add_ps(ay, _mm_mul_ps(u, py)), vy3);
+        _mm_storeu_ps(dist + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+    }
+#endif
+
+    for (; i < n; i++)
+        dist[i] = distToSegment(newPoint, QPoint(x1[i], y1[i]), QPoint(x2[i], y2[i]));
+}
+
+void transformPoints(const QTransform &transform, int *x, int *y, int n)
+{
+    const float m11 = transform.m11();
+    const float m12 = transform.m12();
+    const float m21 = transform.m21();
+    const float m22 = transform.m22();
+    const float dx = transform.dx();
+    const float dy = transform.dy();
+    int i = 0;
+
+#ifdef OUTLINEFLOW_SSE2
+    const __m128 v11 = _mm_set1_ps(m11);
+    const __m128 v12 = _mm_set1_ps(m12);
+    const __m128 v21 = _mm_set1_ps(m21);
+    const __m128 v22 = _mm_set1_ps(m22);
+    const __m128 vdx = _mm_set1_ps(dx);
+    const __m128 vdy = _mm_set1_ps(dy);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i *px = reinterpret_cast<__m128i *>(x + i);
+        __m128i *py = reinterpret_cast<__m128i *>(y + i);
+        const __m128 ax = _mm_cvtepi32_ps(_mm_loadu_si128(px));
+        const __m128 ay = _mm_cvtepi32_ps(_mm_loadu_si128(py));
+        const __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, v11), _mm_mul_ps(ay, v21)), vdx);
+        const __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, v12), _mm_mul_ps(ay, v22)), vdy);
+        // The default rounding mode, to nearest even, like nearbyint below.
+        _mm_storeu_si128(px, _mm_cvtps_epi32(tx));
+        _mm_storeu_si128(py, _mm_cvtps_epi32(ty));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        const float ax = x[i];
+        const float ay = y[i];
+        const float tx = ax * m11 + ay * m21 + dx;
+        const float ty = ax * m12 + ay * m22 + dy;
+        x[i] = int(std::nearbyint(tx));
+        y[i] = int(std::nearbyint(ty));
+    }
+}
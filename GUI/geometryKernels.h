@@ -0,0 +1,21 @@
+#ifndef GEOMETRYKERNELS_H
+#define GEOMETRYKERNELS_H
+
+#include <QPoint>
+#include <QTransform>
+
+// Distance from newPoint to the segment p1-p2. A zero-length segment
+// measures the distance to p1.
+float distToSegment(QPoint newPoint, QPoint p1, QPoint p2);
+
+// Batched form of distToSegment over packed segment coordinates. Produces
+// the same values as the scalar version, n results are written to dist.
+void distToSegments(QPoint newPoint, const float *x1, const float *y1,
+                    const float *x2, const float *y2, float *dist, int n);
+
+// Applies the affine part of transform to n points given as packed x and y
+// coordinates, in place, in one pass. Computed in single precision and
+// rounded to the nearest pixel, halfway cases to even, with or without SSE2.
+void transformPoints(const QTransform &transform, int *x, int *y, int n);
+
+#endif // GEOMETRYKERNELS_H
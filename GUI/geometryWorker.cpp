@@ -0,0 +1,201 @@
+#include "geometryWorker.h"
+#include <QtConcurrent>
+#include "trace.h"
+
+GeometryWorker::GeometryWorker(const PolygonDocument *document, QObject *parent)
+    : QObject(parent), document(document), cache(new Cache), cancelled(new QAtomicInt(0))
+{
+    pool.setMaxThreadCount(1);
+
+    auto bump = [this]() { ++currentVersion; };
+    connect(document, &PolygonDocument::polygonInserted, this, bump);
+    connect(document, &PolygonDocument::polygonRemoved, this, bump);
+    connect(document, &PolygonDocument::polygonReplaced, this, bump);
+    connect(document, &PolygonDocument::vertexInserted, this, bump);
+    connect(document, &PolygonDocument::vertexMoved, this, bump);
+    connect(document, &PolygonDocument::vertexRemoved, this, bump);
+    connect(document, &PolygonDocument::documentReset, this, bump);
+}
+
+GeometryWorker::~GeometryWorker()
+{
+    cancelled->storeRelease(1);
+    pool.waitForDone();
+}
+
+GeometryWorker::Snapshot GeometryWorker::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.version = currentVersion;
+    snapshot.data = document->toProjectData();
+    return snapshot;
+}
+
+void GeometryWorker::findNearestSegment(const QPoint &pos)
+{
+    if (nearestBusy)
+    {
+        nearestPending = true;
+        pendingPos = pos;
+        return;
+    }
+    nearestBusy = true;
+
+    const Snapshot snap = snapshot();
+    const QSharedPointer<Cache> state = cache;
+    const QSharedPointer<QAtomicInt> flag = cancelled;
+    QtConcurrent::run(&pool, [this, snap, state, flag, pos]() {
+        if (flag->loadAcquire())
+            return;
+
+        // Rebuilt once per version, hovering over a plan that does not
+        // change reuses it.
+        if (state->version != snap.version)
+        {
+            TRACE_SCOPE("workerIndex");
+            state->polygons = snap.data.polygons;
+            state->edges.rebuild(state->polygons);
+            state->version = snap.version;
+        }
+
+        int polygon = -1;
+        int edge = -1;
+        float distance = 0;
+        {
+            TRACE_SCOPE("workerNearest");
+            if (!state->edges.nearest(pos, &polygon, &edge, &distance))
+                polygon = -1;
+        }
+
+        const quint64 version = snap.version;
+        QMetaObject::invokeMethod(this, [this, version, pos, polygon, edge, distance]() {
+            deliverNearest(version, pos, polygon, edge, distance);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GeometryWorker::validate()
+{
+    validationWanted = true;
+
+    const Snapshot snap = snapshot();
+    const QSharedPointer<QAtomicInt> flag = cancelled;
+    QtConcurrent::run(&pool, [this, snap, flag]() {
+        if (flag->loadAcquire())
+            return;
+
+        const QVector<PolygonValidator::Issue> issues = PolygonValidator::validate(snap.data.polygons);
+        const quint64 version = snap.version;
+        QMetaObject::invokeMethod(this, [this, version, issues]() {
+            deliverValidation(version, issues);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GeometryWorker::refresh(int reach)
+{
+    refreshWanted = true;
+    refreshReach = reach;
+
+    const Snapshot snap = snapshot();
+    const QSharedPointer<QAtomicInt> flag = cancelled;
+    QtConcurrent::run(&pool, [this, snap, flag, reach]() {
+        if (flag->loadAcquire())
+            return;
+
+        QVector<PolygonValidator::Issue> issues;
+        RoomAnalytics::Tables tables;
+        {
+            TRACE_SCOPE("workerRefresh");
+            issues = PolygonValidator::validate(snap.data.polygons);
+            PolygonDocument copy;
+            copy.setProjectData(snap.data);
+            RoomAnalytics analytics(&copy);
+            analytics.setReach(reach);
+            tables = analytics.tables();
+        }
+
+        const quint64 version = snap.version;
+        QMetaObject::invokeMethod(this, [this, version, issues, tables]() {
+            deliverRefresh(version, issues, tables);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GeometryWorker::exportProject(const QString &fileName, const ProjectData &data)
+{
+    QtConcurrent::run(&pool, [this, fileName, data]() {
+        QString error;
+        {
+            TRACE_SCOPE("workerExport");
+            ProjectIO::write(fileName, data, &error);
+        }
+        QMetaObject::invokeMethod(this, [this, fileName, error]() {
+            emit exported(fileName, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GeometryWorker::exportAnalytics(const QString &fileName, int reach)
+{
+    const Snapshot snap = snapshot();
+    QtConcurrent::run(&pool, [this, fileName, reach, snap]() {
+        QString error;
+        {
+            TRACE_SCOPE("workerAnalytics");
+            // A private document, the one on the GUI thread keeps changing.
+            PolygonDocument copy;
+            copy.setProjectData(snap.data);
+            RoomAnalytics analytics(&copy);
+            analytics.setReach(reach);
+            analytics.exportJson(fileName, &error);
+        }
+        QMetaObject::invokeMethod(this, [this, fileName, error]() {
+            emit exported(fileName, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void GeometryWorker::deliverNearest(quint64 version, const QPoint &pos, int polygon, int edge, float distance)
+{
+    nearestBusy = false;
+    if (nearestPending)
+    {
+        nearestPending = false;
+        findNearestSegment(pendingPos);
+        return;
+    }
+    if (version != currentVersion)
+        return;
+
+    emit nearestSegmentFound(pos, polygon, edge, distance);
+}
+
+void GeometryWorker::deliverValidation(quint64 version, const QVector<PolygonValidator::Issue> &issues)
+{
+    if (!validationWanted)
+        return;
+    if (version != currentVersion)
+    {
+        validate();
+        return;
+    }
+
+    validationWanted = false;
+    emit validated(issues);
+}
+
+void GeometryWorker::deliverRefresh(quint64 version, const QVector<PolygonValidator::Issue> &issues,
+                                    const RoomAnalytics::Tables &tables)
+{
+    if (!refreshWanted)
+        return;
+    if (version != currentVersion)
+    {
+        refresh(refreshReach);
+        return;
+    }
+
+    refreshWanted = false;
+    emit refreshed(issues, tables);
+}
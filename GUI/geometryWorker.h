@@ -0,0 +1,90 @@
+#ifndef GEOMETRYWORKER_H
+#define GEOMETRYWORKER_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QPoint>
+#include <QSharedPointer>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include "polygonDocument.h"
+#include "polygonValidator.h"
+#include "projectIO.h"
+#include "roomAnalytics.h"
+#include "segmentIndex.h"
+
+// Runs the heavy geometry queries on a worker thread: nearest segment,
+// full validation, room analytics and file export. Each query works on a
+// snapshot of the document. The lists of a snapshot are implicitly
+// shared, taking one costs a few reference counts and the next edit
+// detaches from it, so the GUI thread never waits on the worker.
+//
+// Every edit bumps the document version. Answers computed for an older
+// version are dropped; a requested validation or refresh runs again on the
+// current snapshot instead. Exports always finish, they write what was
+// asked for.
+class GeometryWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Snapshot
+    {
+        quint64 version = 0;
+        ProjectData data;
+    };
+
+    explicit GeometryWorker(const PolygonDocument *document, QObject *parent = nullptr);
+    ~GeometryWorker();
+
+    quint64 version() const { return currentVersion; }
+    Snapshot snapshot() const;
+
+    // Only the latest position is looked up while one is in flight.
+    void findNearestSegment(const QPoint &pos);
+    void validate();
+    // The full validation and room analytics, for a PolygonValidator and
+    // RoomAnalytics of the document that would otherwise start over on the
+    // GUI thread.
+    void refresh(int reach);
+    void exportProject(const QString &fileName, const ProjectData &data);
+    void exportAnalytics(const QString &fileName, int reach);
+
+signals:
+    void nearestSegmentFound(const QPoint &pos, int polygon, int edge, float distance);
+    void validated(const QVector<PolygonValidator::Issue> &issues);
+    void refreshed(const QVector<PolygonValidator::Issue> &issues, const RoomAnalytics::Tables &tables);
+    // error is empty on success.
+    void exported(const QString &fileName, const QString &error);
+
+private:
+    // Worker side, only touched by the single pool thread.
+    struct Cache
+    {
+        quint64 version = 0;
+        // The index reads its points from here.
+        QList<QPolygon> polygons;
+        SegmentIndex edges;
+    };
+
+    void deliverNearest(quint64 version, const QPoint &pos, int polygon, int edge, float distance);
+    void deliverValidation(quint64 version, const QVector<PolygonValidator::Issue> &issues);
+    void deliverRefresh(quint64 version, const QVector<PolygonValidator::Issue> &issues,
+                        const RoomAnalytics::Tables &tables);
+
+    const PolygonDocument *document;
+    QThreadPool pool;
+    QSharedPointer<Cache> cache;
+    QSharedPointer<QAtomicInt> cancelled;
+    quint64 currentVersion = 1;
+
+    bool nearestBusy = false;
+    bool nearestPending = false;
+    QPoint pendingPos;
+    bool validationWanted = false;
+    bool refreshWanted = false;
+    int refreshReach = 0;
+};
+
+#endif // GEOMETRYWORKER_H
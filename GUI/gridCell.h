@@ -0,0 +1,17 @@
+#ifndef GRIDCELL_H
+#define GRIDCELL_H
+
+#include <QtGlobal>
+
+// Shared helpers for the uniform grids used by the spatial indexes.
+inline int gridFloorDiv(int v, int cellSize)
+{
+    return v >= 0 ? v / cellSize : -((-v + cellSize - 1) / cellSize);
+}
+
+inline quint64 gridCellKey(int cx, int cy)
+{
+    return (quint64(quint32(cx)) << 32) | quint32(cy);
+}
+
+#endif // GRIDCELL_H
@@ -0,0 +1,286 @@
+#include "imageLoader.h"
+#include <QImageReader>
+#include <QRgb>
+#include <QtConcurrent>
+#include <cstring>
+#include "trace.h"
+
+namespace {
+
+// Fewer bands decode faster, a reader cutting bands from a JPEG decodes
+// everything above each one, so eight bands cost about four and a half
+// full decodes. Eight hold the peak near an eighth of the full image at
+// 32 bits.
+const int bands = 8;
+// Below this the full image at 32 bits fits, and one decode is much
+// faster than bands.
+const qint64 minBandedBytes = 256 * 1024 * 1024;
+// Side of the sample decoded to spot color before banding.
+const int sampleSide = 256;
+
+// Whether every pixel is gray, and of those whether all are black or white.
+void classify(const QImage &image, bool *gray, bool *mono)
+{
+    auto check = [gray, mono](QRgb c) {
+        const int v = qRed(c);
+        if (qAlpha(c) != 255 || v != qGreen(c) || v != qBlue(c))
+            *gray = false;
+        else if (v != 0 && v != 255)
+            *mono = false;
+    };
+
+    if (image.format() == QImage::Format_Indexed8)
+    {
+        // The table decides, unused entries included.
+        for (const QRgb c : image.colorTable())
+            check(c);
+        return;
+    }
+
+    const bool direct = image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32;
+    // Scans often are color JPEGs of gray paper, the first colored pixel
+    // ends the scan.
+    for (int y = 0; y < image.height() && *gray; y++)
+    {
+        const QImage row = direct ? QImage() : image.copy(0, y, image.width(), 1).convertToFormat(QImage::Format_ARGB32);
+        const QRgb *line = reinterpret_cast<const QRgb *>(direct ? image.constScanLine(y) : row.constScanLine(0));
+        for (int x = 0; x < image.width() && *gray; x++)
+            check(line[x]);
+    }
+}
+
+}
+
+ImageLoader::ImageLoader(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(1);
+}
+
+ImageLoader::~ImageLoader()
+{
+    cancel();
+    pool.waitForDone();
+}
+
+void ImageLoader::load(const QString &fileName)
+{
+    cancel();
+
+    const quint64 job = ++currentJob;
+    const QSharedPointer<QAtomicInt> flag(new QAtomicInt(0));
+    const int side = previewSide;
+    const bool compactImage = compact;
+    cancelled = flag;
+    loading = true;
+
+    QtConcurrent::run(&pool, [this, job, flag, fileName, side, compactImage]() {
+        QImageReader probe(fileName);
+        probe.setAutoTransform(true);
+        QSize fullSize = probe.size();
+        QImage preview;
+
+        if (fullSize.isValid() && qMax(fullSize.width(), fullSize.height()) > side
+                && probe.supportsOption(QImageIOHandler::ScaledSize))
+        {
+            const QSize scaled = fullSize.scaled(side, side, Qt::KeepAspectRatio);
+            probe.setScaledSize(scaled);
+            {
+                TRACE_SCOPE("decodePreview");
+                preview = probe.read();
+            }
+            if (flag->loadAcquire())
+                return;
+
+            if (!preview.isNull())
+            {
+                // Auto transform may have rotated the picture by 90 degrees.
+                if (preview.size() != scaled && preview.size() == scaled.transposed())
+                    fullSize.transpose();
+                QMetaObject::invokeMethod(this, [this, job, preview, fullSize]() {
+                    deliver(job, preview, fullSize, true);
+                }, Qt::QueuedConnection);
+            }
+        }
+
+        QImage image;
+        QString error;
+        {
+            TRACE_SCOPE("decodeImage");
+            if (compactImage)
+            {
+                image = readCompact(fileName, &error, flag.data(), preview);
+            }
+            else
+            {
+                QImageReader reader(fileName);
+                reader.setAutoTransform(true);
+                image = reader.read();
+                if (image.isNull())
+                    error = reader.errorString();
+            }
+        }
+        if (flag->loadAcquire())
+            return;
+
+        if (image.isNull())
+        {
+            QMetaObject::invokeMethod(this, [this, job, fileName, error]() {
+                deliverError(job, fileName, error);
+            }, Qt::QueuedConnection);
+            return;
+        }
+
+        QMetaObject::invokeMethod(this, [this, job, image]() {
+            deliver(job, image, image.size(), false);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ImageLoader::cancel()
+{
+    if (cancelled)
+        cancelled->storeRelease(1);
+    cancelled.reset();
+    loading = false;
+}
+
+void ImageLoader::deliver(quint64 job, const QImage &image, const QSize &fullSize, bool preview)
+{
+    if (job != currentJob || !loading)
+        return;
+
+    if (preview)
+    {
+        emit previewReady(image, fullSize);
+    }
+    else
+    {
+        loading = false;
+        emit imageReady(image);
+    }
+}
+
+void ImageLoader::deliverError(quint64 job, const QString &fileName, const QString &error)
+{
+    if (job != currentJob || !loading)
+        return;
+
+    loading = false;
+    emit failed(fileName, error);
+}
+
+QImage ImageLoader::compacted(const QImage &image)
+{
+    if (image.isNull() || image.depth() == 1 || image.format() == QImage::Format_Grayscale8)
+        return image;
+
+    bool gray = true;
+    bool mono = true;
+    classify(image, &gray, &mono);
+    if (!gray)
+        return image;
+    if (mono)
+        return image.convertToFormat(QImage::Format_Mono, Qt::MonoOnly | Qt::ThresholdDither);
+    return image.convertToFormat(QImage::Format_Grayscale8);
+}
+
+QImage ImageLoader::readCompact(const QString &fileName, QString *error, const QAtomicInt *cancel,
+                                const QImage &preview)
+{
+    QImageReader reader(fileName);
+    reader.setAutoTransform(true);
+    const QSize size = reader.size();
+    const QImage::Format format = reader.imageFormat();
+    const bool small = format == QImage::Format_Mono || format == QImage::Format_MonoLSB
+            || format == QImage::Format_Indexed8 || format == QImage::Format_Grayscale8;
+
+    // Files that decode to 1 or 8 bits are small already. So are plans
+    // that fit at 32 bits, and a reader that cannot cut bands, or would
+    // turn each band on its own, leaves nothing but a full decode.
+    bool banded = !small && size.isValid() && qint64(size.width()) * size.height() * 4 >= minBandedBytes
+            && reader.supportsOption(QImageIOHandler::ClipRect)
+            && reader.transformation() == QImageIOHandler::TransformationNone;
+
+    if (banded)
+    {
+        // A colored plan would only show in some band and then be decoded
+        // once more in full. A small sample tells most of them up front; a
+        // gray one still gets every band checked.
+        QImage sample = preview;
+        if (sample.isNull() && reader.supportsOption(QImageIOHandler::ScaledSize))
+        {
+            QImageReader sampleReader(fileName);
+            sampleReader.setScaledSize(size.scaled(sampleSide, sampleSide, Qt::KeepAspectRatio));
+            sample = sampleReader.read();
+        }
+        bool isGray = true;
+        bool isMono = true;
+        if (!sample.isNull())
+            classify(sample, &isGray, &isMono);
+        banded = isGray;
+    }
+
+    if (!banded)
+    {
+        const QImage image = reader.read();
+        if (image.isNull())
+            *error = reader.errorString();
+        return compacted(image);
+    }
+
+    // Band by band, each one goes into the result at 1 bit while every
+    // pixel so far is black or white, at 8 bits once one is gray. Only one
+    // band is ever held at 32 bits. A colored band ends this, the plan is
+    // then kept as decoded anyway.
+    const int rows = (size.height() + bands - 1) / bands;
+    QImage mono;
+    QImage gray;
+    for (int top = 0; top < size.height(); top += rows)
+    {
+        if (cancel && cancel->loadAcquire())
+            return QImage();
+
+        const QRect band(0, top, size.width(), qMin(rows, size.height() - top));
+        QImageReader bandReader(fileName);
+        bandReader.setClipRect(band);
+        const QImage part = bandReader.read();
+
+        bool isGray = part.size() == band.size();
+        bool isMono = true;
+        if (isGray)
+            classify(part, &isGray, &isMono);
+        if (!isGray)
+        {
+            mono = QImage();
+            gray = QImage();
+            const QImage image = reader.read();
+            if (image.isNull())
+                *error = reader.errorString();
+            return image;
+        }
+
+        if (!isMono && gray.isNull())
+        {
+            // Black and white converts to gray exactly, the rows from top
+            // on are filled by this band and the ones still to come.
+            gray = mono.isNull() ? QImage(size, QImage::Format_Grayscale8)
+                                 : mono.convertToFormat(QImage::Format_Grayscale8);
+            mono = QImage();
+        }
+
+        const QImage converted = gray.isNull()
+                ? part.convertToFormat(QImage::Format_Mono, Qt::MonoOnly | Qt::ThresholdDither)
+                : part.convertToFormat(QImage::Format_Grayscale8);
+        if (gray.isNull() && mono.isNull())
+        {
+            // Every band converts to the same two colors.
+            mono = QImage(size, QImage::Format_Mono);
+            mono.setColorTable(converted.colorTable());
+        }
+        QImage &target = gray.isNull() ? mono : gray;
+        for (int y = 0; y < band.height(); y++)
+            memcpy(target.scanLine(top + y), converted.constScanLine(y), size_t(target.bytesPerLine()));
+    }
+    return gray.isNull() ? mono : gray;
+}
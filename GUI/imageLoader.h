@@ -0,0 +1,62 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QObject>
+#include <QImage>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+// Decodes plan images on a worker thread. A downscaled preview is decoded
+// first when the format can report its size up front, the full image
+// follows. Starting a new load cancels the previous one; results of a
+// cancelled load are never delivered.
+class ImageLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageLoader(QObject *parent = nullptr);
+    ~ImageLoader();
+
+    void load(const QString &fileName);
+    void cancel();
+    bool isLoading() const { return loading; }
+
+    void setPreviewSide(int side) { previewSide = side; }
+
+    // Compact residency stores black-and-white plans as 1-bit and gray
+    // ones as 8-bit gray, whatever the file decoded to. On by default.
+    void setCompact(bool enabled) { compact = enabled; }
+    bool isCompact() const { return compact; }
+
+    // image in the smallest format that holds its pixels exactly, or image
+    // itself.
+    static QImage compacted(const QImage &image);
+    // Decodes fileName straight into what compacted() would give. Where the
+    // plan would not fit at 32 bits and the reader can cut bands out of the
+    // file, a gray or black-and-white plan never exists at 32 bits in full,
+    // only one band at a time. preview, a downscaled decode if there is
+    // one, rules out banding a colored plan. Null with error set on
+    // failure, or null once cancel is set.
+    static QImage readCompact(const QString &fileName, QString *error, const QAtomicInt *cancel = nullptr,
+                              const QImage &preview = QImage());
+
+signals:
+    void previewReady(const QImage &preview, const QSize &fullSize);
+    void imageReady(const QImage &image);
+    void failed(const QString &fileName, const QString &error);
+
+private:
+    void deliver(quint64 job, const QImage &image, const QSize &fullSize, bool preview);
+    void deliverError(quint64 job, const QString &fileName, const QString &error);
+
+    QThreadPool pool;
+    QSharedPointer<QAtomicInt> cancelled;
+    quint64 currentJob = 0;
+    bool loading = false;
+    int previewSide = 2048;
+    bool compact = true;
+};
+
+#endif // IMAGELOADER_H
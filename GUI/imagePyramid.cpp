@@ -0,0 +1,158 @@
+#include "imagePyramid.h"
+#include <QPainter>
+#include <cstring>
+
+namespace {
+
+// Averages every 2x2 block of an 8 or 32 bits per pixel image, per byte. An
+// odd last row or column is averaged with itself.
+QImage halved(const QImage &image)
+{
+    const int bytes = image.depth() / 8;
+    QImage result((image.width() + 1) / 2, (image.height() + 1) / 2, image.format());
+    for (int y = 0; y < result.height(); y++)
+    {
+        const uchar *top = image.constScanLine(2 * y);
+        const uchar *bottom = image.constScanLine(qMin(2 * y + 1, image.height() - 1));
+        uchar *out = result.scanLine(y);
+        for (int x = 0; x < result.width(); x++)
+        {
+            const int left = 2 * x * bytes;
+            const int right = qMin(2 * x + 1, image.width() - 1) * bytes;
+            for (int c = 0; c < bytes; c++)
+                out[x * bytes + c] = uchar((top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c] + 2) / 4);
+        }
+    }
+    return result;
+}
+
+}
+
+ImagePyramid::ImagePyramid(int tileSize, int cacheKilobytes)
+    : tileSide(qMax(16, tileSize))
+{
+    cache.setMaxCost(cacheKilobytes);
+}
+
+void ImagePyramid::setSource(const QImage &image)
+{
+    cache.clear();
+    source = image;
+    // The table decides for 1 and 8 bits, 32 bits are kept as they are.
+    if (source.depth() <= 8 && source.isGrayscale())
+        levelFormat = QImage::Format_Grayscale8;
+    else
+        levelFormat = source.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+
+    maxLevel = 0;
+    int side = qMax(source.width(), source.height());
+    while (side > tileSide)
+    {
+        side /= 2;
+        maxLevel++;
+    }
+}
+
+void ImagePyramid::clear()
+{
+    setSource(QImage());
+}
+
+void ImagePyramid::setCacheLimit(int kilobytes)
+{
+    cache.setMaxCost(kilobytes);
+}
+
+int ImagePyramid::levelFor(qreal scale) const
+{
+    int level = 0;
+    while (level < maxLevel && scale * (2 << level) <= 1.0)
+        level++;
+    return level;
+}
+
+QRect ImagePyramid::tileRect(int level, int tx, int ty) const
+{
+    const int side = tileSide << level;
+    return QRect(tx * side, ty * side, side, side).intersected(source.rect());
+}
+
+QImage ImagePyramid::tile(int level, int tx, int ty)
+{
+    const quint64 key = (quint64(level) << 48) | (quint64(quint32(tx) & 0xffffff) << 24)
+                      | (quint32(ty) & 0xffffff);
+    if (QImage *cached = cache.object(key))
+        return *cached;
+
+    QImage image = renderTile(level, tx, ty);
+    // Level 0 tiles share the source pixels and cost next to nothing.
+    const int cost = level == 0 && source.depth() >= 8 ? 1 : qMax<qint64>(1, image.sizeInBytes() / 1024);
+    cache.insert(key, new QImage(image), cost);
+    return image;
+}
+
+QImage ImagePyramid::renderTile(int level, int tx, int ty)
+{
+    const QRect area = tileRect(level, tx, ty);
+    if (area.isEmpty())
+        return QImage();
+
+    if (level > 0)
+    {
+        // The children come from the cache or are built the same way, so
+        // no level reads more than the one below it.
+        QImage children[2][2];
+        for (int dy = 0; dy < 2; dy++)
+            for (int dx = 0; dx < 2; dx++)
+                children[dy][dx] = tile(level - 1, 2 * tx + dx, 2 * ty + dy).convertToFormat(levelFormat);
+
+        const QImage &first = children[0][0];
+        const int bytes = first.depth() / 8;
+        QImage joined(first.width() + children[0][1].width(), first.height() + children[1][0].height(), levelFormat);
+        for (int dy = 0; dy < 2; dy++)
+        {
+            for (int dx = 0; dx < 2; dx++)
+            {
+                const QImage &child = children[dy][dx];
+                const int left = dx * first.width() * bytes;
+                const int top = dy * first.height();
+                for (int y = 0; y < child.height(); y++)
+                    memcpy(joined.scanLine(top + y) + left, child.constScanLine(y), size_t(child.width() * bytes));
+            }
+        }
+        return halved(joined);
+    }
+
+    if (source.depth() >= 8)
+    {
+        // A view onto the source scanlines, no pixels are copied.
+        const int bytesPerPixel = source.depth() / 8;
+        QImage region(source.constScanLine(area.top()) + area.left() * bytesPerPixel,
+                      area.width(), area.height(), source.bytesPerLine(), source.format());
+        region.setColorTable(source.colorTable());
+        return region;
+    }
+    return source.copy(area);
+}
+
+void ImagePyramid::draw(QPainter &painter, const QRect &area)
+{
+    // The painter already maps image coordinates, tiles of coarser levels
+    // are stretched back over the image area they cover.
+    const QRect visible = area.intersected(source.rect());
+    if (visible.isEmpty())
+        return;
+
+    const int level = levelFor(painter.transform().m11());
+    const int side = tileSide << level;
+
+    for (int ty = visible.top() / side; ty <= visible.bottom() / side; ty++)
+    {
+        for (int tx = visible.left() / side; tx <= visible.right() / side; tx++)
+        {
+            const QImage image = tile(level, tx, ty);
+            if (!image.isNull())
+                painter.drawImage(QRectF(tileRect(level, tx, ty)), image, QRectF(image.rect()));
+        }
+    }
+}
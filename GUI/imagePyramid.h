@@ -0,0 +1,52 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QCache>
+#include <QImage>
+#include <QRect>
+
+class QPainter;
+
+// Multi-resolution tiles over a plan image. Level 0 is full resolution and
+// every further level halves it. Tiles are produced on first use and kept
+// in an LRU cache with a memory budget. A tile above level 0 is built from
+// its four children one level finer, so each level only costs its own
+// pixels.
+class ImagePyramid
+{
+public:
+    explicit ImagePyramid(int tileSize = 256, int cacheKilobytes = 128 * 1024);
+
+    void setSource(const QImage &image);
+    void clear();
+    bool isNull() const { return source.isNull(); }
+    const QImage &image() const { return source; }
+    QSize size() const { return source.size(); }
+    int tileSize() const { return tileSide; }
+
+    void setCacheLimit(int kilobytes);
+    int cacheKilobytes() const { return cache.totalCost(); }
+
+    // Coarsest level that still has at least one pixel per screen pixel.
+    int levelFor(qreal scale) const;
+
+    // Area of the image covered by a tile of the given level.
+    QRect tileRect(int level, int tx, int ty) const;
+    QImage tile(int level, int tx, int ty);
+
+    // Draws the tiles covering area, given in image coordinates, at the level
+    // matching the painter's scale.
+    void draw(QPainter &painter, const QRect &area);
+
+private:
+    QImage renderTile(int level, int tx, int ty);
+
+    QImage source;
+    // Format of the tiles above level 0, 8-bit gray for gray plans.
+    QImage::Format levelFormat = QImage::Format_RGB32;
+    int tileSide;
+    int maxLevel = 0;
+    QCache<quint64, QImage> cache;
+};
+
+#endif // IMAGEPYRAMID_H
@@ -0,0 +1,334 @@
+#include "liveStream.h"
+#include <QtEndian>
+#include "trace.h"
+
+namespace {
+
+enum Message : quint8 { Snapshot = 1, Frame, Hello };
+// Version 2 added replace polygon records.
+const quint32 protocolVersion = 2;
+// How long a server already on the name has to answer.
+const int probeTimeoutMs = 500;
+enum Op : quint8 { InsertPolygon = 1, RemovePolygon, InsertVertex, MoveVertex, RemoveVertex, ReplacePolygon };
+
+void put32(QByteArray *out, quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    out->append(reinterpret_cast<const char *>(bytes), 4);
+}
+
+void putString(QByteArray *out, const QString &text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    put32(out, quint32(utf8.size()));
+    out->append(utf8);
+}
+
+void putPolygon(QByteArray *out, const QPolygon &poly)
+{
+    put32(out, quint32(poly.length()));
+    for (const QPoint &point : poly)
+    {
+        put32(out, quint32(point.x()));
+        put32(out, quint32(point.y()));
+    }
+}
+
+// Starts a message, its size is filled in by endMessage().
+void beginMessage(QByteArray *out, Message type)
+{
+    put32(out, 0);
+    out->append(char(type));
+}
+
+void endMessage(QByteArray *out)
+{
+    qToLittleEndian<quint32>(quint32(out->size() - 4), reinterpret_cast<uchar *>(out->data()));
+}
+
+} // namespace
+
+LiveStream::LiveStream(RedrawScheduler *scheduler, QObject *parent)
+    : QObject(parent), scheduler(scheduler)
+{
+    connect(&server, &QLocalServer::newConnection, this, &LiveStream::newConnection);
+}
+
+LiveStream::~LiveStream()
+{
+    close();
+}
+
+bool LiveStream::listen(const QString &name, QString *error)
+{
+    if (server.listen(name))
+        return true;
+
+    if (server.serverError() != QAbstractSocket::AddressInUseError)
+    {
+        *error = server.errorString();
+        return false;
+    }
+
+    // A server that crashed leaves its socket file behind on Unix. Only a
+    // name nobody answers on is taken over, another running editor keeps
+    // its stream.
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(probeTimeoutMs))
+    {
+        probe.abort();
+        *error = tr("Another program is already streaming as %1").arg(name);
+        return false;
+    }
+
+    QLocalServer::removeServer(name);
+    if (server.listen(name))
+        return true;
+    *error = server.errorString();
+    return false;
+}
+
+void LiveStream::close()
+{
+    server.close();
+    for (QLocalSocket *client : clients)
+    {
+        disconnect(client, nullptr, this, nullptr);
+        client->abort();
+        client->deleteLater();
+    }
+    clients.clear();
+    behind.clear();
+    pending.clear();
+    recordCount = 0;
+    lastMove = -1;
+}
+
+void LiveStream::setDocument(const PolygonDocument *document, const QString &imageFile)
+{
+    if (this->document)
+        disconnect(this->document, nullptr, this, nullptr);
+    this->document = document;
+    image = imageFile;
+
+    if (document)
+    {
+        connect(document, &PolygonDocument::polygonInserted, this, &LiveStream::polygonInserted);
+        connect(document, &PolygonDocument::polygonRemoved, this, &LiveStream::polygonRemoved);
+        connect(document, &PolygonDocument::polygonReplaced, this, &LiveStream::polygonReplaced);
+        connect(document, &PolygonDocument::vertexInserted, this, &LiveStream::vertexInserted);
+        connect(document, &PolygonDocument::vertexMoved, this, &LiveStream::vertexMoved);
+        connect(document, &PolygonDocument::vertexRemoved, this, &LiveStream::vertexRemoved);
+        connect(document, &PolygonDocument::documentReset, this, &LiveStream::resync);
+    }
+    resync();
+}
+
+void LiveStream::flush()
+{
+    lastMove = -1;
+    if (recordCount == 0)
+        return;
+    TRACE_SCOPE("liveStreamFlush");
+
+    QByteArray message;
+    message.reserve(pending.size() + 13);
+    beginMessage(&message, Frame);
+    put32(&message, ++sequence);
+    put32(&message, recordCount);
+    message.append(pending);
+    endMessage(&message);
+    pending.clear();
+    recordCount = 0;
+
+    for (QLocalSocket *client : clients)
+    {
+        if (behind.contains(client))
+            continue;
+        // A client this far behind would only make the buffer grow, it
+        // catches up with a snapshot once it has read what it has.
+        if (client->bytesToWrite() > maxBufferedBytes)
+        {
+            behind.insert(client);
+            continue;
+        }
+        client->write(message);
+    }
+}
+
+void LiveStream::newConnection()
+{
+    while (QLocalSocket *client = server.nextPendingConnection())
+    {
+        connect(client, &QLocalSocket::disconnected, this, [this, client]() { disconnected(client); });
+        connect(client, &QLocalSocket::bytesWritten, this, [this, client]() { bytesWritten(client); });
+        clients.append(client);
+
+        QByteArray hello;
+        beginMessage(&hello, Hello);
+        put32(&hello, protocolVersion);
+        endMessage(&hello);
+        client->write(hello);
+        sendSnapshot(client);
+    }
+}
+
+void LiveStream::disconnected(QLocalSocket *client)
+{
+    clients.removeOne(client);
+    behind.remove(client);
+    client->deleteLater();
+}
+
+void LiveStream::bytesWritten(QLocalSocket *client)
+{
+    if (behind.contains(client) && client->bytesToWrite() == 0)
+    {
+        behind.remove(client);
+        sendSnapshot(client);
+    }
+}
+
+void LiveStream::resync()
+{
+    // Whatever was pending is part of the new snapshot.
+    pending.clear();
+    recordCount = 0;
+    lastMove = -1;
+    ++sequence;
+    snapshot.clear();
+    for (QLocalSocket *client : clients)
+    {
+        if (!behind.contains(client))
+            sendSnapshot(client);
+    }
+}
+
+void LiveStream::sendSnapshot(QLocalSocket *client)
+{
+    // The snapshot has to match the frames sent so far, the edits after
+    // them go out first.
+    flush();
+
+    if (snapshot.isEmpty())
+    {
+        TRACE_SCOPE("liveStreamSnapshot");
+        beginMessage(&snapshot, Snapshot);
+        put32(&snapshot, sequence);
+        putString(&snapshot, image);
+        if (document)
+        {
+            const QList<QPolygon> &rooms = document->polygons(PolygonDocument::Rooms);
+            put32(&snapshot, quint32(rooms.length()));
+            for (int i = 0; i < rooms.length(); i++)
+            {
+                putString(&snapshot, document->colors().at(i));
+                putPolygon(&snapshot, rooms.at(i));
+            }
+            const QList<QPolygon> &doors = document->polygons(PolygonDocument::Doors);
+            put32(&snapshot, quint32(doors.length()));
+            for (const QPolygon &door : doors)
+                putPolygon(&snapshot, door);
+        }
+        else
+        {
+            put32(&snapshot, 0);
+            put32(&snapshot, 0);
+        }
+        endMessage(&snapshot);
+    }
+    client->write(snapshot);
+}
+
+bool LiveStream::beginRecord(quint8 op, PolygonDocument::Layer layer)
+{
+    // The document changed, the snapshot built before no longer matches,
+    // also for a client that connects later.
+    snapshot.clear();
+
+    // Nobody listens, nothing to encode.
+    if (clients.isEmpty())
+        return false;
+
+    if (recordCount == 0)
+        scheduler->requestFrame();
+    lastMove = -1;
+    recordCount++;
+    pending.append(char(op));
+    pending.append(char(layer == PolygonDocument::Rooms ? 0 : 1));
+    return true;
+}
+
+void LiveStream::polygonInserted(PolygonDocument::Layer layer, int index)
+{
+    if (!beginRecord(InsertPolygon, layer))
+        return;
+    put32(&pending, quint32(index));
+    putString(&pending, layer == PolygonDocument::Rooms ? document->colors().at(index) : QString());
+    putPolygon(&pending, document->polygon(layer, index));
+}
+
+void LiveStream::polygonRemoved(PolygonDocument::Layer layer, int index)
+{
+    if (!beginRecord(RemovePolygon, layer))
+        return;
+    put32(&pending, quint32(index));
+}
+
+void LiveStream::polygonReplaced(PolygonDocument::Layer layer, int index)
+{
+    if (!beginRecord(ReplacePolygon, layer))
+        return;
+    put32(&pending, quint32(index));
+    putPolygon(&pending, document->polygon(layer, index));
+}
+
+void LiveStream::vertexInserted(PolygonDocument::Layer layer, int index, int vertex)
+{
+    if (!beginRecord(InsertVertex, layer))
+        return;
+    const QPoint &pos = document->polygon(layer, index).at(vertex);
+    put32(&pending, quint32(index));
+    put32(&pending, quint32(vertex));
+    put32(&pending, quint32(pos.x()));
+    put32(&pending, quint32(pos.y()));
+}
+
+void LiveStream::vertexMoved(PolygonDocument::Layer layer, int index, int vertex)
+{
+    const QPoint &pos = document->polygon(layer, index).at(vertex);
+
+    // Moves of one vertex within a frame only need the last position.
+    if (lastMove >= 0)
+    {
+        uchar *record = reinterpret_cast<uchar *>(pending.data() + lastMove);
+        if (record[1] == (layer == PolygonDocument::Rooms ? 0 : 1)
+                && qFromLittleEndian<qint32>(record + 2) == index
+                && qFromLittleEndian<qint32>(record + 6) == vertex)
+        {
+            qToLittleEndian<qint32>(pos.x(), record + 10);
+            qToLittleEndian<qint32>(pos.y(), record + 14);
+            snapshot.clear();
+            return;
+        }
+    }
+
+    const int start = pending.size();
+    if (!beginRecord(MoveVertex, layer))
+        return;
+    put32(&pending, quint32(index));
+    put32(&pending, quint32(vertex));
+    put32(&pending, quint32(pos.x()));
+    put32(&pending, quint32(pos.y()));
+    lastMove = start;
+}
+
+void LiveStream::vertexRemoved(PolygonDocument::Layer layer, int index, int vertex)
+{
+    if (!beginRecord(RemoveVertex, layer))
+        return;
+    put32(&pending, quint32(index));
+    put32(&pending, quint32(vertex));
+}
@@ -0,0 +1,100 @@
+#ifndef LIVESTREAM_H
+#define LIVESTREAM_H
+
+#include <QByteArray>
+#include <QList>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include "polygonDocument.h"
+#include "redrawScheduler.h"
+
+// Publishes the outlines being edited to local programs, such as a
+// simulator, over a QLocalServer. A client gets a full snapshot when it
+// connects and then the edits of every frame as one message, so a drag
+// costs one small message per repaint rather than one per mouse event.
+//
+// The editor never waits for a client. Whatever a client has not read yet
+// is buffered up to maxBufferedBytes; beyond that it misses frames and,
+// once it has caught up, gets a new snapshot in their place.
+//
+// Messages, little endian: u32 size of what follows, u8 type, body. A
+// client first gets a hello, then a snapshot. Types it does not know can
+// be skipped by their size.
+// 3 hello     u32 protocol version, 2. Version 1 had no hello and no
+//             op 6, a client has to refuse versions above its own.
+// 1 snapshot  u32 sequence, u32 image path bytes, UTF-8 image path,
+//             u32 room count, per room u32 color bytes, UTF-8 color,
+//             u32 count, count i32 x, i32 y; u32 door count, per door
+//             u32 count, count i32 x, i32 y
+// 2 frame     u32 sequence, u32 record count, records of u8 op, u8 layer
+//             (0 rooms, 1 doors), payload:
+//             1 insert polygon  i32 index, u32 color bytes, UTF-8 color,
+//                               u32 count, count i32 x, i32 y
+//             2 remove polygon  i32 index
+//             3 insert vertex   i32 index, i32 vertex, i32 x, i32 y
+//             4 move vertex     i32 index, i32 vertex, i32 x, i32 y
+//             5 remove vertex   i32 index, i32 vertex
+//             6 replace polygon i32 index, u32 count, count i32 x, i32 y
+//
+// Frames are numbered in order; a snapshot carries the number of the last
+// frame it contains. Another floor or a replaced document is sent as a
+// new snapshot.
+class LiveStream : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const qint64 maxBufferedBytes = 4 * 1024 * 1024;
+
+    explicit LiveStream(RedrawScheduler *scheduler, QObject *parent = nullptr);
+    ~LiveStream();
+
+    bool listen(const QString &name, QString *error);
+    void close();
+    bool isListening() const { return server.isListening(); }
+    QString serverName() const { return server.fullServerName(); }
+    int clientCount() const { return clients.length(); }
+
+    // The document streamed, null for none. Clients get a new snapshot.
+    void setDocument(const PolygonDocument *document, const QString &imageFile);
+
+    // Sends the edits collected since the last frame.
+    void flush();
+
+private:
+    void newConnection();
+    void disconnected(QLocalSocket *client);
+    void bytesWritten(QLocalSocket *client);
+    void resync();
+    void sendSnapshot(QLocalSocket *client);
+
+    void polygonInserted(PolygonDocument::Layer layer, int index);
+    void polygonRemoved(PolygonDocument::Layer layer, int index);
+    void polygonReplaced(PolygonDocument::Layer layer, int index);
+    void vertexInserted(PolygonDocument::Layer layer, int index, int vertex);
+    void vertexMoved(PolygonDocument::Layer layer, int index, int vertex);
+    void vertexRemoved(PolygonDocument::Layer layer, int index, int vertex);
+    bool beginRecord(quint8 op, PolygonDocument::Layer layer);
+
+    RedrawScheduler *scheduler;
+    QLocalServer server;
+    QList<QLocalSocket *> clients;
+    // Clients that fell behind, they wait for a snapshot.
+    QSet<QLocalSocket *> behind;
+
+    const PolygonDocument *document = nullptr;
+    QString image;
+
+    QByteArray pending;
+    quint32 recordCount = 0;
+    // Offset of the last record in pending when it is a move, or -1.
+    int lastMove = -1;
+    quint32 sequence = 0;
+    // Built once per sequence, however many clients need it.
+    QByteArray snapshot;
+};
+
+#endif // LIVESTREAM_H
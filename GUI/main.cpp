@@ -1,9 +1,27 @@
 #include "outlineFlow.h"
+#include "batchRunner.h"
+#include "overlayRasterizer.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    // "batch" runs without a display, see BatchRunner.
+    if (argc > 1 && qstrcmp(argv[1], "batch") == 0)
+    {
+        QCoreApplication a(argc, argv);
+        return BatchRunner::run(a.arguments());
+    }
+    // "render" paints into images, which wants a gui application but no
+    // display.
+    if (argc > 1 && qstrcmp(argv[1], "render") == 0)
+    {
+        if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        QGuiApplication a(argc, argv);
+        return OverlayRasterizer::run(a.arguments());
+    }
+
     QApplication a(argc, argv);
     OutlineFlow l;
     l.show();
@@ -1,6 +1,11 @@
 #include "outlineFlow.h"
+#include "projectIO.h"
+#include "trace.h"
 #include <QGuiApplication>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QInputDialog>
 #include <QStandardPaths>
 #include <QImageReader>
 #include <QImageWriter>
@@ -10,32 +15,91 @@
 #include <QApplication>
 #include <QScreen>
 #include <QMouseEvent>
-#include <qpainter.h>
-#include <QtMath>
-#include <limits>
+#include <QStatusBar>
+#include <algorithm>
+#include <QLineEdit>
+#include "geometryKernels.h"
 
 OutlineFlow::OutlineFlow(QWidget *parent)
-   : QMainWindow(parent), imageLabel(new QLabel)
-   , scrollArea(new QScrollArea)
+   : QMainWindow(parent), planView(new PlanView)
+   , scrollArea(new QScrollArea), redrawScheduler(new RedrawScheduler(this))
+   , imageLoader(new ImageLoader(this)), traceHud(nullptr)
+   , autoTracer(new AutoTracer(this)), edgeSnapper(new EdgeSnapper(256, 64 * 1024, this))
+   , planCache(new PlanCache(1024 * 1024, this))
+   , liveStream(new LiveStream(redrawScheduler, this))
 {
-    imageLabel->setBackgroundRole(QPalette::Base);
-    imageLabel->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-    imageLabel->setScaledContents(true);
+    connect(redrawScheduler, &RedrawScheduler::frame, this, &OutlineFlow::presentFrame);
+    connect(imageLoader, &ImageLoader::previewReady, this, &OutlineFlow::showPreview);
+    connect(imageLoader, &ImageLoader::imageReady, this, &OutlineFlow::showImage);
+    connect(imageLoader, &ImageLoader::failed, this, &OutlineFlow::imageLoadFailed);
+    connect(autoTracer, &AutoTracer::finished, this, &OutlineFlow::autoTraceFinished);
 
     if (QSysInfo::productType() == "osx"){
         osOffset = 0;
     }
 
-    polyList.append(QPolygon());
+    rubberBand = new QRubberBand(QRubberBand::Rectangle, planView);
 
     scrollArea->setBackgroundRole(QPalette::Dark);
-    scrollArea->setWidget(imageLabel);
+    scrollArea->setWidget(planView);
     scrollArea->setVisible(false);
     setCentralWidget(scrollArea);
 
+    // Sits on the scroll area, so it stays in the corner while scrolling.
+    traceHud = new TraceHud(scrollArea);
+    traceHud->move(8, 8);
+    traceHud->hide();
+
     createActions();
 
+    connect(scrollArea->horizontalScrollBar(), &QScrollBar::valueChanged, this, &OutlineFlow::prefetchSnapTiles);
+    connect(scrollArea->verticalScrollBar(), &QScrollBar::valueChanged, this, &OutlineFlow::prefetchSnapTiles);
+
+    // Edits are journaled per session. A session directory whose lock is
+    // free was left by one that crashed, see recoverAutosave().
+    autosaveDir = QStringLiteral("%1/autosave/%2-%3")
+            .arg(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation),
+                 QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"))
+            .arg(QCoreApplication::applicationPid());
+    autosaveLock = new QLockFile(autosaveDir + "/session.lock");
+    if (!QDir().mkpath(autosaveDir) || !autosaveLock->tryLock(0))
+        autosaveDir.clear();
+
+    // The workspace starts with one empty floor, File -> Open fills it.
+    floors.append(createFloor());
+    attachFloor(floors.first());
+    updateFloorMenu();
+
+    // What the plan costs in memory, the caches fill and drain over time.
+    memoryLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(memoryLabel);
+    memoryTimer.setInterval(1000);
+    connect(&memoryTimer, &QTimer::timeout, this, &OutlineFlow::updateMemoryLabel);
+    memoryTimer.start();
+
+    if (qEnvironmentVariableIsSet("OUTLINEFLOW_TRACE"))
+        setTracing(true);
+    if (qEnvironmentVariableIsSet("OUTLINEFLOW_LIVE"))
+        setLiveStream(true);
+
     resize(QGuiApplication::primaryScreen()->availableSize() * 3 / 5);
+
+    // Asks once the window is up.
+    QTimer::singleShot(0, this, &OutlineFlow::recoverAutosave);
+}
+
+OutlineFlow::~OutlineFlow()
+{
+    // The floors remove their autosave files, the session directory goes
+    // after them.
+    detachFloor();
+    planView->setDocument(nullptr);
+    liveStream->setDocument(nullptr, QString());
+    qDeleteAll(floors);
+    floors.clear();
+    delete autosaveLock;
+    if (!autosaveDir.isEmpty())
+        QDir(autosaveDir).removeRecursively();
 }
 
 static void initializeImageFileDialog(QFileDialog &dialog, QFileDialog::AcceptMode acceptMode, QString typeFilter, QString defaultSuffix)
@@ -85,34 +149,428 @@ void OutlineFlow::open()
 
 bool OutlineFlow::loadFile(const QString &fileName)
 {
+    TRACE_SCOPE("loadFile");
     QImageReader reader(fileName);
-    reader.setAutoTransform(true);
-    const QImage newImage = reader.read();
-    if (newImage.isNull()) {
+    if (!reader.canRead()) {
         QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
                                  tr("Cannot load %1: %2")
                                  .arg(QDir::toNativeSeparators(fileName), reader.errorString()));
         return false;
     }
-    image = newImage;
-    scaleFactor = 1.0;
+
+    cancelAutoTrace();
+
+    // The edge field belongs to the old image.
+    edgeSnapper->clear();
+
+    // Decoding happens on the loader thread, the plan shows up in
+    // showPreview() or showImage().
+    awaitingFirstImage = true;
+    restoreView = false;
+    loadingFile = fileName;
+    imageLoader->load(fileName);
+
+    return true;
+}
+
+void OutlineFlow::showPreview(const QImage &preview, const QSize &fullSize)
+{
+    image = QImage();
+    planView->setPreview(preview, fullSize);
+    showLoadedPlan();
+}
+
+void OutlineFlow::showImage(const QImage &newImage)
+{
+    // Kept in the plan cache for switching back, the floor on screen stays
+    // there whatever the budget.
+    setPlan(planCache->insert(loadingFile, newImage));
+
+    if (awaitingFirstImage)
+        showLoadedPlan();
+    else
+        drawPolygon();
+
+    prefetchSnapTiles();
+    prefetchNeighbours();
+}
+
+void OutlineFlow::setPlan(const QSharedPointer<ImagePyramid> &pyramid)
+{
+    image = pyramid->image();
+    planView->setBackground(pyramid);
+    edgeSnapper->setImage(image);
+}
+
+void OutlineFlow::showLoadedPlan()
+{
+    awaitingFirstImage = false;
+    currentFloor->setImageFile(loadingFile);
+    liveStream->setDocument(document, loadingFile);
+    planCache->setPinned(loadingFile);
+    updateFloorMenu();
 
     scrollArea->setVisible(true);
-    QPixmap p = QPixmap::fromImage(image);
+    planView->show();
 
-    imageLabel->setPixmap(p);
-    imageLabel->show();
+    if (restoreView)
+    {
+        restoreView = false;
+        restoreFloorView();
+        return;
+    }
 
-    imageLabel->adjustSize();
+    scaleFactor = 1.0;
+    planView->adjustSize();
 
     reset();
+}
 
-    return true;
+void OutlineFlow::imageLoadFailed(const QString &fileName, const QString &error)
+{
+    QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                             tr("Cannot load %1: %2")
+                             .arg(QDir::toNativeSeparators(fileName), error));
+}
+
+void OutlineFlow::addFloors()
+{
+    QFileDialog dialog(this, tr("Add Floors"));
+    initializeImageFileDialog(dialog, QFileDialog::AcceptOpen, "image/jpeg", "jpg");
+    dialog.setFileMode(QFileDialog::ExistingFiles);
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    // Each plan gets a floor of its own, the first one is shown and the
+    // one after it is decoded meanwhile.
+    const int first = floors.length();
+    for (const QString &fileName : dialog.selectedFiles())
+    {
+        Floor *floor = createFloor();
+        floor->setImageFile(fileName);
+        floors.append(floor);
+    }
+    switchFloor(first);
+}
+
+Floor *OutlineFlow::createFloor()
+{
+    const QString base = autosaveDir.isEmpty() ? QString() : QStringLiteral("%1/floor%2").arg(autosaveDir).arg(++floorCount);
+    Floor *floor = new Floor(base, this);
+    if (floor->autosave())
+    {
+        connect(floor->autosave(), &Autosave::failed, this, [this](const QString &error) {
+            statusBar()->showMessage(tr("Autosave failed: %1").arg(error), 5000);
+        });
+    }
+    return floor;
+}
+
+void OutlineFlow::recoverAutosave()
+{
+    if (autosaveDir.isEmpty())
+        return;
+
+    // Locks of running sessions are held, stale ones of crashed sessions
+    // can be taken. Held until the directories are gone, so two windows
+    // starting together do not both recover them.
+    const QDir root = QFileInfo(autosaveDir).dir();
+    QStringList crashed;
+    QStringList bases;
+    QList<QLockFile *> locks;
+    for (const QString &name : root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name))
+    {
+        const QString dir = root.filePath(name);
+        if (dir == autosaveDir)
+            continue;
+        QLockFile *lock = new QLockFile(dir + "/session.lock");
+        if (!lock->tryLock(0))
+        {
+            delete lock;
+            continue;
+        }
+        locks << lock;
+        crashed << dir;
+        bases << Autosave::bases(dir);
+    }
+
+    if (!bases.isEmpty())
+    {
+        const QMessageBox::StandardButton answer = QMessageBox::question(this, tr("Recover Floors"),
+                tr("OutlineFlow did not exit cleanly. Recover %n floor(s) from the autosave?", nullptr, bases.length()));
+        if (answer == QMessageBox::Yes)
+        {
+            const int first = floors.length();
+            Floor *initial = floors.first();
+            const bool untouched = first == 1 && initial->imageFile().isEmpty() && !journal->canUndo();
+            QStringList errors;
+            for (const QString &base : bases)
+            {
+                ProjectData data;
+                QString imageFile;
+                QString error;
+                if (!Autosave::recover(base, &data, &imageFile, &error))
+                {
+                    errors << error;
+                    continue;
+                }
+                Floor *floor = createFloor();
+                floor->setImageFile(imageFile);
+                floor->document()->setProjectData(data);
+                floor->journal()->clear();
+                floors.append(floor);
+            }
+
+            if (floors.length() > first)
+            {
+                switchFloor(first);
+                // The empty floor the window started with is not needed.
+                if (untouched)
+                {
+                    floors.removeOne(initial);
+                    delete initial;
+                }
+                updateFloorMenu();
+                prefetchNeighbours();
+            }
+            if (!errors.isEmpty())
+                QMessageBox::warning(this, tr("Recover Floors"), errors.join('\n'));
+        }
+    }
+
+    // Asked once, declined floors are not offered again.
+    for (const QString &dir : crashed)
+        QDir(dir).removeRecursively();
+    qDeleteAll(locks);
+}
+
+void OutlineFlow::closeFloor()
+{
+    if (floors.length() < 2)
+        return;
+
+    if (journal->canUndo())
+    {
+        const QMessageBox::StandardButton answer = QMessageBox::question(this, tr("Close Floor"),
+                tr("Close %1 with all its outlines?").arg(currentFloor->name()));
+        if (answer != QMessageBox::Yes)
+            return;
+    }
+
+    Floor *closing = currentFloor;
+    const int index = floors.indexOf(closing);
+    switchFloor(index > 0 ? index - 1 : index + 1);
+    floors.removeOne(closing);
+
+    bool shared = false;
+    for (Floor *floor : floors)
+        shared |= floor->imageFile() == closing->imageFile();
+    if (!shared)
+        planCache->remove(closing->imageFile());
+    delete closing;
+
+    updateFloorMenu();
+    prefetchNeighbours();
+}
+
+void OutlineFlow::nextFloor()
+{
+    switchFloor(floors.indexOf(currentFloor) + 1);
+}
+
+void OutlineFlow::previousFloor()
+{
+    switchFloor(floors.indexOf(currentFloor) - 1);
+}
+
+void OutlineFlow::switchFloor(int index)
+{
+    if (index < 0 || index >= floors.length() || floors.at(index) == currentFloor)
+        return;
+    TRACE_SCOPE("switchFloor");
+
+    // Whatever is under way belongs to the floor being left.
+    cancelInteraction();
+    clearSelection();
+    if (insertPoint)
+        insert();
+    cancelAutoTrace();
+    imageLoader->cancel();
+    planCache->cancelPrefetch();
+
+    saveFloorView();
+    detachFloor();
+    attachFloor(floors.at(index));
+    showFloorImage();
+    updateFloorMenu();
+}
+
+void OutlineFlow::attachFloor(Floor *floor)
+{
+    currentFloor = floor;
+    document = floor->document();
+    journal = floor->journal();
+    analytics = floor->analytics();
+    validator = floor->validator();
+    geometryWorker = floor->geometryWorker();
+
+    // The document announces every edit, the view repaints what it touched.
+    connect(document, &PolygonDocument::polygonInserted, this, &OutlineFlow::markPolygon);
+    connect(document, &PolygonDocument::polygonRemoved, this, &OutlineFlow::markRemovedPolygon);
+    connect(document, &PolygonDocument::polygonReplaced, this, &OutlineFlow::markReplacedPolygon);
+    connect(document, &PolygonDocument::vertexInserted, this, &OutlineFlow::markVertex);
+    connect(document, &PolygonDocument::vertexMoved, this, &OutlineFlow::markMovedVertex);
+    connect(document, &PolygonDocument::vertexRemoved, this, &OutlineFlow::markRemovedVertex);
+    connect(document, &PolygonDocument::documentReset, this, [this]() { drawPolygon(); });
+    // Selections are held by index, anything but a move may shift them.
+    connect(document, &PolygonDocument::polygonInserted, this, &OutlineFlow::clearSelection);
+    connect(document, &PolygonDocument::polygonRemoved, this, &OutlineFlow::clearSelection);
+    connect(document, &PolygonDocument::polygonReplaced, this, &OutlineFlow::clearSelection);
+    connect(document, &PolygonDocument::vertexInserted, this, &OutlineFlow::clearSelection);
+    connect(document, &PolygonDocument::vertexRemoved, this, &OutlineFlow::clearSelection);
+    connect(document, &PolygonDocument::documentReset, this, &OutlineFlow::clearSelection);
+
+    connect(geometryWorker, &GeometryWorker::validated, this, &OutlineFlow::showIssues);
+    connect(geometryWorker, &GeometryWorker::exported, this, &OutlineFlow::showExported);
+    connect(geometryWorker, &GeometryWorker::refreshed, this, &OutlineFlow::continueAfterRefresh);
+    connect(geometryWorker, &GeometryWorker::nearestSegmentFound, this, &OutlineFlow::showInsertTarget);
+
+    connect(journal, &EditJournal::canUndoChanged, undoAct, &QAction::setEnabled);
+    connect(journal, &EditJournal::canRedoChanged, redoAct, &QAction::setEnabled);
+    undoAct->setEnabled(journal->canUndo());
+    redoAct->setEnabled(journal->canRedo());
+
+    planView->setDocument(document);
+    liveStream->setDocument(document, floor->imageFile());
+}
+
+void OutlineFlow::detachFloor()
+{
+    // The floor keeps working in the background, an export it was asked
+    // for still finishes, but nothing reaches the window any more.
+    disconnect(document, nullptr, this, nullptr);
+    disconnect(geometryWorker, nullptr, this, nullptr);
+    pendingRoomInfo = -1;
+    pendingExport.reset();
+    disconnect(journal, nullptr, undoAct, nullptr);
+    disconnect(journal, nullptr, redoAct, nullptr);
+}
+
+void OutlineFlow::showFloorImage()
+{
+    const QString fileName = currentFloor->imageFile();
+    edgeSnapper->clear();
+    planCache->setPinned(fileName);
+
+    if (fileName.isEmpty())
+    {
+        image = QImage();
+        planView->setBackground(QSharedPointer<ImagePyramid>());
+        scrollArea->setVisible(false);
+        return;
+    }
+
+    const QSharedPointer<ImagePyramid> pyramid = planCache->find(fileName);
+    if (pyramid)
+    {
+        setPlan(pyramid);
+        restoreFloorView();
+        prefetchNeighbours();
+        return;
+    }
+
+    // Decoded like a newly opened plan, but the floor keeps its polygons
+    // and view.
+    image = QImage();
+    planView->setBackground(QSharedPointer<ImagePyramid>());
+    awaitingFirstImage = true;
+    restoreView = true;
+    loadingFile = fileName;
+    imageLoader->load(fileName);
+}
+
+void OutlineFlow::saveFloorView()
+{
+    if (planView->imageSize().isEmpty())
+        return;
+
+    Floor::View view;
+    view.scale = scaleFactor;
+    view.scroll = QPoint(scrollArea->horizontalScrollBar()->value(), scrollArea->verticalScrollBar()->value());
+    view.area = visibleImageArea();
+    currentFloor->setView(view);
+}
+
+void OutlineFlow::restoreFloorView()
+{
+    const Floor::View &view = currentFloor->view();
+    scrollArea->setVisible(true);
+    scaleFactor = view.scale;
+    scaleImage(1.0);
+    scrollArea->horizontalScrollBar()->setValue(view.scroll.x());
+    scrollArea->verticalScrollBar()->setValue(view.scroll.y());
+    drawPolygon();
+}
+
+void OutlineFlow::prefetchNeighbours()
+{
+    // The next floor first, that is where one usually goes.
+    const int index = floors.indexOf(currentFloor);
+    for (int i : { index + 1, index - 1 })
+    {
+        if (i < 0 || i >= floors.length())
+            continue;
+
+        // A floor never shown opens at full size in the top left corner.
+        const Floor::View &view = floors.at(i)->view();
+        const QRect area = view.area.isNull() ? QRect(QPoint(0, 0), scrollArea->viewport()->size()) : view.area;
+        planCache->prefetch(floors.at(i)->imageFile(), area, view.scale);
+    }
+}
+
+void OutlineFlow::updateFloorMenu()
+{
+    // Later, the entry that was clicked may still be on the call stack.
+    for (QAction *action : floorGroup->actions())
+    {
+        floorGroup->removeAction(action);
+        floorMenu->removeAction(action);
+        action->deleteLater();
+    }
+    for (int i = 0; i < floors.length(); i++)
+    {
+        Floor *floor = floors.at(i);
+        QString text = floor->name();
+        if (floor != currentFloor && planCache->contains(floor->imageFile()))
+            text = tr("%1 (ready)").arg(text);
+
+        QAction *action = floorMenu->addAction(text);
+        action->setCheckable(true);
+        action->setChecked(floor == currentFloor);
+        floorGroup->addAction(action);
+        connect(action, &QAction::triggered, this, [this, i]() { switchFloor(i); });
+    }
+
+    const int index = floors.indexOf(currentFloor);
+    nextFloorAct->setEnabled(index + 1 < floors.length());
+    previousFloorAct->setEnabled(index > 0);
+    closeFloorAct->setEnabled(floors.length() > 1);
+}
+
+void OutlineFlow::setCacheBudget()
+{
+    bool ok;
+    const int megabytes = QInputDialog::getInt(this, tr("Plan Cache Budget"),
+                                               tr("Memory for the plans of open floors in MB:"),
+                                               planCache->budget() / 1024, 64, 1024 * 1024, 64, &ok);
+    if (ok)
+        planCache->setBudget(megabytes * 1024);
 }
 
 void OutlineFlow::openTxt()
 {
-    QFileDialog dialog(this, tr("Import File"), QDir::currentPath(), tr("ASCII-File (*.dat)"));
+    QFileDialog dialog(this, tr("Import File"), QDir::currentPath(),
+                       tr("Project files (*.dat *.ofb);;ASCII-File (*.dat);;Binary-File (*.ofb)"));
     initializeTextFileDialog(dialog, QFileDialog::AcceptOpen, "text/plain", "dat");
 
     while (dialog.exec() == QDialog::Accepted && !importFile(dialog.selectedFiles().first())) {}
@@ -120,91 +578,99 @@ void OutlineFlow::openTxt()
 
 bool OutlineFlow::importFile(const QString &fileName)
 {
-
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    TRACE_SCOPE("importFile");
+    ProjectData data;
+    QString error;
+    if (!ProjectIO::read(fileName, &data, &error))
+    {
+        QMessageBox::information(this, tr("Unable to import file"), error);
         return false;
+    }
 
-    reset();
-    polyList.clear();
-    polyCount.clear();
-    polygonDoorsList.clear();
-
-    QTextStream in(&file);
-
-    QStringList stringList;
-    bool isPoly;
-    int countP = 0;
-    int countD = 0;
-
-    while (!in.atEnd()) {
-        QString line = in.readLine();
-       if(line.startsWith("P")){
-           isPoly = true;
-           stringList = line.split(", ");
-           polyCount.append(stringList[1]);
-           countP++;
-           polyList.append(QPolygon());
-       } else if(line.startsWith("D")){
-           isPoly = false;
-           countD++;
-           polygonDoorsList.append(QPolygon());
-       } else {
-           if(isPoly){
-               stringList = line.split(" ");
-               polyList[countP-1].append(QPoint(stringList[0].toFloat(), stringList[1].toFloat()));
-           }else if(!isPoly){
-               stringList = line.split(" ");
-               polygonDoorsList[countD-1].append(QPoint(stringList[0].toFloat(), stringList[1].toFloat()));
-           }
-       }
+    if (data.polygons.isEmpty())
+    {
+        data.polygons.append(QPolygon());
+        data.colors.append("#0000ff");
     }
 
-    drawPolygon();
+    // One undo step brings back what was there before.
+    journal->beginCommand();
+    reset();
+    document->setProjectData(data);
+    journal->endCommand();
     return true;
 }
 
 void OutlineFlow::exportFile()
 {
+    exportData(document->toProjectData());
+}
+
+void OutlineFlow::exportSimplified()
+{
+    if (!askSimplification())
+        return;
+
+    // Only the file gets the reduced outlines, the document keeps them all.
+    ProjectData data = document->toProjectData();
+    data.polygons = PolygonSimplifier::simplify(data.polygons, simplifyMethod, simplifyTolerance);
+    exportData(data);
+}
+
+void OutlineFlow::exportAnalytics()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export Room Analytics"), "",
+                                                    tr("JSON-File (*.json)"));
+    if (fileName.isEmpty())
+        return;
+    if (QFileInfo(fileName).suffix().isEmpty())
+        fileName += ".json";
+
+    geometryWorker->exportAnalytics(fileName, analytics->reach());
+}
+
+void OutlineFlow::exportData(const ProjectData &data)
+{
+    // A document that was just loaded or replaced is checked on the
+    // worker first, the export goes on in continueAfterRefresh().
+    if (validator->needsFullCheck())
+    {
+        pendingExport.reset(new ProjectData(data));
+        statusBar()->showMessage(tr("Checking rooms..."));
+        geometryWorker->refresh(analytics->reach());
+        return;
+    }
+
+    const QVector<PolygonValidator::Issue> issues = validator->issues();
+    if (!issues.isEmpty())
+    {
+        const QMessageBox::StandardButton answer = QMessageBox::question(this, tr("Export File"),
+                tr("The rooms have %n problem(s), the first: %1.\nExport anyway?", nullptr, issues.size())
+                .arg(PolygonValidator::describe(issues.first())));
+        if (answer != QMessageBox::Yes)
+            return;
+    }
+
+    QString selectedFilter;
     QString fileName = QFileDialog::getSaveFileName(this,
             tr("Export File"), "",
-            tr("ASCII-File (*.dat)"));
+            tr("ASCII-File (*.dat);;Binary-File (*.ofb)"), &selectedFilter);
     if (fileName.isEmpty())
             return;
-    else
-    {
-        QFile file(fileName);
-        if (!file.open(QIODevice::WriteOnly))
-        {
-            QMessageBox::information(this, tr("Unable to open file"),
-                file.errorString());
-            return;
-        }
 
-        QTextStream out(&file);
-                int x = 0;
-                int y = 0;
-                foreach(QPolygon poly, polyList)
-                {
-                    out << QStringLiteral("P, %1, %2\n").arg(polyCount[x]).arg(polyList[x].length());
-                    foreach(QPoint point, poly)
-                    {
-                        out << QStringLiteral("%1 %2\n").arg(QString::number(point.x())).arg(QString::number(point.y()));
-                        y++;
-                    }
-                    x++;
-                }
-                int i = 0;
-                foreach(QPolygon door, polygonDoorsList)
-                {
-                    out << QStringLiteral("D\n");
-                    foreach(QPoint point, door)
-                    {
-                        out << QStringLiteral("%1 %2\n").arg(QString::number(point.x())).arg(QString::number(point.y()));
-                    }
-                    i++;
-                }
-     }
+    if (QFileInfo(fileName).suffix().isEmpty())
+        fileName += selectedFilter.contains("*.ofb") ? ".ofb" : ".dat";
+
+    // Written on the worker, the data is a snapshot already.
+    geometryWorker->exportProject(fileName, data);
+}
+
+void OutlineFlow::showExported(const QString &fileName, const QString &error)
+{
+    if (!error.isEmpty())
+        QMessageBox::information(this, tr("Unable to open file"), error);
+    else
+        statusBar()->showMessage(tr("Exported %1").arg(QDir::toNativeSeparators(fileName)), 5000);
 }
 
 void OutlineFlow::zoomIn()
@@ -219,7 +685,7 @@ void OutlineFlow::zoomOut()
 
 void OutlineFlow::normalSize()
 {
-    imageLabel->adjustSize();
+    planView->adjustSize();
     scaleFactor = 1.0;
 }
 
@@ -236,6 +702,18 @@ void OutlineFlow::about()
                "<p><b>Remove:</b> Double click on point (point turns red) -> Edit -> Remove </p>"
                "<p><b>Cancel Remove:</b> Double click on point (point turns black)</p>"
                "<p><b>New polygon:</b> Edit -> New Polygon (Color)</p>"
+               "<p><b>Undo/Redo:</b> Edit -> Undo / Redo</p>"
+               "<p><b>Auto-trace:</b> Edit -> Auto-Trace Rooms (adds green outlines of the rooms found in the plan)</p>"
+               "<p><b>Magnetic snapping:</b> View -> Magnetic Snapping (new and dragged points jump to nearby walls and corners, hold Shift to place freely)</p>"
+               "<p><b>Simplify:</b> Edit -> Simplify Polygons... (drops points closer than the tolerance to the outline), File -> Export Simplified... does the same for the exported file only</p>"
+               "<p><b>Room analytics:</b> Releasing a room point shows the room's area, perimeter, doors and neighbours in the status bar, File -> Export Room Analytics... writes them all as JSON</p>"
+               "<p><b>Validate:</b> Edit -> Validate Polygons lists crossing edges, rooms running back along themselves, repeated points and zero-length edges, a dragged room with problems says so in the status bar</p>"
+               "<p><b>Select:</b> Ctrl + drag spans a rubber band over room points, Ctrl + click on a point selects its whole room, Esc clears the selection</p>"
+               "<p><b>Move, scale, rotate:</b> Edit -> Move Selection... / Scale Selection... / Rotate Selection... transform all selected points at once, around the selection's center</p>"
+               "<p><b>Memory:</b> The status bar shows what the plan, its drawing tiles and the snapping field take. View -> Compact Image Memory keeps black-and-white plans at 1 bit and gray ones at 8 bits per pixel</p>"
+               "<p><b>Floors:</b> Floors -> Add Floors... opens several plans side by side, Ctrl + Page Up / Page Down switches between them. Every floor keeps its outlines, undo history and view; recently shown plans stay decoded up to Floors -> Plan Cache Budget..., the neighbouring floors are decoded ahead</p>"
+               "<p><b>Live stream:</b> View -> Live Stream publishes the outlines of the floor on screen to local programs, every edit reaches them within a frame</p>"
+               "<p><b>Autosave:</b> Every edit is journaled as it happens; after a crash the next start offers to recover the open floors with their outlines</p>"
                "<p><b>Reset all points:</b> File -> Reset</p>"
                "<p><b>Export:</b> File -> Export... (exports/saves all polygons in .dat file)</p>"
                "<p><b>Import:</b> File -> Import... (imports polygons from exported file)</p>"));
@@ -254,6 +732,9 @@ void OutlineFlow::createActions()
     QAction *exportAct = fileMenu->addAction(tr("&Export..."), this, &OutlineFlow::exportFile);
     exportAct->setShortcut(tr("Ctrl+S"));
 
+    fileMenu->addAction(tr("Export &Simplified..."), this, &OutlineFlow::exportSimplified);
+    fileMenu->addAction(tr("Export Room &Analytics..."), this, &OutlineFlow::exportAnalytics);
+
     QAction *resetAct = fileMenu->addAction(tr("&Reset"), this, &OutlineFlow::reset);
     resetAct->setShortcut(tr("Ctrl+R"));
 
@@ -263,6 +744,16 @@ void OutlineFlow::createActions()
     exitAct->setShortcut(tr("Ctrl+Q"));
 
     QMenu *editMenu = menuBar()->addMenu(tr("&Edit"));
+    undoAct = editMenu->addAction(tr("&Undo"), this, &OutlineFlow::undo);
+    undoAct->setShortcut(QKeySequence::Undo);
+    undoAct->setEnabled(false);
+
+    redoAct = editMenu->addAction(tr("Re&do"), this, &OutlineFlow::redo);
+    redoAct->setShortcut(QKeySequence::Redo);
+    redoAct->setEnabled(false);
+
+    editMenu->addSeparator();
+
     removeAct = editMenu->addAction(tr("&Remove"), this, &OutlineFlow::remove);
     removeAct->setShortcut(QKeySequence::Delete);
     removeAct->setEnabled(false);
@@ -281,6 +772,32 @@ void OutlineFlow::createActions()
     QAction *newPolyBlueAct = editMenu->addAction(tr("&New Polygon (Blue)"), this, &OutlineFlow::newPolyBlue);
     newPolyBlueAct->setShortcut(tr("Ctrl+3"));
 
+    editMenu->addSeparator();
+
+    autoTraceAct = editMenu->addAction(tr("&Auto-Trace Rooms"), this, &OutlineFlow::autoTrace);
+    autoTraceAct->setShortcut(tr("Ctrl+T"));
+
+    simplifyAct = editMenu->addAction(tr("&Simplify Polygons..."), this, &OutlineFlow::simplifyPolygons);
+    simplifyAct->setShortcut(tr("Ctrl+Shift+S"));
+
+    validateAct = editMenu->addAction(tr("&Validate Polygons"), this, &OutlineFlow::validatePolygons);
+    validateAct->setShortcut(tr("Ctrl+Shift+V"));
+
+    editMenu->addSeparator();
+
+    moveSelectionAct = editMenu->addAction(tr("&Move Selection..."), this, &OutlineFlow::moveSelection);
+    moveSelectionAct->setEnabled(false);
+
+    scaleSelectionAct = editMenu->addAction(tr("S&cale Selection..."), this, &OutlineFlow::scaleSelection);
+    scaleSelectionAct->setEnabled(false);
+
+    rotateSelectionAct = editMenu->addAction(tr("R&otate Selection..."), this, &OutlineFlow::rotateSelection);
+    rotateSelectionAct->setEnabled(false);
+
+    clearSelectionAct = editMenu->addAction(tr("Clear Se&lection"), this, &OutlineFlow::clearSelection);
+    clearSelectionAct->setShortcut(QKeySequence(Qt::Key_Escape));
+    clearSelectionAct->setEnabled(false);
+
     QMenu *viewMenu = menuBar()->addMenu(tr("&View"));
 
     zoomInAct = viewMenu->addAction(tr("Zoom &In (25%)"), this, &OutlineFlow::zoomIn);
@@ -306,6 +823,58 @@ void OutlineFlow::createActions()
     decPointAct = viewMenu->addAction(tr("&Decrease Point Width"), this, &OutlineFlow::decreasePoint);
     decPointAct->setShortcut(tr("Ctrl+9"));
 
+    viewMenu->addSeparator();
+
+    traceAct = viewMenu->addAction(tr("Record &Timings"), this, &OutlineFlow::setTracing);
+    traceAct->setCheckable(true);
+
+    hudAct = viewMenu->addAction(tr("Latency &HUD"), this, &OutlineFlow::setHudVisible);
+    hudAct->setCheckable(true);
+    hudAct->setShortcut(tr("F12"));
+
+    viewMenu->addAction(tr("Export T&race..."), this, &OutlineFlow::exportTrace);
+
+    viewMenu->addSeparator();
+
+    snapAct = viewMenu->addAction(tr("&Magnetic Snapping"), this, &OutlineFlow::prefetchSnapTiles);
+    snapAct->setCheckable(true);
+    snapAct->setChecked(true);
+    snapAct->setShortcut(tr("Ctrl+M"));
+
+    compactAct = viewMenu->addAction(tr("Compact Image &Memory"));
+    compactAct->setCheckable(true);
+    compactAct->setChecked(imageLoader->isCompact());
+    connect(compactAct, &QAction::toggled, this, [this](bool enabled) {
+        imageLoader->setCompact(enabled);
+        planCache->setCompact(enabled);
+        statusBar()->showMessage(tr("Applies to the next plan opened"), 5000);
+    });
+
+    viewMenu->addSeparator();
+
+    liveAct = viewMenu->addAction(tr("&Live Stream"), this, &OutlineFlow::setLiveStream);
+    liveAct->setCheckable(true);
+
+    floorMenu = menuBar()->addMenu(tr("F&loors"));
+
+    QAction *addFloorsAct = floorMenu->addAction(tr("&Add Floors..."), this, &OutlineFlow::addFloors);
+    addFloorsAct->setShortcut(tr("Ctrl+Shift+O"));
+
+    closeFloorAct = floorMenu->addAction(tr("&Close Floor"), this, &OutlineFlow::closeFloor);
+
+    nextFloorAct = floorMenu->addAction(tr("&Next Floor"), this, &OutlineFlow::nextFloor);
+    nextFloorAct->setShortcut(tr("Ctrl+PgDown"));
+
+    previousFloorAct = floorMenu->addAction(tr("&Previous Floor"), this, &OutlineFlow::previousFloor);
+    previousFloorAct->setShortcut(tr("Ctrl+PgUp"));
+
+    floorMenu->addAction(tr("Plan Cache &Budget..."), this, &OutlineFlow::setCacheBudget);
+
+    floorMenu->addSeparator();
+
+    // One entry per floor below, rebuilt whenever the menu opens.
+    floorGroup = new QActionGroup(this);
+    connect(floorMenu, &QMenu::aboutToShow, this, &OutlineFlow::updateFloorMenu);
 
     QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
 
@@ -316,7 +885,7 @@ void OutlineFlow::createActions()
 void OutlineFlow::scaleImage(double factor)
 {
     scaleFactor *= factor;
-    imageLabel->resize(scaleFactor * imageLabel->pixmap(Qt::ReturnByValue).size());
+    planView->resize(scaleFactor * planView->imageSize());
 
 
 
@@ -324,7 +893,11 @@ void OutlineFlow::scaleImage(double factor)
     adjustScrollBar(scrollArea->verticalScrollBar(), factor);
 
     zoomInAct->setEnabled(scaleFactor < 3.0);
-    zoomOutAct->setEnabled(scaleFactor > 0.333);
+    // Big plans may zoom out further, until they fit on a screen.
+    const QSize shown = scaleFactor * planView->imageSize();
+    zoomOutAct->setEnabled(scaleFactor > 0.333 || qMax(shown.width(), shown.height()) > 2000);
+
+    prefetchSnapTiles();
 }
 
 void OutlineFlow::adjustScrollBar(QScrollBar *scrollBar, double factor)
@@ -350,7 +923,9 @@ void OutlineFlow::newPolyBlue()
 
 void OutlineFlow::mouseDoubleClickEvent(QMouseEvent *event)
 {
-    QPoint mousePoint = imageLabel->mapFromParent(event->pos());
+    TRACE_SCOPE("mouseDoubleClickEvent");
+    Trace::markInput();
+    QPoint mousePoint = planView->mapFromParent(event->pos());
 
     QPoint mousePointReal;
     mousePointReal.setX((mousePoint.x()) / scaleFactor);
@@ -362,13 +937,13 @@ void OutlineFlow::mouseDoubleClickEvent(QMouseEvent *event)
         {
             leftClick = true;
             rightClick = false;
-            closestPoint = getClosestPoint(mousePointReal, polyList);
+            closestPoint = getClosestPoint(mousePointReal, PolygonDocument::Rooms, &iList, &iPoint);
         }
         else if(event->buttons() & Qt::RightButton)
         {
             rightClick = true;
             leftClick = false;
-            closestPoint = getClosestPoint(mousePointReal, polygonDoorsList);
+            closestPoint = getClosestPoint(mousePointReal, PolygonDocument::Doors, &iList, &iPoint);
         }
 
         if((mousePointReal - closestPoint).manhattanLength() < 7)
@@ -383,173 +958,332 @@ void OutlineFlow::mouseDoubleClickEvent(QMouseEvent *event)
         removeAct->setEnabled(false);
     }
 
-    drawPolygon();
+    drawPolygon(QRect());
 }
 
 void OutlineFlow::mouseMoveEvent(QMouseEvent *event)
 {
-    if(!insertPoint)
+    TRACE_SCOPE("mouseMoveEvent");
+    if(selecting)
     {
-        QPoint mousePoint = imageLabel->mapFromParent(event->pos());
+        QPoint mousePoint = planView->mapFromParent(event->pos());
+        bandEnd.setX((mousePoint.x()) / scaleFactor);
+        bandEnd.setY((mousePoint.y() - osOffset) / scaleFactor);
+
+        const QRect band = QRect(bandStart, bandEnd).normalized();
+        rubberBand->setGeometry(QRectF(band.x() * scaleFactor, band.y() * scaleFactor,
+                                       band.width() * scaleFactor, band.height() * scaleFactor).toRect());
+    }
+    else if(!insertPoint && dragList >= 0)
+    {
+        Trace::markInput();
+        QPoint mousePoint = planView->mapFromParent(event->pos());
 
         QPoint mousePointReal;
         mousePointReal.setX((mousePoint.x()) / scaleFactor);
         mousePointReal.setY((mousePoint.y() - osOffset) / scaleFactor);
 
-        if(event->buttons() & Qt::LeftButton)
-        {
-            closestPoint = getClosestPoint(mousePointReal, polyList);
-            if((mousePointReal - closestPoint).manhattanLength() < 50)
-                polyList[iList].replace(iPoint, mousePointReal);
-        }
-        else if(event->buttons() & Qt::RightButton)
-        {
-            closestPoint = getClosestPoint(mousePointReal, polygonDoorsList);
-            if((mousePointReal - closestPoint).manhattanLength() < 50)
-            {
-                QPolygon z = polygonDoorsList.takeAt(iList);
-                z.replace(iPoint, mousePointReal);
-                polygonDoorsList.insert(iList, z);
-            }
-        }
+        // Only the latest position counts, it is applied on the next frame.
+        dragTarget = snapPoint(mousePointReal, event->modifiers());
+        dragPending = true;
+        redrawScheduler->requestFrame();
+    }
+    else if(insertPoint)
+    {
+        QPoint mousePoint = planView->mapFromParent(event->pos());
 
-        drawPolygon();
+        QPoint mousePointReal;
+        mousePointReal.setX((mousePoint.x()) / scaleFactor);
+        mousePointReal.setY((mousePoint.y() - osOffset) / scaleFactor);
+
+        // Looked up on the worker, the answer lands in showInsertTarget().
+        geometryWorker->findNearestSegment(mousePointReal);
+    }
+}
+
+void OutlineFlow::mouseReleaseEvent(QMouseEvent *event)
+{
+    Q_UNUSED(event);
+
+    if(selecting)
+    {
+        // Answered by the vertex grid, only cells under the band are read.
+        selecting = false;
+        rubberBand->hide();
+        const QRect band = QRect(bandStart, bandEnd).normalized();
+        QVector<QPair<int, int>> hits = document->pointIndex(PolygonDocument::Rooms).pointsIn(band);
+        std::sort(hits.begin(), hits.end());
+        setSelection(hits);
+        return;
     }
+
+    applyDrag();
+    if(dragList >= 0 && !dragDoor)
+        showRoomInfo(dragList);
+    dragList = -1;
+    journal->endCommand();
+    redrawScheduler->requestFrame();
 }
 
 void OutlineFlow::mousePressEvent(QMouseEvent *event)
 {
-    QPoint mousePoint = imageLabel->mapFromParent(event->pos());
+    TRACE_SCOPE("mousePressEvent");
+    Trace::markInput();
+    QPoint mousePoint = planView->mapFromParent(event->pos());
 
     QPoint mousePointReal;
     mousePointReal.setX((mousePoint.x()) / scaleFactor);
     mousePointReal.setY((mousePoint.y() - osOffset) / scaleFactor);
 
+    // Ctrl + click on a point selects its room, elsewhere a band starts.
+    if(event->button() == Qt::LeftButton && (event->modifiers() & Qt::ControlModifier) && !insertPoint)
+    {
+        closestPoint = getClosestPoint(mousePointReal, PolygonDocument::Rooms, &iList, &iPoint);
+        if(iList >= 0 && (mousePointReal - closestPoint).manhattanLength() <= 7)
+        {
+            QVector<QPair<int, int>> vertices;
+            const int n = document->polygon(PolygonDocument::Rooms, iList).length();
+            vertices.reserve(n);
+            for(int i = 0; i < n; i++)
+                vertices.append(qMakePair(iList, i));
+            setSelection(vertices);
+        }
+        else
+        {
+            selecting = true;
+            bandStart = mousePointReal;
+            bandEnd = mousePointReal;
+            rubberBand->setGeometry(QRect());
+            rubberBand->show();
+        }
+        return;
+    }
+
+    // New points land on the nearest wall, picking existing ones does not.
+    const QPoint snapped = snapPoint(mousePointReal, event->modifiers());
+
+    applyDrag();
+    // Whatever this press adds and the drag that follows undo together.
+    journal->beginCommand();
+
     if(event->button() == Qt::LeftButton)
     {
         if(!insertPoint)
         {
-            closestPoint = getClosestPoint(mousePointReal, polyList);
+            closestPoint = getClosestPoint(mousePointReal, PolygonDocument::Rooms, &iList, &iPoint);
             if((mousePointReal - closestPoint).manhattanLength() > 7)
             {
-                polyList[polyCount.length()-1] << mousePointReal;
+                const int last = document->count(PolygonDocument::Rooms) - 1;
+                document->appendVertex(PolygonDocument::Rooms, last, snapped);
+                iList = last;
+                iPoint = document->polygon(PolygonDocument::Rooms, last).length()-1;
             }
         }
         else
         {
-            insertNewPoint(mousePointReal);
+            insertNewPoint(snapped);
         }
+        beginDrag(false, iList, iPoint);
     }
     if(event->button() == Qt::RightButton)
     {
-        closestPoint = getClosestPoint(mousePointReal, polygonDoorsList);
+        closestPoint = getClosestPoint(mousePointReal, PolygonDocument::Doors, &iList, &iPoint);
         if((mousePointReal - closestPoint).manhattanLength() > 7)
         {
-            if(polygonDoorsList.length() >= 1)
+            // A door is complete with two points, otherwise a new one starts.
+            const QList<QPolygon> &doors = document->polygons(PolygonDocument::Doors);
+            if(!doors.isEmpty() && doors.last().length() == 1)
             {
-                if(polygonDoorsList.last().length() == 1)
-                {
-                    polygonDoorsList.last() << mousePointReal;
-                }
-                else
-                {
-                    QPolygon poly;
-                    poly << mousePointReal;
-                    polygonDoorsList << poly;
-                }
+                document->appendVertex(PolygonDocument::Doors, doors.length()-1, snapped);
             }
             else
             {
-                QPolygon poly;
-                poly << mousePointReal;
-                polygonDoorsList << poly;
+                QPolygon door;
+                door << snapped;
+                document->appendPolygon(PolygonDocument::Doors, door);
             }
+            iList = doors.length()-1;
+            iPoint = doors.last().length()-1;
         }
+        beginDrag(true, iList, iPoint);
     }
 
-    drawPolygon();
+    drawPolygon(QRect());
 }
 
-void OutlineFlow::drawPolygon()
+void OutlineFlow::beginDrag(bool door, int list, int point)
 {
-    QImage tmp(image);
-    QPainter *painter = new QPainter(&tmp);
-    QPen pen;
-    int c = 0;
-    foreach(QPolygon poly, polyList)
+    // The dragged vertex is fixed here, moves only replace its position.
+    const QList<QPolygon> &lists = document->polygons(door ? PolygonDocument::Doors : PolygonDocument::Rooms);
+    dragPending = false;
+    if(list < lists.length() && point < lists[list].length())
     {
-        QColor color;
-        color.setNamedColor(polyCount[c]);
-        pen = QPen(color, lineWidth);
-        painter->setPen(pen);
-        painter->drawPolygon(poly);
-
-        pen = QPen(Qt::black, pointWidth);
-        painter->setPen(pen);
-        painter->drawPoints(poly);
-        c++;
+        dragDoor = door;
+        dragList = list;
+        dragPoint = point;
     }
-
-    foreach(QPolygon door, polygonDoorsList)
+    else
     {
-        pen = QPen(Qt::magenta, lineWidth);
-        painter->setPen(pen);
-        painter->drawPolygon(door);
-
-        pen = QPen(Qt::black, pointWidth);
-        painter->setPen(pen);
-        painter->drawPoints(door);
+        dragList = -1;
     }
+}
+
+void OutlineFlow::applyDrag()
+{
+    if(!dragPending || dragList < 0)
+        return;
+    TRACE_SCOPE("applyDrag");
+    dragPending = false;
+
+    document->moveVertex(dragDoor ? PolygonDocument::Doors : PolygonDocument::Rooms,
+                        dragList, dragPoint, dragTarget);
+    closestPoint = dragTarget;
+    markDirty(QRect());
+}
+
+QPoint OutlineFlow::snapPoint(const QPoint &point, Qt::KeyboardModifiers modifiers)
+{
+    // Shift places points freely.
+    if(!snapAct->isChecked() || (modifiers & Qt::ShiftModifier))
+        return point;
+
+    QPoint snapped;
+    return edgeSnapper->snap(point, scaleFactor, &snapped) ? snapped : point;
+}
+
+void OutlineFlow::prefetchSnapTiles()
+{
+    if (image.isNull() || !snapAct->isChecked())
+        return;
+
+    const QRect area = visibleImageArea();
+    if (!area.isNull())
+        edgeSnapper->prefetch(area, scaleFactor);
+}
+
+QRect OutlineFlow::visibleImageArea() const
+{
+    const QRect visible = planView->visibleRegion().boundingRect();
+    if (visible.isEmpty())
+        return QRect();
+    return QRect(int(visible.x() / scaleFactor), int(visible.y() / scaleFactor),
+                 int(visible.width() / scaleFactor) + 1, int(visible.height() / scaleFactor) + 1);
+}
+
+void OutlineFlow::presentFrame()
+{
+    applyDrag();
+    planView->flush();
+    // One message per frame carries all edits made since the last one.
+    liveStream->flush();
+}
+
+void OutlineFlow::drawPolygon()
+{
+    TRACE_SCOPE("drawPolygon");
+    planView->setHighlight(removePoint, closestPoint);
+    planView->markAll();
+    redrawScheduler->requestFrame();
+}
+
+void OutlineFlow::drawPolygon(const QRect &dirty)
+{
+    TRACE_SCOPE("drawPolygon");
+    markDirty(dirty);
+    redrawScheduler->requestFrame();
+}
 
-    if(removePoint)
+void OutlineFlow::markDirty(const QRect &dirty)
+{
+    if (batchEdit)
+        return;
+    planView->setHighlight(removePoint, closestPoint);
+    planView->markImageRect(dirty);
+}
+
+QRect OutlineFlow::vertexArea(const QPolygon &poly, int i)
+{
+    const int n = poly.length();
+    QRect area(poly.at(i), QSize(1, 1));
+    if(n > 1)
     {
-        pen = QPen(Qt::red, pointWidth);
-        painter->setPen(pen);
-        painter->drawPoint(closestPoint);
+        area |= QRect(poly.at((i + n - 1) % n), QSize(1, 1));
+        area |= QRect(poly.at((i + 1) % n), QSize(1, 1));
     }
+    return area;
+}
+
+void OutlineFlow::markPolygon(PolygonDocument::Layer layer, int index)
+{
+    markDirty(document->polygon(layer, index).boundingRect());
+}
+
+void OutlineFlow::markRemovedPolygon(PolygonDocument::Layer layer, int index,
+                                     const QPolygon &points, const QString &color)
+{
+    Q_UNUSED(layer);
+    Q_UNUSED(index);
+    Q_UNUSED(color);
+    markDirty(points.boundingRect());
+}
+
+void OutlineFlow::markReplacedPolygon(PolygonDocument::Layer layer, int index, const QPolygon &from)
+{
+    markDirty(document->polygon(layer, index).boundingRect() | from.boundingRect());
+}
 
-    painter->end();
-    imageLabel->setPixmap(QPixmap::fromImage(tmp));
+void OutlineFlow::markVertex(PolygonDocument::Layer layer, int index, int vertex)
+{
+    const QPolygon &poly = document->polygon(layer, index);
+    markDirty(layer == PolygonDocument::Rooms ? vertexArea(poly, vertex) : poly.boundingRect());
+}
+
+void OutlineFlow::markMovedVertex(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from)
+{
+    // The neighbours stayed, so the old area is the new one plus the old spot.
+    const QPolygon &poly = document->polygon(layer, index);
+    QRect area = layer == PolygonDocument::Rooms ? vertexArea(poly, vertex) : poly.boundingRect();
+    markDirty(area | QRect(from, QSize(1, 1)));
+}
+
+void OutlineFlow::markRemovedVertex(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from)
+{
+    const QPolygon &poly = document->polygon(layer, index);
+    QRect area(from, QSize(1, 1));
+    const int n = poly.length();
+    if(layer == PolygonDocument::Doors)
+        area |= poly.boundingRect();
+    else if(n > 0)
+    {
+        // The former neighbours are joined by a new edge now.
+        area |= QRect(poly.at((vertex + n - 1) % n), QSize(1, 1));
+        area |= QRect(poly.at(vertex % n), QSize(1, 1));
+    }
+    markDirty(area);
 }
 
 void OutlineFlow::reset()
 {
-    polyList.clear();
-    polyCount.clear();
-    polygonDoorsList.clear();
-    imageLabel->setPixmap(QPixmap::fromImage(image));
     removePoint = false;
     removeAct->setEnabled(false);
     insertPoint = false;
-    polyList.append(QPolygon());
-    polyCount.append("#0000ff");
+    dragList = -1;
+    dragPending = false;
+
+    ProjectData empty;
+    empty.polygons.append(QPolygon());
+    empty.colors.append("#0000ff");
+    document->setProjectData(empty);
 }
 
-QPoint OutlineFlow::getClosestPoint(QPoint newPosition, QList<QPolygon> list)
+QPoint OutlineFlow::getClosestPoint(QPoint newPosition, PolygonDocument::Layer layer, int *list, int *point) const
 {
+    TRACE_SCOPE("getClosestPoint");
     QPoint closestPoint;
-    float manhattenLength = std::numeric_limits<float>::max();
 
-    iPoint = 0;
-    iList = 0;
-    int iL = 0;
-    foreach(QPolygon poly, list)
-    {
-        int iP = 0;
-        foreach(QPoint point, poly)
-        {
-            float mhL = (point - newPosition).manhattanLength();
-            if(mhL < manhattenLength)
-            {
-                closestPoint = point;
-                manhattenLength = mhL;
-                iPoint = iP;
-                iList = iL;
-            }
-            iP++;
-        }
-        iL++;
-    }
+    *list = 0;
+    *point = 0;
+    document->pointIndex(layer).closest(newPosition, list, point, &closestPoint);
 
     return closestPoint;
 }
@@ -557,123 +1291,495 @@ QPoint OutlineFlow::getClosestPoint(QPoint newPosition, QList<QPolygon> list)
 void OutlineFlow::remove(){
     if(leftClick)
     {
-        polyList[iList].removeAt(iPoint);
+        document->removeVertex(PolygonDocument::Rooms, iList, iPoint);
         leftClick = false;
     }
     else if(rightClick)
     {
-        polygonDoorsList.removeAt(iList);
+        document->removePolygon(PolygonDocument::Doors, iList);
         rightClick = false;
     }
 
     removePoint = false;
     removeAct->setEnabled(false);
-    drawPolygon();
+    drawPolygon(QRect());
 }
 
-void OutlineFlow::insert()
+void OutlineFlow::undo()
 {
-    if(insertPoint == false)
-        insertPoint = true;
-    else
-        insertPoint = false;
+    cancelInteraction();
+    journal->undo();
+    drawPolygon(QRect());
 }
 
-void OutlineFlow::insertNewPoint(QPoint newPoint)
+void OutlineFlow::redo()
 {
-    int index = 0;
-    int j;
-    float minDist = std::numeric_limits<float>::max();
-    float dist;
-    int c = 0;
+    cancelInteraction();
+    journal->redo();
+    drawPolygon(QRect());
+}
 
-    foreach(QPolygon poly, polyList){
-        for(int i = 0; i < poly.length(); i++)
-        {
-            if(i < poly.length() - 1)
-                j = i + 1;
-            else
-                j = 0;
+void OutlineFlow::updateMemoryLabel()
+{
+    if (image.isNull())
+    {
+        memoryLabel->clear();
+        return;
+    }
 
-            dist = distToSegment(newPoint, poly.at(i), poly.at(j));
-            if(dist < minDist)
-            {
-                minDist = dist;
-                index = i;
-                iList = c;
-            }
-        }
-        c++;
+    QString format;
+    switch (image.depth())
+    {
+    case 1:
+        format = tr("1-bit");
+        break;
+    case 8:
+        format = image.format() == QImage::Format_Grayscale8 ? tr("8-bit gray") : tr("8-bit indexed");
+        break;
+    default:
+        format = tr("%1-bit color").arg(image.depth());
+        break;
     }
 
-    if(polyList[iList].empty()){
-        polyList[iList] << newPoint;
-    }else{
-        polyList[iList].insert(index+1, newPoint);
+    // The plan and its tiles are part of the cache, the other floors'
+    // plans make up the rest.
+    const qint64 imageKilobytes = image.sizeInBytes() / 1024;
+    const int tileKilobytes = planView->tileCacheKilobytes();
+    const int snapKilobytes = edgeSnapper->cacheKilobytes();
+    const int cacheKilobytes = planCache->usedKilobytes();
+    memoryLabel->setText(tr("Plan %1 MB (%2), tiles %3 MB, snapping %4 MB, %5 plan(s) cached %6 MB, total %7 MB")
+                         .arg(imageKilobytes / 1024).arg(format)
+                         .arg(tileKilobytes / 1024).arg(snapKilobytes / 1024)
+                         .arg(planCache->count()).arg(cacheKilobytes / 1024)
+                         .arg((qint64(cacheKilobytes) + snapKilobytes) / 1024));
+}
+
+void OutlineFlow::showRoomInfo(int room)
+{
+    if (room >= document->count(PolygonDocument::Rooms))
+        return;
+
+    // With polygons added, removed or replaced wholesale the validator or
+    // the analytics would start over, that runs on the worker and the
+    // answer follows in continueAfterRefresh().
+    if (validator->needsFullCheck() || analytics->needsRebuild())
+    {
+        pendingRoomInfo = room;
+        geometryWorker->refresh(analytics->reach());
+        return;
     }
 
-    insertPoint = false;
+    // Problems first, only the edges touched by the drag were checked again.
+    const QVector<PolygonValidator::Issue> issues = validator->issuesOf(room);
+    if (!issues.isEmpty())
+    {
+        statusBar()->showMessage(tr("Room %1: %2").arg(room).arg(PolygonValidator::describe(issues.first())), 5000);
+        return;
+    }
+
+    // Only this room is measured again.
+    const RoomAnalytics::Room &info = analytics->room(room);
+    statusBar()->showMessage(tr("Room %1: area %2 px², perimeter %3 px, %4 doors, %5 neighbours")
+                             .arg(room)
+                             .arg(qRound64(info.area))
+                             .arg(qRound64(info.perimeter))
+                             .arg(info.doors.size())
+                             .arg(analytics->neighbours(room).size()), 5000);
+}
+
+void OutlineFlow::continueAfterRefresh()
+{
+    // The floor has taken the results over by now.
+    const int room = pendingRoomInfo;
+    pendingRoomInfo = -1;
+    if (room >= 0)
+        showRoomInfo(room);
+
+    if (pendingExport)
+    {
+        const ProjectData data = *pendingExport;
+        pendingExport.reset();
+        statusBar()->clearMessage();
+        exportData(data);
+    }
+}
+
+void OutlineFlow::setSelection(const QVector<QPair<int, int>> &vertices)
+{
+    selection = vertices;
+    planView->setSelection(selection);
+    redrawScheduler->requestFrame();
+
+    const bool any = !selection.isEmpty();
+    moveSelectionAct->setEnabled(any);
+    scaleSelectionAct->setEnabled(any);
+    rotateSelectionAct->setEnabled(any);
+    clearSelectionAct->setEnabled(any);
+    if (any)
+        statusBar()->showMessage(tr("%n point(s) selected", nullptr, selection.size()), 5000);
+}
+
+void OutlineFlow::clearSelection()
+{
+    if (!selection.isEmpty())
+        setSelection(QVector<QPair<int, int>>());
+}
+
+QPointF OutlineFlow::selectionCenter() const
+{
+    QRect bounds;
+    for (const QPair<int, int> &v : selection)
+        bounds |= QRect(document->polygon(PolygonDocument::Rooms, v.first).at(v.second), QSize(1, 1));
+    return QRectF(bounds).center() - QPointF(0.5, 0.5);
+}
+
+void OutlineFlow::moveSelection()
+{
+    bool ok;
+    const QString text = QInputDialog::getText(this, tr("Move Selection"), tr("Offset x, y in pixels:"),
+                                               QLineEdit::Normal, "0, 0", &ok);
+    const QStringList parts = text.split(',');
+    if (!ok || parts.size() != 2)
+        return;
+
+    bool okX, okY;
+    const int dx = parts.at(0).trimmed().toInt(&okX);
+    const int dy = parts.at(1).trimmed().toInt(&okY);
+    if (okX && okY)
+        transformSelection(QTransform::fromTranslate(dx, dy));
+}
+
+void OutlineFlow::scaleSelection()
+{
+    bool ok;
+    const double percent = QInputDialog::getDouble(this, tr("Scale Selection"), tr("Scale in percent:"),
+                                                   100, 1, 10000, 2, &ok);
+    if (!ok)
+        return;
+
+    const QPointF c = selectionCenter();
+    QTransform transform;
+    transform.translate(c.x(), c.y());
+    transform.scale(percent / 100, percent / 100);
+    transform.translate(-c.x(), -c.y());
+    transformSelection(transform);
+}
+
+void OutlineFlow::rotateSelection()
+{
+    bool ok;
+    const double degrees = QInputDialog::getDouble(this, tr("Rotate Selection"), tr("Clockwise rotation in degrees:"),
+                                                   0, -360, 360, 2, &ok);
+    if (!ok)
+        return;
+
+    const QPointF c = selectionCenter();
+    QTransform transform;
+    transform.translate(c.x(), c.y());
+    transform.rotate(degrees);
+    transform.translate(-c.x(), -c.y());
+    transformSelection(transform);
 }
 
-float OutlineFlow::distToSegment(QPoint newPoint, QPoint p1, QPoint p2)
+void OutlineFlow::transformSelection(const QTransform &transform)
 {
-    int x1 = p1.x();
-    int y1 = p1.y();
-    int x2 = p2.x();
-    int y2 = p2.y();
-    int x3 = newPoint.x();
-    int y3 = newPoint.y();
+    TRACE_SCOPE("transformSelection");
+    const int n = selection.size();
+    if (n == 0)
+        return;
+
+    // Packed coordinates, transformed in one pass.
+    QVector<int> xs(n);
+    QVector<int> ys(n);
+    QRect area;
+    for (int i = 0; i < n; i++)
+    {
+        const QPair<int, int> &v = selection.at(i);
+        const QPoint &p = document->polygon(PolygonDocument::Rooms, v.first).at(v.second);
+        xs[i] = p.x();
+        ys[i] = p.y();
+        area |= vertexArea(document->polygon(PolygonDocument::Rooms, v.first), v.second);
+    }
+    transformPoints(transform, xs.data(), ys.data(), n);
+
+    // One undo step, one marked area and one frame for all of them.
+    cancelInteraction();
+    journal->beginCommand();
+    batchEdit = true;
+    for (int i = 0; i < n; i++)
+    {
+        const QPair<int, int> &v = selection.at(i);
+        document->moveVertex(PolygonDocument::Rooms, v.first, v.second, QPoint(xs.at(i), ys.at(i)));
+    }
+    batchEdit = false;
+    journal->endCommand();
+
+    for (const QPair<int, int> &v : selection)
+        area |= vertexArea(document->polygon(PolygonDocument::Rooms, v.first), v.second);
+    planView->setSelection(selection);
+    drawPolygon(area);
+}
+
+void OutlineFlow::cancelInteraction()
+{
+    // Indices held for a drag or a pending removal may be gone after
+    // undo or redo.
+    dragList = -1;
+    dragPending = false;
+    selecting = false;
+    rubberBand->hide();
+    removePoint = false;
+    removeAct->setEnabled(false);
+    leftClick = false;
+    rightClick = false;
+}
+
+void OutlineFlow::autoTrace()
+{
+    if (image.isNull())
+    {
+        QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                                 tr("Auto-trace needs a fully loaded plan image."));
+        return;
+    }
+
+    autoTraceAct->setEnabled(false);
+    QApplication::setOverrideCursor(Qt::BusyCursor);
+    autoTracer->trace(image, AutoTracer::Options());
+}
+
+void OutlineFlow::cancelAutoTrace()
+{
+    if (!autoTracer->isRunning())
+        return;
+
+    autoTracer->cancel();
+    QApplication::restoreOverrideCursor();
+    autoTraceAct->setEnabled(true);
+}
+
+void OutlineFlow::autoTraceFinished(const QList<QPolygon> &polygons, qint64 elapsedMs)
+{
+    QApplication::restoreOverrideCursor();
+    autoTraceAct->setEnabled(true);
+
+    // The traced rooms go in front of the polygon being drawn, so clicks
+    // keep adding to that one. One undo step removes them all.
+    journal->beginCommand();
+    int at = document->count(PolygonDocument::Rooms);
+    const bool drawing = at > 0 && document->polygon(PolygonDocument::Rooms, at - 1).isEmpty();
+    if (drawing)
+        at--;
+    for (const QPolygon &poly : polygons)
+        document->insertPolygon(PolygonDocument::Rooms, at++, poly, "#00ff00");
+    if (!drawing)
+        document->appendPolygon(PolygonDocument::Rooms, QPolygon(), "#0000ff");
+    journal->endCommand();
+
+    drawPolygon(QRect());
+    statusBar()->showMessage(tr("Auto-trace found %1 rooms in %2 ms").arg(polygons.length()).arg(elapsedMs), 5000);
+}
+
+bool OutlineFlow::askSimplification()
+{
+    const QStringList methods = QStringList() << tr("Douglas-Peucker") << tr("Visvalingam-Whyatt");
+    bool ok = false;
+    const QString method = QInputDialog::getItem(this, tr("Simplify"), tr("Method:"), methods,
+                                                 simplifyMethod == PolygonSimplifier::VisvalingamWhyatt ? 1 : 0,
+                                                 false, &ok);
+    if (!ok)
+        return false;
+
+    const double tolerance = QInputDialog::getDouble(this, tr("Simplify"), tr("Tolerance in pixels:"),
+                                                     simplifyTolerance, 0.1, 1000, 1, &ok);
+    if (!ok)
+        return false;
 
-    float px=x2-x1;
-    float py=y2-y1;
-    float temp=(px*px)+(py*py);
-    float u=((x3 - x1) * px + (y3 - y1) * py) / (temp);
+    simplifyMethod = method == methods.at(1) ? PolygonSimplifier::VisvalingamWhyatt
+                                             : PolygonSimplifier::DouglasPeucker;
+    simplifyTolerance = tolerance;
+    return true;
+}
 
-    if(u>1)
+void OutlineFlow::simplifyPolygons()
+{
+    if (!askSimplification())
+        return;
+
+    TRACE_SCOPE("simplifyPolygons");
+    const QList<QPolygon> simplified = PolygonSimplifier::simplify(document->polygons(PolygonDocument::Rooms),
+                                                                   simplifyMethod, simplifyTolerance);
+
+    // Rooms keep their place but not their vertex indices.
+    cancelInteraction();
+    qint64 before = 0;
+    qint64 after = 0;
+    journal->beginCommand();
+    for (int i = 0; i < simplified.length(); i++)
     {
-        u=1;
+        const int length = document->polygon(PolygonDocument::Rooms, i).length();
+        before += length;
+        after += simplified.at(i).length();
+        if (simplified.at(i).length() == length)
+            continue;
+
+        document->replacePolygon(PolygonDocument::Rooms, i, simplified.at(i));
     }
-    else if(u<0)
+    journal->endCommand();
+
+    drawPolygon(QRect());
+    statusBar()->showMessage(tr("Simplified %1 points to %2").arg(before).arg(after), 5000);
+}
+
+void OutlineFlow::validatePolygons()
+{
+    // The full sweep runs on the worker, the answer arrives in showIssues().
+    statusBar()->showMessage(tr("Validating..."));
+    geometryWorker->validate();
+}
+
+void OutlineFlow::showIssues(const QVector<PolygonValidator::Issue> &issues)
+{
+    if (issues.isEmpty())
     {
-        u=0;
+        statusBar()->showMessage(tr("No problems found"), 5000);
+        return;
     }
 
-    float x = x1 + u * px;
-    float y = y1 + u * py;
+    const int shown = qMin(issues.size(), 20);
+    QStringList lines;
+    for (int i = 0; i < shown; i++)
+        lines << PolygonValidator::describe(issues.at(i));
+    if (shown < issues.size())
+        lines << tr("... and %1 more").arg(issues.size() - shown);
+    QMessageBox::warning(this, tr("Validate Polygons"),
+                         tr("%n problem(s) found:", nullptr, issues.size()) + "\n\n" + lines.join('\n'));
+}
 
-    float dx = x - x3;
-    float dy = y - y3;
+void OutlineFlow::insert()
+{
+    if(insertPoint == false)
+        insertPoint = true;
+    else
+        insertPoint = false;
 
-    return qSqrt(dx*dx + dy*dy);
+    // Hovering shows where a click would insert, moves without a button
+    // only arrive with tracking on the view and on the window.
+    planView->setMouseTracking(insertPoint);
+    setMouseTracking(insertPoint);
+}
 
+void OutlineFlow::showInsertTarget(const QPoint &pos, int polygon, int edge, float distance)
+{
+    Q_UNUSED(pos);
+    Q_UNUSED(distance);
+    if (!insertPoint || polygon < 0)
+        return;
+
+    const int points = document->polygon(PolygonDocument::Rooms, polygon).length();
+    statusBar()->showMessage(tr("Insert into room %1 between points %2 and %3")
+                             .arg(polygon).arg(edge).arg((edge + 1) % points), 2000);
+}
+
+void OutlineFlow::insertNewPoint(QPoint newPoint)
+{
+    TRACE_SCOPE("insertNewPoint");
+    int index = -1;
+    float minDist;
+
+    // Without any edge yet the point starts the current polygon.
+    if(!document->segmentIndex().nearest(newPoint, &iList, &index, &minDist))
+        iList = document->count(PolygonDocument::Rooms) - 1;
+
+    document->insertVertex(PolygonDocument::Rooms, iList, index+1, newPoint);
+
+    insertPoint = false;
+    iPoint = index+1;
 }
 
 void OutlineFlow::newPoly(QString color)
 {
-    polyCount.append(color);
-    polyList.append(QPolygon());
+    document->appendPolygon(PolygonDocument::Rooms, QPolygon(), color);
 }
 
 void OutlineFlow::increaseLine(){
     if(lineWidth < 7)
         lineWidth++;
-    drawPolygon();
+    planView->setLineWidth(lineWidth);
 }
 
 void OutlineFlow::increasePoint(){
     if(pointWidth < 10)
         pointWidth++;
-    drawPolygon();
+    planView->setPointWidth(pointWidth);
 }
 
 void OutlineFlow::decreaseLine(){
     if(lineWidth > 1)
         lineWidth--;
-    drawPolygon();
+    planView->setLineWidth(lineWidth);
 }
 
 void OutlineFlow::decreasePoint(){
     if(pointWidth > 1)
         pointWidth--;
-    drawPolygon();
+    planView->setPointWidth(pointWidth);
+}
+
+void OutlineFlow::setTracing(bool enabled)
+{
+    if (enabled)
+        Trace::clear();
+    Trace::setEnabled(enabled);
+    traceAct->setChecked(enabled);
+    if (!enabled)
+    {
+        hudAct->setChecked(false);
+        traceHud->hide();
+    }
+}
+
+void OutlineFlow::setHudVisible(bool visible)
+{
+    // Numbers need recording, the HUD turns it on but leaves it on.
+    if (visible && !traceAct->isChecked())
+        setTracing(true);
+    traceHud->setVisible(visible);
+    traceHud->raise();
+}
+
+void OutlineFlow::setLiveStream(bool enabled)
+{
+    if (!enabled)
+    {
+        liveStream->close();
+        liveAct->setChecked(false);
+        return;
+    }
+
+    // OUTLINEFLOW_LIVE names the server when set to anything.
+    QString name = QString::fromLocal8Bit(qgetenv("OUTLINEFLOW_LIVE"));
+    if (name.isEmpty())
+        name = "outlineflow";
+    QString error;
+    if (!liveStream->isListening() && !liveStream->listen(name, &error))
+    {
+        liveAct->setChecked(false);
+        QMessageBox::information(this, tr("Unable to start live stream"), error);
+        return;
+    }
+    liveAct->setChecked(true);
+    statusBar()->showMessage(tr("Streaming outlines on %1").arg(liveStream->serverName()), 5000);
+}
+
+void OutlineFlow::exportTrace()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+            tr("Export Trace"), "trace.json", tr("Chrome Trace (*.json)"));
+    if (fileName.isEmpty())
+        return;
+
+    QString error;
+    if (!Trace::writeChromeTrace(fileName, &error))
+        QMessageBox::information(this, tr("Unable to export trace"), error);
 }
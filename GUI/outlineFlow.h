@@ -1,10 +1,32 @@
 #ifndef OUTLINEFLOW_H
 #define OUTLINEFLOW_H
 
+#include <QActionGroup>
+#include <QLabel>
+#include <QLockFile>
 #include <QMainWindow>
+#include <QMenu>
+#include <QRubberBand>
+#include <QScopedPointer>
 #include <QScrollArea>
 #include <QScrollBar>
-#include <QLabel>
+#include <QTimer>
+#include <QTransform>
+#include "autoTracer.h"
+#include "edgeSnapper.h"
+#include "editJournal.h"
+#include "floor.h"
+#include "geometryWorker.h"
+#include "imageLoader.h"
+#include "liveStream.h"
+#include "planCache.h"
+#include "planView.h"
+#include "polygonDocument.h"
+#include "polygonSimplifier.h"
+#include "polygonValidator.h"
+#include "redrawScheduler.h"
+#include "roomAnalytics.h"
+#include "traceHud.h"
 
 class OutlineFlow : public QMainWindow
 {
@@ -12,8 +34,11 @@ class OutlineFlow : public QMainWindow
 
 public:
     OutlineFlow(QWidget *parent = nullptr);
+    ~OutlineFlow();
     bool loadFile(const QString &);
     void exportFile();
+    void exportSimplified();
+    void exportAnalytics();
     bool importFile(const QString &);
 
 private slots:
@@ -25,26 +50,119 @@ private slots:
     void about();
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
     void mouseDoubleClickEvent(QMouseEvent *event);
+    void presentFrame();
+    void showPreview(const QImage &preview, const QSize &fullSize);
+    void showImage(const QImage &newImage);
+    void imageLoadFailed(const QString &fileName, const QString &error);
+    void autoTraceFinished(const QList<QPolygon> &polygons, qint64 elapsedMs);
+    void setTracing(bool enabled);
+    void setHudVisible(bool visible);
+    void setLiveStream(bool enabled);
+    void exportTrace();
+    void prefetchSnapTiles();
+    void markPolygon(PolygonDocument::Layer layer, int index);
+    void markRemovedPolygon(PolygonDocument::Layer layer, int index,
+                            const QPolygon &points, const QString &color);
+    void markReplacedPolygon(PolygonDocument::Layer layer, int index, const QPolygon &from);
+    void markVertex(PolygonDocument::Layer layer, int index, int vertex);
+    void markMovedVertex(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from);
+    void markRemovedVertex(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from);
+    void addFloors();
+    void closeFloor();
+    void nextFloor();
+    void previousFloor();
+    void setCacheBudget();
+    void updateFloorMenu();
+    void recoverAutosave();
 
 private:
     void createActions();
+    void showLoadedPlan();
+    void setPlan(const QSharedPointer<ImagePyramid> &pyramid);
+    Floor *createFloor();
+    void switchFloor(int index);
+    void attachFloor(Floor *floor);
+    void detachFloor();
+    void showFloorImage();
+    void saveFloorView();
+    void restoreFloorView();
+    void prefetchNeighbours();
+    void cancelAutoTrace();
+    QRect visibleImageArea() const;
     void createMenus();
     void setImage(const QImage &newImage);
     void scaleImage(double factor);
     void adjustScrollBar(QScrollBar *scrollBar, double factor);
     void drawPolygon();
+    void drawPolygon(const QRect &dirty);
+    void markDirty(const QRect &dirty);
+    static QRect vertexArea(const QPolygon &poly, int i);
     void reset();
     void newPoly(QString color);
     void remove();
-    QPoint getClosestPoint(QPoint newPosition, QList<QPolygon> );
+    void autoTrace();
+    bool askSimplification();
+    void simplifyPolygons();
+    void validatePolygons();
+    void showIssues(const QVector<PolygonValidator::Issue> &issues);
+    void showExported(const QString &fileName, const QString &error);
+    void showInsertTarget(const QPoint &pos, int polygon, int edge, float distance);
+    void exportData(const ProjectData &data);
+    void undo();
+    void redo();
+    void cancelInteraction();
+    void showRoomInfo(int room);
+    void continueAfterRefresh();
+    void updateMemoryLabel();
+    void setSelection(const QVector<QPair<int, int>> &vertices);
+    void clearSelection();
+    void moveSelection();
+    void scaleSelection();
+    void rotateSelection();
+    void transformSelection(const QTransform &transform);
+    QPointF selectionCenter() const;
+    QPoint getClosestPoint(QPoint newPosition, PolygonDocument::Layer layer, int *list, int *point) const;
     void insert();
     void insertNewPoint(QPoint newPoint);
-    float distToSegment(QPoint newPoint, QPoint p1, QPoint p2);
+    void beginDrag(bool door, int list, int point);
+    void applyDrag();
+    QPoint snapPoint(const QPoint &point, Qt::KeyboardModifiers modifiers);
 
     QImage image;
-    QLabel *imageLabel;
+    PlanView *planView;
     QScrollArea *scrollArea;
+    RedrawScheduler *redrawScheduler;
+    ImageLoader *imageLoader;
+    TraceHud *traceHud;
+    AutoTracer *autoTracer;
+    EdgeSnapper *edgeSnapper;
+    PlanCache *planCache;
+    LiveStream *liveStream;
+
+    // Open floors in menu order. The pointers below belong to the one on
+    // screen and change with it.
+    QList<Floor *> floors;
+    Floor *currentFloor = nullptr;
+    PolygonDocument *document = nullptr;
+    EditJournal *journal = nullptr;
+    RoomAnalytics *analytics = nullptr;
+    PolygonValidator *validator = nullptr;
+    GeometryWorker *geometryWorker = nullptr;
+    // This session's autosave files, empty when there is nowhere to put
+    // them. The lock tells running sessions from crashed ones.
+    QString autosaveDir;
+    QLockFile *autosaveLock = nullptr;
+    int floorCount = 0;
+    // Waiting for the worker's refresh: the room whose info to show, the
+    // data to export.
+    int pendingRoomInfo = -1;
+    QScopedPointer<ProjectData> pendingExport;
+    QString loadingFile;
+    bool awaitingFirstImage = false;
+    // The image being loaded belongs to a floor that keeps its polygons.
+    bool restoreView = false;
     int osOffset = 20;
 
     double scaleFactor = 1;
@@ -53,13 +171,32 @@ private:
     QAction *zoomOutAct;
     QAction *normalSizeAct;
     QAction *removeAct;
+    QAction *undoAct;
+    QAction *autoTraceAct;
+    QAction *simplifyAct;
+    QAction *validateAct;
+    QAction *moveSelectionAct;
+    QAction *scaleSelectionAct;
+    QAction *rotateSelectionAct;
+    QAction *clearSelectionAct;
+    QAction *redoAct;
     QAction *importFileAct;
     QAction *exportFileAct;
     QAction *insertAct;
     QAction *resetAct;
-
-    QPolygon polygonDoor;
-    QList<QPolygon> polygonDoorsList;
+    QAction *traceAct;
+    QAction *hudAct;
+    QAction *snapAct;
+    QAction *compactAct;
+    QAction *liveAct;
+    QAction *nextFloorAct;
+    QAction *previousFloorAct;
+    QAction *closeFloorAct;
+    QMenu *floorMenu;
+    QActionGroup *floorGroup;
+
+    QLabel *memoryLabel;
+    QTimer memoryTimer;
 
     int iPoint;
     int iList;
@@ -70,6 +207,23 @@ private:
 
     bool insertPoint = false;
 
+    // Drag anchor, captured on mouse press
+    bool dragDoor = false;
+    int dragList = -1;
+    int dragPoint = 0;
+    QPoint dragTarget;
+    bool dragPending = false;
+
+    // Selected room vertices as (polygon, vertex), sorted. Ctrl + drag
+    // spans a rubber band, both corners in image coordinates.
+    QVector<QPair<int, int>> selection;
+    QRubberBand *rubberBand = nullptr;
+    bool selecting = false;
+    QPoint bandStart;
+    QPoint bandEnd;
+    // A bulk edit marks its area once instead of per vertex.
+    bool batchEdit = false;
+
     // New Polygon
     void newPolyGreen();
     void newPolyRed();
@@ -79,8 +233,8 @@ private:
     QAction *newPolyRedAct;
     QAction *newPolyBlueAct;
 
-    QList<QString> polyCount = {"blue"};
-    QList<QPolygon> polyList;
+    PolygonSimplifier::Method simplifyMethod = PolygonSimplifier::DouglasPeucker;
+    double simplifyTolerance = 1.5;
 
 
     int lineWidth = 1;
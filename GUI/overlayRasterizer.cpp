@@ -0,0 +1,369 @@
+#include "overlayRasterizer.h"
+#include "imageLoader.h"
+#include "imagePyramid.h"
+#include "overlayRenderer.h"
+#include "pointIndex.h"
+#include "polygonLod.h"
+#include "segmentIndex.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QPainter>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QtMath>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+struct Overlay
+{
+    const ProjectData &data;
+    PointIndex pointIndex;
+    SegmentIndex segmentIndex;
+    PolygonLod lod;
+
+    explicit Overlay(const ProjectData &data)
+        : data(data)
+    {
+        pointIndex.rebuild(data.polygons);
+        segmentIndex.rebuild(data.polygons);
+    }
+};
+
+QSize scaledSize(const QSize &size, qreal scale)
+{
+    return QSize(qMax(1, qCeil(size.width() * scale)), qMax(1, qCeil(size.height() * scale)));
+}
+
+QImage render(ImagePyramid &pyramid, Overlay &overlay, qreal scale,
+              const OverlayRasterizer::Options &options)
+{
+    QImage target(scaledSize(pyramid.size(), scale), QImage::Format_RGB32);
+    target.fill(Qt::white);
+
+    OverlayRenderer renderer(overlay.data.polygons, overlay.data.colors, overlay.data.doors,
+                             overlay.pointIndex, overlay.segmentIndex);
+    renderer.setLineWidth(options.lineWidth);
+    renderer.setPointWidth(options.pointWidth);
+    const int level = PolygonLod::levelFor(scale);
+    if (level > 0)
+        renderer.setLevelOfDetail(&overlay.lod.level(overlay.data.polygons, level));
+
+    // One tile row of the level the pyramid draws at per band. Outlines
+    // reaching over the band edge are clipped, so every pixel comes out as
+    // if the plan had been drawn in one go.
+    const int band = pyramid.tileSize() << pyramid.levelFor(scale);
+    const int margin = qMax(options.lineWidth, options.pointWidth) + 1;
+    const QSize size = pyramid.size();
+
+    QPainter painter(&target);
+    painter.scale(scale, scale);
+    for (int y = 0; y < size.height(); y += band)
+    {
+        const QRect area(0, y, size.width(), qMin(band, size.height() - y));
+        painter.setClipRect(area);
+        pyramid.draw(painter, area);
+        renderer.paint(painter, area.adjusted(-margin, -margin, margin, margin));
+    }
+    return target;
+}
+
+QString outputName(const QString &dir, const QString &base, qreal scale)
+{
+    if (scale == 1.0)
+        return QDir(dir).filePath(base + ".overlay.png");
+    return QDir(dir).filePath(base + QStringLiteral(".overlay-%1.png").arg(qRound(scale * 100)));
+}
+
+} // namespace
+
+int OverlayRasterizer::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders OutlineFlow projects over their plan images without a display.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("render", "Selects the render mode.");
+    parser.addPositionalArgument("files", "Plan images or project files (.dat or .ofb), the other one "
+                                          "is found by the same base name.", "files...");
+
+    QCommandLineOption scaleOption(QStringList() << "s" << "scale",
+            "Writes a render at <scale>, a comma separated list for several. Defaults to 1.", "scale");
+    QCommandLineOption thumbnailOption(QStringList() << "t" << "thumbnail",
+            "Also writes <name>.thumb.png, at most <side> pixels wide and high.", "side");
+    QCommandLineOption lineWidthOption(QStringList() << "line-width",
+            "Polygon and door line width, 1 to 7 like in the editor. Defaults to 1.", "width");
+    QCommandLineOption pointWidthOption(QStringList() << "point-width",
+            "Point width, 1 to 10 like in the editor. Defaults to 2.", "width");
+    QCommandLineOption outputOption(QStringList() << "o" << "output-dir",
+            "Writes results to <dir> instead of next to the input.", "dir");
+    QCommandLineOption memoryOption(QStringList() << "memory",
+            "Megabytes all workers may hold together, defaults to 4096. Larger plans wait for "
+            "smaller ones to finish, a plan above the budget runs alone.", "mb");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+            "Number of worker threads, defaults to one per core.", "n");
+    parser.addOption(scaleOption);
+    parser.addOption(thumbnailOption);
+    parser.addOption(lineWidthOption);
+    parser.addOption(pointWidthOption);
+    parser.addOption(outputOption);
+    parser.addOption(memoryOption);
+    parser.addOption(jobsOption);
+    parser.process(arguments);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QStringList files = parser.positionalArguments();
+    if (!files.isEmpty())
+        files.removeFirst();
+    if (files.isEmpty())
+    {
+        err << "No input files given.\n";
+        return 2;
+    }
+
+    Options options;
+    if (parser.isSet(scaleOption))
+    {
+        for (const QString &value : parser.value(scaleOption).split(','))
+        {
+            if (value.trimmed().isEmpty())
+                continue;
+            bool ok = false;
+            const qreal scale = value.toDouble(&ok);
+            if (!ok || scale <= 0 || scale > 4)
+            {
+                err << "Invalid scale " << value << ", expected a number above 0 and up to 4.\n";
+                return 2;
+            }
+            options.scales << scale;
+        }
+    }
+    if (options.scales.isEmpty())
+        options.scales << 1.0;
+
+    auto intValue = [&parser, &err](const QCommandLineOption &option, int min, int max, int *value) {
+        if (!parser.isSet(option))
+            return true;
+        bool ok = false;
+        *value = parser.value(option).toInt(&ok);
+        if (!ok || *value < min || *value > max)
+        {
+            err << "Invalid value " << parser.value(option) << " for --" << option.names().last()
+                << ", expected " << min << " to " << max << ".\n";
+            return false;
+        }
+        return true;
+    };
+    int memory = 4096;
+    if (!intValue(thumbnailOption, 16, 4096, &options.thumbnailSide)
+            || !intValue(lineWidthOption, 1, 7, &options.lineWidth)
+            || !intValue(pointWidthOption, 1, 10, &options.pointWidth)
+            || !intValue(memoryOption, 64, 1024 * 1024, &memory))
+        return 2;
+
+    if (parser.isSet(outputOption))
+    {
+        options.outputDir = parser.value(outputOption);
+        if (!QDir().mkpath(options.outputDir))
+        {
+            err << "Cannot create " << options.outputDir << ".\n";
+            return 2;
+        }
+    }
+
+    if (parser.isSet(jobsOption))
+        QThreadPool::globalInstance()->setMaxThreadCount(qMax(1, parser.value(jobsOption).toInt()));
+
+    QElapsedTimer total;
+    total.start();
+
+    // Every worker reserves what its plan will take before decoding, so the
+    // budget holds however the large and small plans are mixed.
+    QSemaphore budget(memory);
+    const std::function<Result(const QString &)> work = [options, memory, &budget](const QString &fileName) {
+        Job job;
+        Result r;
+        if (!findJob(fileName, &job, &r.message))
+        {
+            r.fileName = fileName;
+            return r;
+        }
+        const int estimate = estimateMegabytes(job, options);
+        const int reserved = estimate > 0 ? qMin(estimate, memory) : memory;
+        budget.acquire(reserved);
+        r = renderJob(job, options);
+        budget.release(reserved);
+        return r;
+    };
+    QFuture<Result> future = QtConcurrent::mapped(files, work);
+
+    int failed = 0;
+    int outputs = 0;
+    for (int i = 0; i < files.length(); i++)
+    {
+        // Results arrive in input order, each one as soon as it is done.
+        const Result r = future.resultAt(i);
+        outputs += r.outputs;
+        if (!r.ok)
+            failed++;
+
+        out << (r.ok ? "OK    " : "FAIL  ")
+            << "decode " << QString::number(r.decodeMs, 'f', 1).rightJustified(8) << " ms  "
+            << "render " << QString::number(r.renderMs, 'f', 1).rightJustified(8) << " ms  "
+            << "write " << QString::number(r.writeMs, 'f', 1).rightJustified(8) << " ms  "
+            << r.fileName;
+        if (!r.message.isEmpty())
+            out << "  " << r.message;
+        out << "\n";
+        out.flush();
+    }
+
+    out << files.length() << " plans, " << failed << " failed, " << outputs << " images in "
+        << total.elapsed() << " ms on " << QThreadPool::globalInstance()->maxThreadCount()
+        << " threads\n";
+
+    return failed == 0 ? 0 : 1;
+}
+
+bool OverlayRasterizer::findJob(const QString &fileName, Job *job, QString *error)
+{
+    const QFileInfo info(fileName);
+    const QString suffix = info.suffix().toLower();
+    const QString base = QDir(info.path()).filePath(info.completeBaseName());
+
+    if (suffix == "dat" || suffix == "ofb")
+    {
+        job->project = fileName;
+        for (const QByteArray &format : QImageReader::supportedImageFormats())
+        {
+            const QString image = base + "." + QString::fromLatin1(format);
+            if (QFileInfo::exists(image))
+            {
+                job->image = image;
+                return true;
+            }
+        }
+        *error = "no plan image next to it";
+        return false;
+    }
+
+    job->image = fileName;
+    for (const QString &project : { base + ".ofb", base + ".dat" })
+    {
+        if (QFileInfo::exists(project))
+        {
+            job->project = project;
+            return true;
+        }
+    }
+    *error = "no .ofb or .dat project next to it";
+    return false;
+}
+
+int OverlayRasterizer::estimateMegabytes(const Job &job, const Options &options)
+{
+    QImageReader reader(job.image);
+    reader.setAutoTransform(true);
+    const QSize size = reader.size();
+    if (!size.isValid())
+        return 0;
+
+    // The decoded image at 32 bits, as a color plan, or one the reader
+    // cannot decode in bands, is held, then the largest render at 32 bits
+    // and the tile cache. Renders are written one at a time.
+    const qreal pixels = qreal(size.width()) * size.height();
+    const qreal largest = *std::max_element(options.scales.constBegin(), options.scales.constEnd());
+    const qreal bytes = pixels * 4 + pixels * largest * largest * 4
+            + qreal(options.tileCacheKilobytes) * 1024;
+    return qMax(1, qCeil(bytes / (1024 * 1024)));
+}
+
+OverlayRasterizer::Result OverlayRasterizer::renderJob(const Job &job, const Options &options)
+{
+    Result r;
+    r.fileName = job.image;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ProjectData data;
+    QString error;
+    if (!ProjectIO::read(job.project, &data, &error))
+    {
+        r.message = error;
+        return r;
+    }
+
+    // At 1 or 8 bits when the plan allows, decoded band by band where the
+    // format can.
+    QImage image = ImageLoader::readCompact(job.image, &r.message);
+    if (image.isNull())
+        return r;
+    r.decodeMs = timer.nsecsElapsed() / 1e6;
+
+    ImagePyramid pyramid(256, options.tileCacheKilobytes);
+    pyramid.setSource(image);
+    image = QImage();
+    Overlay overlay(data);
+
+    const QFileInfo info(job.image);
+    const QString dir = options.outputDir.isEmpty() ? info.absolutePath() : options.outputDir;
+    const QString base = info.completeBaseName();
+
+    // Smallest last, the thumbnail is scaled down from the last render.
+    QList<qreal> scales = options.scales;
+    std::sort(scales.begin(), scales.end(), std::greater<qreal>());
+
+    QStringList written;
+    QImage smallest;
+    for (qreal scale : scales)
+    {
+        timer.restart();
+        smallest = render(pyramid, overlay, scale, options);
+        r.renderMs += timer.nsecsElapsed() / 1e6;
+
+        timer.restart();
+        const QString target = outputName(dir, base, scale);
+        const bool ok = smallest.save(target, "PNG");
+        r.writeMs += timer.nsecsElapsed() / 1e6;
+        if (!ok)
+        {
+            r.message = "cannot write " + target;
+            return r;
+        }
+        written << target;
+    }
+
+    if (options.thumbnailSide > 0)
+    {
+        timer.restart();
+        QImage thumbnail = smallest;
+        if (qMax(thumbnail.width(), thumbnail.height()) > options.thumbnailSide)
+            thumbnail = thumbnail.scaled(options.thumbnailSide, options.thumbnailSide,
+                                         Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        r.renderMs += timer.nsecsElapsed() / 1e6;
+
+        timer.restart();
+        const QString target = QDir(dir).filePath(base + ".thumb.png");
+        const bool ok = thumbnail.save(target, "PNG");
+        r.writeMs += timer.nsecsElapsed() / 1e6;
+        if (!ok)
+        {
+            r.message = "cannot write " + target;
+            return r;
+        }
+        written << target;
+    }
+
+    r.ok = true;
+    r.outputs = written.length();
+    r.message = "-> " + written.join(", ");
+    return r;
+}
@@ -0,0 +1,57 @@
+#ifndef OVERLAYRASTERIZER_H
+#define OVERLAYRASTERIZER_H
+
+#include <QList>
+#include <QStringList>
+#include "projectIO.h"
+
+// Headless overlay renders, started with "render" as the first argument.
+// Draws the outlines of a project over its plan image with the editor's
+// styling and writes PNGs at any number of scales plus a thumbnail, many
+// plans side by side on a thread pool.
+class OverlayRasterizer
+{
+public:
+    struct Options
+    {
+        QList<qreal> scales;        // one render per scale, 1.0 when empty
+        int thumbnailSide = 0;      // longest side of the thumbnail, 0 for none
+        int lineWidth = 1;
+        int pointWidth = 2;
+        int tileCacheKilobytes = 16 * 1024;
+        QString outputDir;
+    };
+
+    struct Job
+    {
+        QString image;
+        QString project;
+    };
+
+    struct Result
+    {
+        QString fileName;
+        bool ok = false;
+        QString message;
+        double decodeMs = 0;
+        double renderMs = 0;
+        double writeMs = 0;
+        int outputs = 0;
+    };
+
+    static int run(const QStringList &arguments);
+
+    // The image and project belonging to fileName, which may name either.
+    static bool findJob(const QString &fileName, Job *job, QString *error);
+
+    // Megabytes a worker holds at most while rendering job, from the image
+    // header alone. 0 when the size cannot be read up front.
+    static int estimateMegabytes(const Job &job, const Options &options);
+
+    // Decodes the image once and writes every render and the thumbnail
+    // from it. Each render is drawn in bands of one tile row, so the tile
+    // cache and the index lookups stay bounded whatever the plan's size.
+    static Result renderJob(const Job &job, const Options &options);
+};
+
+#endif // OVERLAYRASTERIZER_H
@@ -0,0 +1,99 @@
+#include "overlayRenderer.h"
+#include <QPainter>
+#include <climits>
+
+OverlayRenderer::OverlayRenderer(const QList<QPolygon> &polygons, const QList<QString> &colors,
+                                 const QList<QPolygon> &doors, const PointIndex &pointIndex,
+                                 const SegmentIndex &segmentIndex)
+    : polygons(polygons), colors(colors), doors(doors),
+      pointIndex(pointIndex), segmentIndex(segmentIndex)
+{
+}
+
+void OverlayRenderer::paint(QPainter &painter, const QRect &area) const
+{
+    if (lod)
+        paintSimplified(painter, area);
+    else
+        paintRooms(painter, area);
+    paintDoors(painter, area);
+}
+
+void OverlayRenderer::paintRooms(QPainter &painter, const QRect &area) const
+{
+    // Edges and points come back sorted by polygon, so each polygon is drawn
+    // lines first, then points, in list order, just like a full repaint.
+    const QVector<QPair<int, int>> edges = segmentIndex.edgesIn(area);
+    const QVector<QPair<int, int>> points = pointIndex.pointsIn(area);
+
+    QPen pen;
+    QVector<QLine> lines;
+    QVector<QPoint> dots;
+    int e = 0;
+    int p = 0;
+    while (e < edges.length() || p < points.length())
+    {
+        const int list = qMin(e < edges.length() ? edges.at(e).first : INT_MAX,
+                              p < points.length() ? points.at(p).first : INT_MAX);
+        const QPolygon &poly = polygons.at(list);
+
+        lines.clear();
+        for (; e < edges.length() && edges.at(e).first == list; e++)
+        {
+            const int i = edges.at(e).second;
+            lines.append(QLine(poly.at(i), poly.at(i + 1 < poly.length() ? i + 1 : 0)));
+        }
+        dots.clear();
+        for (; p < points.length() && points.at(p).first == list; p++)
+            dots.append(poly.at(points.at(p).second));
+
+        QColor color;
+        color.setNamedColor(colors.at(list));
+        pen = QPen(color, lineWidth);
+        painter.setPen(pen);
+        painter.drawLines(lines);
+
+        pen = QPen(Qt::black, pointWidth);
+        painter.setPen(pen);
+        painter.drawPoints(dots.constData(), dots.length());
+    }
+}
+
+void OverlayRenderer::paintSimplified(QPainter &painter, const QRect &area) const
+{
+    QPen pen;
+    for (int i = 0; i < lod->polygons.size(); i++)
+    {
+        const QPolygon &outline = lod->polygons.at(i);
+        if (outline.isEmpty() || !lod->bounds.at(i).intersects(area))
+            continue;
+
+        QColor color;
+        color.setNamedColor(colors.at(i));
+        pen = QPen(color, lineWidth);
+        painter.setPen(pen);
+        painter.drawPolygon(outline);
+
+        pen = QPen(Qt::black, pointWidth);
+        painter.setPen(pen);
+        painter.drawPoints(outline);
+    }
+}
+
+void OverlayRenderer::paintDoors(QPainter &painter, const QRect &area) const
+{
+    QPen pen;
+    for (const QPolygon &door : doors)
+    {
+        if (!door.boundingRect().intersects(area))
+            continue;
+
+        pen = QPen(Qt::magenta, lineWidth);
+        painter.setPen(pen);
+        painter.drawPolygon(door);
+
+        pen = QPen(Qt::black, pointWidth);
+        painter.setPen(pen);
+        painter.drawPoints(door);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef OVERLAYRENDERER_H
+#define OVERLAYRENDERER_H
+
+#include <QList>
+#include <QPolygon>
+#include <QRect>
+#include "pointIndex.h"
+#include "polygonLod.h"
+#include "segmentIndex.h"
+
+class QPainter;
+
+// Draws polygons and doors the way the editor shows them: edges in the
+// polygon color, points in black, doors in magenta. Only what touches the
+// given area is drawn, looked up through the spatial indexes. Works on any
+// painter, so the same styling is used on screen and offscreen.
+class OverlayRenderer
+{
+public:
+    OverlayRenderer(const QList<QPolygon> &polygons, const QList<QString> &colors,
+                    const QList<QPolygon> &doors, const PointIndex &pointIndex,
+                    const SegmentIndex &segmentIndex);
+
+    void setLineWidth(int width) { lineWidth = width; }
+    void setPointWidth(int width) { pointWidth = width; }
+    // Draws the simplified outlines of level in place of the polygons,
+    // culled by their bounds instead of the indexes. Null draws full detail.
+    void setLevelOfDetail(const PolygonLod::Level *level) { lod = level; }
+
+    void paint(QPainter &painter, const QRect &area) const;
+
+private:
+    void paintRooms(QPainter &painter, const QRect &area) const;
+    void paintSimplified(QPainter &painter, const QRect &area) const;
+    void paintDoors(QPainter &painter, const QRect &area) const;
+
+    const QList<QPolygon> &polygons;
+    const QList<QString> &colors;
+    const QList<QPolygon> &doors;
+    const PointIndex &pointIndex;
+    const SegmentIndex &segmentIndex;
+    const PolygonLod::Level *lod = nullptr;
+
+    int lineWidth = 1;
+    int pointWidth = 2;
+};
+
+#endif // OVERLAYRENDERER_H
@@ -0,0 +1,179 @@
+#include "planCache.h"
+#include <QImageReader>
+#include <QtConcurrent>
+#include <climits>
+#include "imageLoader.h"
+#include "trace.h"
+
+PlanCache::PlanCache(int budgetKilobytes, QObject *parent)
+    : QObject(parent), budgetKilobytes(budgetKilobytes)
+{
+    pool.setMaxThreadCount(1);
+}
+
+PlanCache::~PlanCache()
+{
+    cancelPrefetch();
+    pool.waitForDone();
+}
+
+void PlanCache::setBudget(int kilobytes)
+{
+    budgetKilobytes = kilobytes;
+    trim();
+}
+
+int PlanCache::usedKilobytes() const
+{
+    qint64 total = 0;
+    for (const Entry &entry : entries)
+        total += entry.pyramid->image().sizeInBytes() / 1024 + entry.pyramid->cacheKilobytes();
+    return int(qMin<qint64>(total, INT_MAX));
+}
+
+QSharedPointer<ImagePyramid> PlanCache::find(const QString &fileName)
+{
+    auto it = entries.find(fileName);
+    if (it == entries.end())
+        return QSharedPointer<ImagePyramid>();
+
+    it->lastUse = ++useClock;
+    return it->pyramid;
+}
+
+QSharedPointer<ImagePyramid> PlanCache::insert(const QString &fileName, const QImage &image)
+{
+    Entry entry;
+    entry.pyramid = QSharedPointer<ImagePyramid>(new ImagePyramid);
+    entry.pyramid->setSource(image);
+    entry.lastUse = ++useClock;
+    entries.insert(fileName, entry);
+    trim();
+    return entry.pyramid;
+}
+
+void PlanCache::remove(const QString &fileName)
+{
+    entries.remove(fileName);
+}
+
+void PlanCache::setPinned(const QString &fileName)
+{
+    pinned = fileName;
+    trim();
+}
+
+void PlanCache::trim()
+{
+    // A handful of floors at most, a scan for the oldest is cheap enough.
+    while (usedKilobytes() > budgetKilobytes)
+    {
+        auto oldest = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            if (it.key() != pinned && (oldest == entries.end() || it->lastUse < oldest->lastUse))
+                oldest = it;
+        if (oldest == entries.end())
+            return;
+        entries.erase(oldest);
+    }
+}
+
+void PlanCache::prefetch(const QString &fileName, const QRect &area, qreal scale)
+{
+    if (fileName.isEmpty() || entries.contains(fileName) || fileName == inFlight)
+        return;
+    for (const Request &request : queue)
+        if (request.fileName == fileName)
+            return;
+
+    Request request;
+    request.fileName = fileName;
+    request.area = area;
+    request.scale = scale;
+    queue.append(request);
+    startPrefetch();
+}
+
+void PlanCache::cancelPrefetch()
+{
+    queue.clear();
+    inFlight.clear();
+    ++currentJob;
+    if (cancelled)
+        cancelled->storeRelease(1);
+    cancelled.reset();
+}
+
+void PlanCache::startPrefetch()
+{
+    if (!inFlight.isEmpty() || queue.isEmpty())
+        return;
+
+    const Request request = queue.takeFirst();
+    const quint64 job = ++currentJob;
+    const QSharedPointer<QAtomicInt> flag(new QAtomicInt(0));
+    const bool compactImage = compact;
+    cancelled = flag;
+    inFlight = request.fileName;
+
+    QtConcurrent::run(&pool, [this, job, flag, request, compactImage]() {
+        QSharedPointer<ImagePyramid> pyramid;
+        if (!flag->loadAcquire())
+        {
+            QImage image;
+            {
+                TRACE_SCOPE("prefetchDecode");
+                QString error;
+                if (compactImage)
+                {
+                    image = ImageLoader::readCompact(request.fileName, &error, flag.data());
+                }
+                else
+                {
+                    QImageReader reader(request.fileName);
+                    reader.setAutoTransform(true);
+                    image = reader.read();
+                }
+            }
+
+            if (!image.isNull() && !flag->loadAcquire())
+            {
+                // The pyramid is handed over whole, until then only this
+                // thread touches it.
+                pyramid = QSharedPointer<ImagePyramid>(new ImagePyramid);
+                pyramid->setSource(image);
+
+                TRACE_SCOPE("prefetchTiles");
+                const QRect visible = request.area.intersected(image.rect());
+                const int level = pyramid->levelFor(request.scale);
+                const int side = pyramid->tileSize() << level;
+                for (int ty = visible.top() / side; !visible.isEmpty() && ty <= visible.bottom() / side; ty++)
+                    for (int tx = visible.left() / side; tx <= visible.right() / side && !flag->loadAcquire(); tx++)
+                        pyramid->tile(level, tx, ty);
+            }
+        }
+
+        const QString fileName = request.fileName;
+        QMetaObject::invokeMethod(this, [this, job, fileName, pyramid]() {
+            deliverPrefetch(job, fileName, pyramid);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PlanCache::deliverPrefetch(quint64 job, const QString &fileName, const QSharedPointer<ImagePyramid> &pyramid)
+{
+    if (job != currentJob)
+        return;
+
+    inFlight.clear();
+    // Failures stay quiet, the floor reports them once it is shown.
+    if (pyramid && !entries.contains(fileName))
+    {
+        Entry entry;
+        entry.pyramid = pyramid;
+        entry.lastUse = ++useClock;
+        entries.insert(fileName, entry);
+        trim();
+    }
+    startPrefetch();
+}
@@ -0,0 +1,84 @@
+#ifndef PLANCACHE_H
+#define PLANCACHE_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QRect>
+#include <QSharedPointer>
+#include <QString>
+#include <QThreadPool>
+#include "imagePyramid.h"
+
+// Decoded plan images with their tile pyramids, keyed by file name and
+// shared by all open floors. Images and tiles count against one memory
+// budget; when it is exceeded the plans shown longest ago are dropped, the
+// pinned one on screen never is.
+//
+// Plans can be decoded ahead of time on a worker thread, with the tiles of
+// the area their view will show already rendered, so switching to them
+// costs no decoding at all.
+class PlanCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PlanCache(int budgetKilobytes = 1024 * 1024, QObject *parent = nullptr);
+    ~PlanCache();
+
+    void setBudget(int kilobytes);
+    int budget() const { return budgetKilobytes; }
+    int usedKilobytes() const;
+    int count() const { return entries.size(); }
+
+    // Prefetched plans are stored 1-bit or gray when they allow, see
+    // ImageLoader::compacted().
+    void setCompact(bool enabled) { compact = enabled; }
+
+    bool contains(const QString &fileName) const { return entries.contains(fileName); }
+    // The cached pyramid of fileName, or null. Counts as a use.
+    QSharedPointer<ImagePyramid> find(const QString &fileName);
+    // Caches image as the plan of fileName and returns its pyramid.
+    QSharedPointer<ImagePyramid> insert(const QString &fileName, const QImage &image);
+    void remove(const QString &fileName);
+    // fileName stays cached whatever the budget until another one is pinned.
+    void setPinned(const QString &fileName);
+
+    // Queues fileName for decoding unless it is cached or queued already.
+    // After decoding, the tiles covering area at scale are rendered too.
+    void prefetch(const QString &fileName, const QRect &area, qreal scale);
+    void cancelPrefetch();
+
+private:
+    struct Entry
+    {
+        QSharedPointer<ImagePyramid> pyramid;
+        quint64 lastUse = 0;
+    };
+
+    struct Request
+    {
+        QString fileName;
+        QRect area;
+        qreal scale = 1.0;
+    };
+
+    void startPrefetch();
+    void deliverPrefetch(quint64 job, const QString &fileName, const QSharedPointer<ImagePyramid> &pyramid);
+    void trim();
+
+    QHash<QString, Entry> entries;
+    quint64 useClock = 0;
+    int budgetKilobytes;
+    QString pinned;
+    bool compact = true;
+
+    QThreadPool pool;
+    QSharedPointer<QAtomicInt> cancelled;
+    QList<Request> queue;
+    QString inFlight;
+    quint64 currentJob = 0;
+};
+
+#endif // PLANCACHE_H
@@ -0,0 +1,238 @@
+#include "planView.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include "overlayRenderer.h"
+#include "trace.h"
+
+PlanView::PlanView(QWidget *parent)
+    : QWidget(parent)
+{
+    setBackgroundRole(QPalette::Base);
+    setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void PlanView::setBackground(const QSharedPointer<ImagePyramid> &pyramid)
+{
+    preview = QImage();
+    this->pyramid = pyramid;
+    logicalSize = pyramid ? pyramid->size() : QSize();
+    update();
+}
+
+void PlanView::setPreview(const QImage &preview, const QSize &fullSize)
+{
+    pyramid.reset();
+    this->preview = preview;
+    logicalSize = fullSize;
+    update();
+}
+
+QSize PlanView::imageSize() const
+{
+    return logicalSize;
+}
+
+QSize PlanView::sizeHint() const
+{
+    return logicalSize;
+}
+
+void PlanView::setDocument(const PolygonDocument *document)
+{
+    if (this->document)
+        disconnect(this->document, nullptr, this, nullptr);
+    this->document = document;
+    lod.reset();
+
+    if (document)
+    {
+        // Vertex edits and new points redo one simplified outline, anything
+        // that shifts the polygon indexes starts over.
+        auto vertexChanged = [this](PolygonDocument::Layer layer, int index) {
+            if (layer == PolygonDocument::Rooms)
+                lod.invalidate(index);
+        };
+        connect(document, &PolygonDocument::vertexInserted, this,
+                [vertexChanged](PolygonDocument::Layer layer, int index, int) { vertexChanged(layer, index); });
+        connect(document, &PolygonDocument::vertexMoved, this,
+                [vertexChanged](PolygonDocument::Layer layer, int index, int, const QPoint &) { vertexChanged(layer, index); });
+        connect(document, &PolygonDocument::vertexRemoved, this,
+                [vertexChanged](PolygonDocument::Layer layer, int index, int, const QPoint &) { vertexChanged(layer, index); });
+        connect(document, &PolygonDocument::polygonReplaced, this,
+                [vertexChanged](PolygonDocument::Layer layer, int index, const QPolygon &) { vertexChanged(layer, index); });
+        connect(document, &PolygonDocument::polygonInserted, this,
+                [this](PolygonDocument::Layer layer) { if (layer == PolygonDocument::Rooms) lod.reset(); });
+        connect(document, &PolygonDocument::polygonRemoved, this,
+                [this](PolygonDocument::Layer layer) { if (layer == PolygonDocument::Rooms) lod.reset(); });
+        connect(document, &PolygonDocument::documentReset, this, [this]() { lod.reset(); });
+    }
+    update();
+}
+
+void PlanView::setLineWidth(int width)
+{
+    lineWidth = width;
+    update();
+}
+
+void PlanView::setPointWidth(int width)
+{
+    pointWidth = width;
+    update();
+}
+
+void PlanView::setHighlight(bool enabled, const QPoint &point)
+{
+    if (highlight == enabled && highlightPoint == point)
+        return;
+
+    if (highlight)
+        markImageRect(QRect(highlightPoint, QSize(1, 1)));
+
+    highlight = enabled;
+    highlightPoint = point;
+
+    if (highlight)
+        markImageRect(QRect(highlightPoint, QSize(1, 1)));
+}
+
+void PlanView::setSelection(const QVector<QPair<int, int>> &vertices)
+{
+    markImageRect(selectionBounds());
+    selection = vertices;
+    markImageRect(selectionBounds());
+}
+
+QRect PlanView::selectionBounds() const
+{
+    if (!document)
+        return QRect();
+
+    const QList<QPolygon> &rooms = document->polygons(PolygonDocument::Rooms);
+    QRect bounds;
+    for (const QPair<int, int> &v : selection)
+        if (v.first < rooms.length() && v.second < rooms.at(v.first).length())
+            bounds |= QRect(rooms.at(v.first).at(v.second), QSize(1, 1));
+    return bounds;
+}
+
+void PlanView::markImageRect(const QRect &rect)
+{
+    if (logicalSize.isEmpty() || rect.isNull())
+        return;
+
+    const qreal sx = qreal(width()) / logicalSize.width();
+    const qreal sy = qreal(height()) / logicalSize.height();
+    const int m = penMargin();
+    const QRectF area = QRectF(rect.adjusted(-m, -m, m, m));
+    dirtyRegion += QRectF(area.x() * sx, area.y() * sy, area.width() * sx, area.height() * sy)
+                   .toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+void PlanView::markAll()
+{
+    dirtyRegion = rect();
+}
+
+void PlanView::flush()
+{
+    if (dirtyRegion.isEmpty())
+        return;
+
+    update(dirtyRegion);
+    dirtyRegion = QRegion();
+}
+
+void PlanView::paintEvent(QPaintEvent *event)
+{
+    TRACE_SCOPE("paintEvent");
+    QPainter painter(this);
+    const QRect exposed = event->rect();
+
+    if (logicalSize.isEmpty())
+    {
+        painter.fillRect(exposed, palette().color(backgroundRole()));
+        return;
+    }
+
+    const qreal sx = qreal(width()) / logicalSize.width();
+    const qreal sy = qreal(height()) / logicalSize.height();
+    const QRectF source(exposed.x() / sx, exposed.y() / sy,
+                        exposed.width() / sx, exposed.height() / sy);
+
+    painter.scale(sx, sy);
+    {
+        TRACE_SCOPE("paintBackground");
+        paintBackground(painter, source.toAlignedRect());
+    }
+
+    const int m = penMargin();
+    {
+        TRACE_SCOPE("paintOverlay");
+        paintOverlay(painter, source.toAlignedRect().adjusted(-m, -m, m, m));
+    }
+    Trace::markPresented();
+}
+
+void PlanView::paintBackground(QPainter &painter, const QRect &area)
+{
+    const QRect visible = area.intersected(QRect(QPoint(0, 0), logicalSize));
+    if (visible.isEmpty())
+        return;
+
+    if (!preview.isNull())
+    {
+        const qreal px = qreal(preview.width()) / logicalSize.width();
+        const qreal py = qreal(preview.height()) / logicalSize.height();
+        painter.drawImage(QRectF(visible), preview,
+                          QRectF(visible.x() * px, visible.y() * py,
+                                 visible.width() * px, visible.height() * py));
+        return;
+    }
+    if (pyramid)
+        pyramid->draw(painter, visible);
+}
+
+void PlanView::paintOverlay(QPainter &painter, const QRect &area)
+{
+    if (!document)
+        return;
+
+    OverlayRenderer renderer(document->polygons(PolygonDocument::Rooms), document->colors(),
+                             document->polygons(PolygonDocument::Doors),
+                             document->pointIndex(PolygonDocument::Rooms), document->segmentIndex());
+    renderer.setLineWidth(lineWidth);
+    renderer.setPointWidth(pointWidth);
+    const int level = PolygonLod::levelFor(painter.transform().m11());
+    if (level > 0)
+        renderer.setLevelOfDetail(&lod.level(document->polygons(PolygonDocument::Rooms), level));
+    renderer.paint(painter, area);
+
+    if (!selection.isEmpty())
+    {
+        const QList<QPolygon> &rooms = document->polygons(PolygonDocument::Rooms);
+        QPolygon points;
+        for (const QPair<int, int> &v : selection)
+        {
+            if (v.first >= rooms.length() || v.second >= rooms.at(v.first).length())
+                continue;
+            const QPoint &p = rooms.at(v.first).at(v.second);
+            if (area.contains(p))
+                points << p;
+        }
+        painter.setPen(QPen(Qt::darkCyan, pointWidth + 2));
+        painter.drawPoints(points);
+    }
+
+    if (highlight)
+    {
+        painter.setPen(QPen(Qt::red, pointWidth));
+        painter.drawPoint(highlightPoint);
+    }
+}
+
+int PlanView::penMargin() const
+{
+    return qMax(lineWidth, pointWidth) + 1;
+}
@@ -0,0 +1,75 @@
+#ifndef PLANVIEW_H
+#define PLANVIEW_H
+
+#include <QWidget>
+#include <QPair>
+#include <QPolygon>
+#include <QRegion>
+#include <QSharedPointer>
+#include <QVector>
+#include "imagePyramid.h"
+#include "polygonDocument.h"
+#include "polygonLod.h"
+
+// Shows the plan image with the polygons drawn on top. The image is drawn
+// from pyramid tiles at the level matching the zoom, only for the exposed
+// area. The overlay is painted per paint event over the same area, so
+// edits should mark the image rect they touched. Marked areas pile up
+// until flush(), which is called once per frame. Zoomed out, rooms are
+// drawn from simplified outlines.
+class PlanView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PlanView(QWidget *parent = nullptr);
+
+    // Draws the background from pyramid, which the plan cache may share.
+    void setBackground(const QSharedPointer<ImagePyramid> &pyramid);
+    // Shows a downscaled stand-in while the full image is still loading.
+    // Coordinates stay those of the full image.
+    void setPreview(const QImage &preview, const QSize &fullSize);
+    QSize imageSize() const;
+    // Memory held by the tiles on screen, the image or preview itself is
+    // shared with the caller.
+    int tileCacheKilobytes() const { return pyramid ? pyramid->cacheKilobytes() : 0; }
+    QSize sizeHint() const override;
+
+    void setDocument(const PolygonDocument *document);
+    void setLineWidth(int width);
+    void setPointWidth(int width);
+    void setHighlight(bool enabled, const QPoint &point = QPoint());
+    // Room vertices drawn as selected, as (polygon, vertex) pairs.
+    void setSelection(const QVector<QPair<int, int>> &vertices);
+
+    // Marks the widget area covering rect, given in image coordinates, for
+    // the next flush(). Pen widths are accounted for here.
+    void markImageRect(const QRect &rect);
+    void markAll();
+    void flush();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    void paintBackground(QPainter &painter, const QRect &exposed);
+    void paintOverlay(QPainter &painter, const QRect &area);
+    int penMargin() const;
+    QRect selectionBounds() const;
+
+    QSharedPointer<ImagePyramid> pyramid;
+    QImage preview;
+    QSize logicalSize;
+    QRegion dirtyRegion;
+
+    const PolygonDocument *document = nullptr;
+    PolygonLod lod;
+
+    int lineWidth = 1;
+    int pointWidth = 2;
+    bool highlight = false;
+    QPoint highlightPoint;
+    QVector<QPair<int, int>> selection;
+};
+
+#endif // PLANVIEW_H
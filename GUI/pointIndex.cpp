@@ -0,0 +1,262 @@
+#include "pointIndex.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <limits>
+
+PointIndex::PointIndex(int cellSize)
+    : cellSize(qMax(1, cellSize))
+{
+}
+
+void PointIndex::rebuild(const QList<QPolygon> &source)
+{
+    clear();
+    lists = &source;
+    for (int l = 0; l < source.length(); l++)
+    {
+        const QPolygon &poly = source.at(l);
+        for (int p = 0; p < poly.length(); p++)
+            addEntry({poly.at(p), l, p});
+    }
+}
+
+void PointIndex::clear()
+{
+    cells.clear();
+    lists = nullptr;
+    count = 0;
+    hasBounds = false;
+}
+
+void PointIndex::insertList(int list)
+{
+    // Renamed from the back, so a moved entry never meets one that still
+    // carries its new name. The polygons behind list sit one further
+    // back in source already.
+    for (int l = lists->length() - 1; l > list; l--)
+    {
+        const QPolygon &poly = lists->at(l);
+        for (int p = 0; p < poly.length(); p++)
+            renameEntry(l - 1, p, poly.at(p), l, p);
+    }
+
+    const QPolygon &poly = lists->at(list);
+    for (int p = 0; p < poly.length(); p++)
+        addEntry({poly.at(p), list, p});
+}
+
+void PointIndex::removeList(int list, const QPolygon &removed)
+{
+    for (int p = 0; p < removed.length(); p++)
+        takeEntry(list, p, removed.at(p));
+
+    for (int l = list; l < lists->length(); l++)
+    {
+        const QPolygon &poly = lists->at(l);
+        for (int p = 0; p < poly.length(); p++)
+            renameEntry(l + 1, p, poly.at(p), l, p);
+    }
+}
+
+void PointIndex::replaceList(int list, const QPolygon &old)
+{
+    for (int p = 0; p < old.length(); p++)
+        takeEntry(list, p, old.at(p));
+
+    const QPolygon &poly = lists->at(list);
+    for (int p = 0; p < poly.length(); p++)
+        addEntry({poly.at(p), list, p});
+}
+
+void PointIndex::insertPoint(int list, int point)
+{
+    const QPolygon &poly = lists->at(list);
+    for (int p = poly.length() - 1; p > point; p--)
+        renameEntry(list, p - 1, poly.at(p), list, p);
+
+    addEntry({poly.at(point), list, point});
+}
+
+void PointIndex::movePoint(int list, int point, const QPoint &from)
+{
+    takeEntry(list, point, from);
+    addEntry({lists->at(list).at(point), list, point});
+}
+
+void PointIndex::removePoint(int list, int point, const QPoint &from)
+{
+    takeEntry(list, point, from);
+    const QPolygon &poly = lists->at(list);
+    for (int p = point; p < poly.length(); p++)
+        renameEntry(list, p + 1, poly.at(p), list, p);
+}
+
+bool PointIndex::closest(const QPoint &pos, int *list, int *point, QPoint *closestPoint) const
+{
+    if (count == 0)
+        return false;
+
+    int best = std::numeric_limits<int>::max();
+    const Entry *bestEntry = nullptr;
+
+    auto scan = [&](const QVector<Entry> &cell) {
+        for (const Entry &entry : cell)
+        {
+            int d = (entry.pos - pos).manhattanLength();
+            if (d < best || (d == best && bestEntry && (entry.list < bestEntry->list
+                    || (entry.list == bestEntry->list && entry.point < bestEntry->point))))
+            {
+                best = d;
+                bestEntry = &entry;
+            }
+        }
+    };
+
+    auto visit = [&](int cx, int cy) {
+        auto it = cells.constFind(gridCellKey(cx, cy));
+        if (it != cells.constEnd())
+            scan(it.value());
+    };
+
+    const int cx = floorDiv(pos.x());
+    const int cy = floorDiv(pos.y());
+    const int maxRing = qMax(qMax(qAbs(cx - minCellX), qAbs(cx - maxCellX)),
+                             qMax(qAbs(cy - minCellY), qAbs(cy - maxCellY)));
+
+    for (int r = 0; r <= maxRing; r++)
+    {
+        // Once a ring has more cells than are occupied, walking the occupied
+        // cells directly is cheaper than probing empty ones.
+        if (8 * r > cells.size())
+        {
+            best = std::numeric_limits<int>::max();
+            bestEntry = nullptr;
+            for (auto it = cells.constBegin(); it != cells.constEnd(); ++it)
+                scan(it.value());
+            break;
+        }
+
+        if (r == 0)
+        {
+            visit(cx, cy);
+        }
+        else
+        {
+            for (int x = cx - r; x <= cx + r; x++)
+            {
+                visit(x, cy - r);
+                visit(x, cy + r);
+            }
+            for (int y = cy - r + 1; y <= cy + r - 1; y++)
+            {
+                visit(cx - r, y);
+                visit(cx + r, y);
+            }
+        }
+
+        // Every unvisited cell is at least r cells away on one axis.
+        if (bestEntry && best < r * cellSize)
+            break;
+    }
+
+    *list = bestEntry->list;
+    *point = bestEntry->point;
+    *closestPoint = bestEntry->pos;
+    return true;
+}
+
+QVector<QPair<int, int>> PointIndex::pointsIn(const QRect &rect) const
+{
+    QVector<QPair<int, int>> hits;
+    if (count == 0 || rect.isEmpty())
+        return hits;
+
+    const int cx0 = qMax(floorDiv(rect.left()), minCellX);
+    const int cx1 = qMin(floorDiv(rect.right()), maxCellX);
+    const int cy0 = qMax(floorDiv(rect.top()), minCellY);
+    const int cy1 = qMin(floorDiv(rect.bottom()), maxCellY);
+    if (qint64(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > cells.size())
+    {
+        for (auto it = cells.constBegin(); it != cells.constEnd(); ++it)
+            for (const Entry &entry : it.value())
+                if (rect.contains(entry.pos))
+                    hits.append(qMakePair(entry.list, entry.point));
+    }
+    else
+    {
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            for (int cy = cy0; cy <= cy1; cy++)
+            {
+                auto it = cells.constFind(gridCellKey(cx, cy));
+                if (it == cells.constEnd())
+                    continue;
+                for (const Entry &entry : it.value())
+                    if (rect.contains(entry.pos))
+                        hits.append(qMakePair(entry.list, entry.point));
+            }
+        }
+    }
+    std::sort(hits.begin(), hits.end());
+    return hits;
+}
+
+void PointIndex::addEntry(const Entry &entry)
+{
+    const int cx = floorDiv(entry.pos.x());
+    const int cy = floorDiv(entry.pos.y());
+    cells[gridCellKey(cx, cy)].append(entry);
+    count++;
+
+    if (!hasBounds)
+    {
+        minCellX = maxCellX = cx;
+        minCellY = maxCellY = cy;
+        hasBounds = true;
+    }
+    else
+    {
+        minCellX = qMin(minCellX, cx);
+        maxCellX = qMax(maxCellX, cx);
+        minCellY = qMin(minCellY, cy);
+        maxCellY = qMax(maxCellY, cy);
+    }
+}
+
+void PointIndex::takeEntry(int list, int point, const QPoint &pos)
+{
+    auto it = cells.find(gridCellKey(floorDiv(pos.x()), floorDiv(pos.y())));
+    if (it == cells.end())
+        return;
+
+    QVector<Entry> &cell = it.value();
+    for (int i = 0; i < cell.length(); i++)
+    {
+        if (cell.at(i).list == list && cell.at(i).point == point)
+        {
+            cell[i] = cell.last();
+            cell.removeLast();
+            count--;
+            break;
+        }
+    }
+    if (cell.isEmpty())
+        cells.erase(it);
+}
+
+void PointIndex::renameEntry(int list, int point, const QPoint &pos, int newList, int newPoint)
+{
+    auto it = cells.find(gridCellKey(floorDiv(pos.x()), floorDiv(pos.y())));
+    if (it == cells.end())
+        return;
+
+    for (Entry &entry : it.value())
+    {
+        if (entry.list == list && entry.point == point)
+        {
+            entry.list = newList;
+            entry.point = newPoint;
+            return;
+        }
+    }
+}
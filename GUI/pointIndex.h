@@ -0,0 +1,71 @@
+#ifndef POINTINDEX_H
+#define POINTINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QPoint>
+#include <QPair>
+#include <QPolygon>
+#include <QRect>
+#include <QVector>
+#include "gridCell.h"
+
+// Uniform grid over the vertices of a polygon list. Entries are addressed by
+// the same (list, point) indices as the QList<QPolygon> they mirror. The
+// index reads positions straight from that list, it keeps no copy: every
+// edit of the list is followed by the matching call below, with the
+// position a moved or removed point had before.
+class PointIndex
+{
+public:
+    explicit PointIndex(int cellSize = 64);
+
+    // source has to outlive the index, or the next rebuild().
+    void rebuild(const QList<QPolygon> &source);
+    void clear();
+
+    // After source gained or lost a polygon at list.
+    void insertList(int list);
+    void removeList(int list, const QPolygon &removed);
+    // After the polygon at list got new points, old being the ones it had.
+    void replaceList(int list, const QPolygon &old);
+    // After source gained, moved or lost a point.
+    void insertPoint(int list, int point);
+    void movePoint(int list, int point, const QPoint &from);
+    void removePoint(int list, int point, const QPoint &from);
+
+    // Nearest vertex by manhattan length. Ties resolve to the lowest
+    // (list, point) pair, like a linear scan in list order would.
+    bool closest(const QPoint &pos, int *list, int *point, QPoint *closestPoint) const;
+
+    // (list, point) pairs of the vertices inside rect, in list order.
+    QVector<QPair<int, int>> pointsIn(const QRect &rect) const;
+
+    int size() const { return count; }
+
+private:
+    struct Entry
+    {
+        QPoint pos;
+        int list;
+        int point;
+    };
+
+    int floorDiv(int v) const { return gridFloorDiv(v, cellSize); }
+    void addEntry(const Entry &entry);
+    void takeEntry(int list, int point, const QPoint &pos);
+    void renameEntry(int list, int point, const QPoint &pos, int newList, int newPoint);
+
+    int cellSize;
+    int count = 0;
+    QHash<quint64, QVector<Entry>> cells;
+    const QList<QPolygon> *lists = nullptr;
+
+    bool hasBounds = false;
+    int minCellX = 0;
+    int minCellY = 0;
+    int maxCellX = 0;
+    int maxCellY = 0;
+};
+
+#endif // POINTINDEX_H
@@ -0,0 +1,216 @@
+#include "polygonDocument.h"
+
+PolygonDocument::PolygonDocument(QObject *parent)
+    : QObject(parent)
+{
+    rebuildIndexes();
+}
+
+qint64 PolygonDocument::vertexCount() const
+{
+    qint64 n = 0;
+    for (const LayerData &data : layers)
+        for (const QPolygon &poly : data.polygons)
+            n += poly.length();
+    return n;
+}
+
+bool PolygonDocument::findPolygon(Id id, Layer *layer, int *index) const
+{
+    const auto it = polygonLookup.constFind(id);
+    if (it == polygonLookup.constEnd())
+        return false;
+    *layer = Layer(it.value() >> 31);
+    *index = int(it.value() & 0x7fffffff);
+    return true;
+}
+
+PolygonDocument::VertexHandle PolygonDocument::vertexHandle(Layer layer, int index, int vertex) const
+{
+    VertexHandle handle;
+    handle.polygon = layers[layer].ids.at(index);
+    handle.vertex = layers[layer].vertexIds.at(index).at(vertex);
+    return handle;
+}
+
+bool PolygonDocument::findVertex(const VertexHandle &handle, Layer *layer, int *index, int *vertex) const
+{
+    if (!findPolygon(handle.polygon, layer, index))
+        return false;
+    // Polygons are short, a scan of one is cheaper than another table.
+    const int v = layers[*layer].vertexIds.at(*index).indexOf(handle.vertex);
+    if (v < 0)
+        return false;
+    *vertex = v;
+    return true;
+}
+
+ProjectData PolygonDocument::toProjectData() const
+{
+    ProjectData data;
+    data.polygons = layers[Rooms].polygons;
+    data.colors = layers[Rooms].colors;
+    data.doors = layers[Doors].polygons;
+    return data;
+}
+
+void PolygonDocument::setProjectData(const ProjectData &data)
+{
+    emit documentAboutToReset();
+    layers[Rooms].polygons = data.polygons;
+    layers[Rooms].colors = data.colors;
+    layers[Doors].polygons = data.doors;
+    layers[Doors].colors.clear();
+    for (int i = 0; i < data.doors.length(); i++)
+        layers[Doors].colors.append(QString());
+
+    polygonLookup.clear();
+    assignIds(layers[Rooms]);
+    assignIds(layers[Doors]);
+    renumberFrom(Rooms, 0);
+    renumberFrom(Doors, 0);
+    rebuildIndexes();
+    emit documentReset();
+}
+
+void PolygonDocument::clear()
+{
+    setProjectData(ProjectData());
+}
+
+int PolygonDocument::appendPolygon(Layer layer, const QPolygon &points, const QString &color)
+{
+    const int index = count(layer);
+    insertPolygon(layer, index, points, color);
+    return index;
+}
+
+void PolygonDocument::insertPolygon(Layer layer, int index, const QPolygon &points, const QString &color)
+{
+    LayerData &data = layers[layer];
+    data.polygons.insert(index, points);
+    data.colors.insert(index, color);
+    data.ids.insert(index, nextPolygonId++);
+
+    QVector<Id> vertexIds(points.length());
+    for (Id &id : vertexIds)
+        id = nextVertexId++;
+    data.vertexIds.insert(index, vertexIds);
+    renumberFrom(layer, index);
+
+    data.points.insertList(index);
+    if (layer == Rooms)
+        roomEdges.insertList(index);
+
+    emit polygonInserted(layer, index);
+}
+
+void PolygonDocument::removePolygon(Layer layer, int index)
+{
+    LayerData &data = layers[layer];
+    const QPolygon points = data.polygons.takeAt(index);
+    const QString color = data.colors.takeAt(index);
+    polygonLookup.remove(data.ids.at(index));
+    data.ids.remove(index);
+    data.vertexIds.remove(index);
+    renumberFrom(layer, index);
+
+    data.points.removeList(index, points);
+    if (layer == Rooms)
+        roomEdges.removeList(index, points);
+
+    emit polygonRemoved(layer, index, points, color);
+}
+
+void PolygonDocument::replacePolygon(Layer layer, int index, const QPolygon &points)
+{
+    LayerData &data = layers[layer];
+    const QPolygon from = data.polygons.at(index);
+    data.polygons[index] = points;
+
+    QVector<Id> &vertexIds = data.vertexIds[index];
+    vertexIds.resize(points.length());
+    for (Id &id : vertexIds)
+        id = nextVertexId++;
+
+    data.points.replaceList(index, from);
+    if (layer == Rooms)
+        roomEdges.replaceList(index, from);
+
+    emit polygonReplaced(layer, index, from);
+}
+
+void PolygonDocument::appendVertex(Layer layer, int index, const QPoint &pos)
+{
+    insertVertex(layer, index, layers[layer].polygons.at(index).length(), pos);
+}
+
+void PolygonDocument::insertVertex(Layer layer, int index, int vertex, const QPoint &pos)
+{
+    LayerData &data = layers[layer];
+    data.polygons[index].insert(vertex, pos);
+    data.vertexIds[index].insert(vertex, nextVertexId++);
+
+    data.points.insertPoint(index, vertex);
+    if (layer == Rooms)
+        roomEdges.insertPoint(index, vertex);
+
+    emit vertexInserted(layer, index, vertex);
+}
+
+void PolygonDocument::moveVertex(Layer layer, int index, int vertex, const QPoint &pos)
+{
+    LayerData &data = layers[layer];
+    const QPoint from = data.polygons.at(index).at(vertex);
+    if (from == pos)
+        return;
+    data.polygons[index][vertex] = pos;
+
+    data.points.movePoint(index, vertex, from);
+    if (layer == Rooms)
+        roomEdges.movePoint(index, vertex, from);
+
+    emit vertexMoved(layer, index, vertex, from);
+}
+
+void PolygonDocument::removeVertex(Layer layer, int index, int vertex)
+{
+    LayerData &data = layers[layer];
+    const QPoint from = data.polygons.at(index).at(vertex);
+    data.polygons[index].remove(vertex);
+    data.vertexIds[index].remove(vertex);
+
+    data.points.removePoint(index, vertex, from);
+    if (layer == Rooms)
+        roomEdges.removePoint(index, vertex, from);
+
+    emit vertexRemoved(layer, index, vertex, from);
+}
+
+void PolygonDocument::rebuildIndexes()
+{
+    layers[Rooms].points.rebuild(layers[Rooms].polygons);
+    layers[Doors].points.rebuild(layers[Doors].polygons);
+    roomEdges.rebuild(layers[Rooms].polygons);
+}
+
+void PolygonDocument::assignIds(LayerData &data)
+{
+    data.ids.resize(data.polygons.length());
+    data.vertexIds.resize(data.polygons.length());
+    for (int i = 0; i < data.polygons.length(); i++)
+    {
+        data.ids[i] = nextPolygonId++;
+        QVector<Id> &vertexIds = data.vertexIds[i];
+        vertexIds.resize(data.polygons.at(i).length());
+        for (Id &id : vertexIds)
+            id = nextVertexId++;
+    }
+}
+
+void PolygonDocument::renumberFrom(Layer layer, int index)
+{
+    const QVector<Id> &ids = layers[layer].ids;
+    for (int i = index; i < ids.length(); i++)
+        polygonLookup.insert(ids.at(i), quint32(layer) << 31 | quint32(i));
+}
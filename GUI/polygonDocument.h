@@ -0,0 +1,109 @@
+#ifndef POLYGONDOCUMENT_H
+#define POLYGONDOCUMENT_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPolygon>
+#include <QString>
+#include <QVector>
+#include "pointIndex.h"
+#include "projectIO.h"
+#include "segmentIndex.h"
+
+// The geometry being edited: rooms with their colors and doors. Every
+// polygon keeps its points in one contiguous array, and the lists are the
+// ones indexes, renderers and exporters read directly, without copies.
+//
+// All edits go through the mutation functions, which keep the spatial
+// indexes in sync and announce what changed. Positions are addressed by
+// (layer, polygon index, vertex index); ids stay valid across other edits
+// and are never reused.
+class PolygonDocument : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Layer { Rooms, Doors };
+    Q_ENUM(Layer)
+
+    typedef quint32 Id;
+
+    struct VertexHandle
+    {
+        Id polygon = 0;
+        Id vertex = 0;
+        bool isNull() const { return polygon == 0; }
+    };
+
+    explicit PolygonDocument(QObject *parent = nullptr);
+
+    const QList<QPolygon> &polygons(Layer layer) const { return layers[layer].polygons; }
+    // Room colors, parallel to polygons(Rooms).
+    const QList<QString> &colors() const { return layers[Rooms].colors; }
+    const QPolygon &polygon(Layer layer, int index) const { return layers[layer].polygons.at(index); }
+    int count(Layer layer) const { return layers[layer].polygons.length(); }
+    qint64 vertexCount() const;
+
+    // Vertex grid of either layer, edge grid of the rooms.
+    const PointIndex &pointIndex(Layer layer) const { return layers[layer].points; }
+    const SegmentIndex &segmentIndex() const { return roomEdges; }
+
+    Id polygonId(Layer layer, int index) const { return layers[layer].ids.at(index); }
+    bool findPolygon(Id id, Layer *layer, int *index) const;
+    VertexHandle vertexHandle(Layer layer, int index, int vertex) const;
+    bool findVertex(const VertexHandle &handle, Layer *layer, int *index, int *vertex) const;
+
+    // Shares the storage, copies only happen once either side is edited.
+    ProjectData toProjectData() const;
+    void setProjectData(const ProjectData &data);
+    void clear();
+
+    int appendPolygon(Layer layer, const QPolygon &points = QPolygon(), const QString &color = QString());
+    void insertPolygon(Layer layer, int index, const QPolygon &points, const QString &color = QString());
+    void removePolygon(Layer layer, int index);
+    // New points for a polygon that keeps its place, id and color. Its
+    // vertices get new ids.
+    void replacePolygon(Layer layer, int index, const QPolygon &points);
+
+    void appendVertex(Layer layer, int index, const QPoint &pos);
+    void insertVertex(Layer layer, int index, int vertex, const QPoint &pos);
+    void moveVertex(Layer layer, int index, int vertex, const QPoint &pos);
+    void removeVertex(Layer layer, int index, int vertex);
+
+signals:
+    void polygonInserted(PolygonDocument::Layer layer, int index);
+    // Carries the removed geometry, the polygon is already gone.
+    void polygonRemoved(PolygonDocument::Layer layer, int index, const QPolygon &points, const QString &color);
+    void polygonReplaced(PolygonDocument::Layer layer, int index, const QPolygon &from);
+    void vertexInserted(PolygonDocument::Layer layer, int index, int vertex);
+    void vertexMoved(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from);
+    void vertexRemoved(PolygonDocument::Layer layer, int index, int vertex, const QPoint &from);
+    // Everything is replaced at once, the old content is still readable in
+    // documentAboutToReset().
+    void documentAboutToReset();
+    void documentReset();
+
+private:
+    struct LayerData
+    {
+        QList<QPolygon> polygons;
+        QList<QString> colors;
+        QVector<Id> ids;
+        QVector<QVector<Id>> vertexIds;
+        PointIndex points;
+    };
+
+    void rebuildIndexes();
+    void assignIds(LayerData &data);
+    void renumberFrom(Layer layer, int index);
+
+    LayerData layers[2];
+    SegmentIndex roomEdges;
+    // Polygon id -> layer << 31 | index
+    QHash<Id, quint32> polygonLookup;
+    Id nextPolygonId = 1;
+    Id nextVertexId = 1;
+};
+
+#endif // POLYGONDOCUMENT_H
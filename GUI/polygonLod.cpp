@@ -0,0 +1,67 @@
+#include "polygonLod.h"
+#include <QtConcurrent>
+#include <functional>
+#include "polygonSimplifier.h"
+#include "trace.h"
+
+int PolygonLod::levelFor(qreal scale)
+{
+    int level = 0;
+    while (level < 16 && scale * (2 << level) <= 1.0)
+        level++;
+    return level;
+}
+
+void PolygonLod::invalidate(int polygon)
+{
+    for (Level &level : levels)
+        if (polygon < level.stale.size())
+            level.stale[polygon] = true;
+}
+
+void PolygonLod::reset()
+{
+    levels.clear();
+}
+
+const PolygonLod::Level &PolygonLod::level(const QList<QPolygon> &source, int level)
+{
+    if (levels.size() <= level)
+        levels.resize(level + 1);
+    Level &lod = levels[level];
+
+    // A changed polygon count means insertions or removals that were not
+    // reported one by one, everything is redone.
+    const int n = source.length();
+    if (lod.polygons.size() != n)
+    {
+        lod.polygons.resize(n);
+        lod.bounds.resize(n);
+        lod.stale.fill(true, n);
+    }
+
+    QVector<int> stale;
+    for (int i = 0; i < n; i++)
+        if (lod.stale.at(i))
+            stale.append(i);
+    if (stale.isEmpty())
+        return lod;
+
+    TRACE_SCOPE("lodUpdate");
+    const double tolerance = 1 << level;
+    QPolygon *polygons = lod.polygons.data();
+    QRect *bounds = lod.bounds.data();
+    const std::function<void(int &)> simplify = [&source, polygons, bounds, tolerance](int &i) {
+        polygons[i] = PolygonSimplifier::douglasPeucker(source.at(i), tolerance);
+        bounds[i] = source.at(i).boundingRect();
+    };
+
+    // Dragging redoes a single polygon, not worth the threads.
+    if (stale.size() == 1)
+        simplify(stale[0]);
+    else
+        QtConcurrent::blockingMap(stale, simplify);
+
+    lod.stale.fill(false);
+    return lod;
+}
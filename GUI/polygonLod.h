@@ -0,0 +1,36 @@
+#ifndef POLYGONLOD_H
+#define POLYGONLOD_H
+
+#include <QList>
+#include <QPolygon>
+#include <QRect>
+#include <QVector>
+
+// Simplified copies of the room outlines for zoomed out views. Level L is
+// used from scale 1/2^L down and drops detail below 2^L image pixels, which
+// is at most one screen pixel there. Levels are built on first use and
+// polygons are redone lazily after they were invalidated.
+class PolygonLod
+{
+public:
+    struct Level
+    {
+        QVector<QPolygon> polygons;
+        QVector<QRect> bounds;
+        QVector<bool> stale;
+    };
+
+    // 0 means full detail.
+    static int levelFor(qreal scale);
+
+    void invalidate(int polygon);
+    void reset();
+
+    // The level, brought up to date with source first.
+    const Level &level(const QList<QPolygon> &source, int level);
+
+private:
+    QVector<Level> levels;
+};
+
+#endif // POLYGONLOD_H
@@ -0,0 +1,195 @@
+#include "polygonSimplifier.h"
+#include <QPair>
+#include <QVector>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace {
+
+double squaredSegmentDistance(const QPoint &p, const QPoint &a, const QPoint &b)
+{
+    const double dx = b.x() - a.x();
+    const double dy = b.y() - a.y();
+    const double length = dx * dx + dy * dy;
+    double u = 0;
+    if (length != 0)
+        u = qBound(0.0, ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / length, 1.0);
+    const double ex = a.x() + u * dx - p.x();
+    const double ey = a.y() + u * dy - p.y();
+    return ex * ex + ey * ey;
+}
+
+double triangleArea(const QPoint &a, const QPoint &b, const QPoint &c)
+{
+    const double cross = double(b.x() - a.x()) * (c.y() - a.y()) - double(b.y() - a.y()) * (c.x() - a.x());
+    return qAbs(cross) / 2;
+}
+
+struct Candidate
+{
+    double area;
+    int index;
+    int stamp;
+    bool operator>(const Candidate &other) const { return area > other.area; }
+};
+
+}
+
+QPolygon PolygonSimplifier::simplify(const QPolygon &polygon, Method method, double tolerance)
+{
+    if (method == VisvalingamWhyatt)
+        return visvalingamWhyatt(polygon, tolerance);
+    return douglasPeucker(polygon, tolerance);
+}
+
+QList<QPolygon> PolygonSimplifier::simplify(const QList<QPolygon> &polygons, Method method, double tolerance)
+{
+    QList<QPolygon> result;
+    result.reserve(polygons.length());
+    for (const QPolygon &polygon : polygons)
+        result.append(simplify(polygon, method, tolerance));
+    return result;
+}
+
+QPolygon PolygonSimplifier::douglasPeucker(const QPolygon &polygon, double tolerance)
+{
+    const int n = polygon.length();
+    if (n < 4)
+        return polygon;
+
+    // A closed outline is split at the point farthest from the first one,
+    // both halves are then reduced as open polylines.
+    int split = 1;
+    qint64 farthest = -1;
+    for (int i = 1; i < n; i++)
+    {
+        const qint64 dx = polygon.at(i).x() - polygon.at(0).x();
+        const qint64 dy = polygon.at(i).y() - polygon.at(0).y();
+        if (dx * dx + dy * dy > farthest)
+        {
+            farthest = dx * dx + dy * dy;
+            split = i;
+        }
+    }
+
+    QVector<bool> keep(n + 1, false);
+    keep[0] = keep[split] = keep[n] = true;
+
+    // Index n stands for point 0 again, closing the outline.
+    auto at = [&polygon, n](int i) -> const QPoint & { return polygon.at(i == n ? 0 : i); };
+
+    const double limit = tolerance * tolerance;
+    QVector<QPair<int, int>> stack;
+    stack.append(qMakePair(0, split));
+    stack.append(qMakePair(split, n));
+    while (!stack.isEmpty())
+    {
+        const QPair<int, int> range = stack.takeLast();
+        double worst = -1;
+        int worstIndex = -1;
+        for (int i = range.first + 1; i < range.second; i++)
+        {
+            const double d = squaredSegmentDistance(at(i), at(range.first), at(range.second));
+            if (d > worst)
+            {
+                worst = d;
+                worstIndex = i;
+            }
+        }
+        if (worstIndex < 0 || worst <= limit)
+            continue;
+
+        keep[worstIndex] = true;
+        stack.append(qMakePair(range.first, worstIndex));
+        stack.append(qMakePair(worstIndex, range.second));
+    }
+
+    // A thin room can have both halves within the tolerance, the point
+    // farthest from its half's chord keeps it an area.
+    if (keep.count(true) < 4)
+    {
+        double worst = -1;
+        int worstIndex = -1;
+        for (int i = 1; i < n; i++)
+        {
+            if (i == split)
+                continue;
+            const double d = i < split ? squaredSegmentDistance(at(i), at(0), at(split))
+                                       : squaredSegmentDistance(at(i), at(split), at(n));
+            if (d > worst)
+            {
+                worst = d;
+                worstIndex = i;
+            }
+        }
+        keep[worstIndex] = true;
+    }
+
+    QPolygon result;
+    for (int i = 0; i < n; i++)
+        if (keep.at(i))
+            result << polygon.at(i);
+
+    // The first point was kept as an anchor only, it goes too when it sits
+    // on the line between its neighbours.
+    const int m = result.length();
+    if (m > 3 && squaredSegmentDistance(result.at(0), result.at(m - 1), result.at(1)) <= limit)
+        result.remove(0);
+    return result;
+}
+
+QPolygon PolygonSimplifier::visvalingamWhyatt(const QPolygon &polygon, double tolerance)
+{
+    const int n = polygon.length();
+    if (n < 4)
+        return polygon;
+
+    // The outline as a ring of linked points. A point's area changes when a
+    // neighbour goes, stale heap entries are recognized by their stamp.
+    QVector<int> prev(n);
+    QVector<int> next(n);
+    QVector<int> stamps(n, 0);
+    QVector<bool> removed(n, false);
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap;
+    for (int i = 0; i < n; i++)
+    {
+        prev[i] = i == 0 ? n - 1 : i - 1;
+        next[i] = i == n - 1 ? 0 : i + 1;
+        heap.push(Candidate { triangleArea(polygon.at(prev.at(i)), polygon.at(i), polygon.at(next.at(i))), i, 0 });
+    }
+
+    const double limit = tolerance * tolerance;
+    int remaining = n;
+    while (remaining > 3 && !heap.empty())
+    {
+        const Candidate c = heap.top();
+        heap.pop();
+        if (removed.at(c.index) || c.stamp != stamps.at(c.index))
+            continue;
+        if (c.area >= limit)
+            break;
+
+        removed[c.index] = true;
+        remaining--;
+        const int a = prev.at(c.index);
+        const int b = next.at(c.index);
+        next[a] = b;
+        prev[b] = a;
+
+        // Neighbours never get a smaller area than the point just dropped,
+        // otherwise they could go next and erode the outline step by step.
+        for (int i : { a, b })
+        {
+            const double area = qMax(c.area, triangleArea(polygon.at(prev.at(i)), polygon.at(i), polygon.at(next.at(i))));
+            heap.push(Candidate { area, i, ++stamps[i] });
+        }
+    }
+
+    QPolygon result;
+    result.reserve(remaining);
+    for (int i = 0; i < n; i++)
+        if (!removed.at(i))
+            result << polygon.at(i);
+    return result;
+}
@@ -0,0 +1,27 @@
+#ifndef POLYGONSIMPLIFIER_H
+#define POLYGONSIMPLIFIER_H
+
+#include <QList>
+#include <QPolygon>
+
+// Vertex reduction for closed outlines. Both methods only drop points, the
+// points kept are unchanged, and never go below three points.
+class PolygonSimplifier
+{
+public:
+    enum Method { DouglasPeucker, VisvalingamWhyatt };
+
+    static QPolygon simplify(const QPolygon &polygon, Method method, double tolerance);
+    static QList<QPolygon> simplify(const QList<QPolygon> &polygons, Method method, double tolerance);
+
+    // Douglas-Peucker: keeps the points that lie farther than tolerance from
+    // the outline through the points kept so far.
+    static QPolygon douglasPeucker(const QPolygon &polygon, double tolerance);
+
+    // Visvalingam-Whyatt: repeatedly drops the point whose triangle with its
+    // neighbours is smallest, while that area is below tolerance squared.
+    // Keeps the overall shape better than Douglas-Peucker on noisy outlines.
+    static QPolygon visvalingamWhyatt(const QPolygon &polygon, double tolerance);
+};
+
+#endif // POLYGONSIMPLIFIER_H
@@ -0,0 +1,807 @@
+#include "polygonValidator.h"
+#include <QRect>
+#include <QSet>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <set>
+#include <tuple>
+#include <vector>
+#include "trace.h"
+
+namespace {
+
+typedef PolygonValidator::Issue Issue;
+
+struct Segment
+{
+    QPoint a;
+    QPoint b;
+    int polygon;
+    int edge;
+};
+
+int orient(const QPoint &p, const QPoint &q, const QPoint &r)
+{
+    const qint64 v = qint64(q.x() - p.x()) * (r.y() - p.y()) - qint64(q.y() - p.y()) * (r.x() - p.x());
+    return v > 0 ? 1 : (v < 0 ? -1 : 0);
+}
+
+// p is collinear with a-b, is it inside without being an end?
+bool strictlyInside(const QPoint &p, const QPoint &a, const QPoint &b)
+{
+    return p != a && p != b
+        && qMin(a.x(), b.x()) <= p.x() && p.x() <= qMax(a.x(), b.x())
+        && qMin(a.y(), b.y()) <= p.y() && p.y() <= qMax(a.y(), b.y());
+}
+
+QPointF crossingPoint(const Segment &s, const Segment &t)
+{
+    const double rx = s.b.x() - s.a.x();
+    const double ry = s.b.y() - s.a.y();
+    const double qx = t.b.x() - t.a.x();
+    const double qy = t.b.y() - t.a.y();
+    const double u = ((t.a.x() - s.a.x()) * qy - (t.a.y() - s.a.y()) * qx) / (rx * qy - ry * qx);
+    return QPointF(s.a.x() + u * rx, s.a.y() + u * ry);
+}
+
+// Crossings count between any two edges. Touching and running along each
+// other only within one room, neighbouring rooms share walls and corners.
+// proper is set for crossings in the interior of both edges.
+bool testPair(const Segment &s, const Segment &t, Issue *issue, bool *proper)
+{
+    *proper = false;
+    issue->polygon = s.polygon;
+    issue->index = s.edge;
+    issue->otherPolygon = t.polygon;
+    issue->otherIndex = t.edge;
+
+    const int o1 = orient(s.a, s.b, t.a);
+    const int o2 = orient(s.a, s.b, t.b);
+    const int o3 = orient(t.a, t.b, s.a);
+    const int o4 = orient(t.a, t.b, s.b);
+    if (o1 * o2 < 0 && o3 * o4 < 0)
+    {
+        issue->kind = Issue::Crossing;
+        issue->at = crossingPoint(s, t);
+        *proper = true;
+        return true;
+    }
+    if (s.polygon != t.polygon)
+        return false;
+
+    if (o1 == 0 && o2 == 0)
+    {
+        // Collinear, measured along the axis the edge mostly runs on.
+        const bool alongX = qAbs(s.b.x() - s.a.x()) >= qAbs(s.b.y() - s.a.y());
+        auto coord = [alongX](const QPoint &p) { return alongX ? p.x() : p.y(); };
+        const int lo = qMax(qMin(coord(s.a), coord(s.b)), qMin(coord(t.a), coord(t.b)));
+        const int hi = qMin(qMax(coord(s.a), coord(s.b)), qMax(coord(t.a), coord(t.b)));
+        if (hi <= lo)
+            return false;
+
+        const double m = (lo + hi) / 2.0;
+        const double u = (m - coord(s.a)) / (coord(s.b) - coord(s.a));
+        issue->kind = Issue::Overlap;
+        issue->at = QPointF(s.a.x() + u * (s.b.x() - s.a.x()), s.a.y() + u * (s.b.y() - s.a.y()));
+        return true;
+    }
+
+    // An end resting on the other edge. Neighbouring edges only share an
+    // end, which never counts.
+    const QPoint *touch = nullptr;
+    if (o1 == 0 && strictlyInside(t.a, s.a, s.b))
+        touch = &t.a;
+    else if (o2 == 0 && strictlyInside(t.b, s.a, s.b))
+        touch = &t.b;
+    else if (o3 == 0 && strictlyInside(s.a, t.a, t.b))
+        touch = &s.a;
+    else if (o4 == 0 && strictlyInside(s.b, t.a, t.b))
+        touch = &s.b;
+    if (!touch)
+        return false;
+
+    issue->kind = Issue::Crossing;
+    issue->at = QPointF(*touch);
+    return true;
+}
+
+bool adjacent(int u, int v, int n)
+{
+    return (u + 1) % n == v || (v + 1) % n == u;
+}
+
+quint64 pointKey(const QPoint &p)
+{
+    return (quint64(quint32(p.x())) << 32) | quint32(p.y());
+}
+
+// Bentley-Ottmann over segments ordered left to right (a before b by x,
+// then y). The status holds slots ordered by the height of their segment
+// at the sweep position; crossing segments trade slots instead of being
+// removed and inserted again.
+class Sweep
+{
+public:
+    explicit Sweep(const QVector<Segment> &segments)
+        : segments(segments), status(Order { this }),
+          slotSegment(segments.size()), segmentSlot(segments.size()), active(segments.size(), false)
+    {
+        for (int i = 0; i < segments.size(); i++)
+            slotSegment[i] = i;
+    }
+
+    QVector<Issue> run()
+    {
+        for (int i = 0; i < segments.size(); i++)
+        {
+            events.push(Event { double(segments.at(i).a.x()), double(segments.at(i).a.y()), Start, i, i });
+            events.push(Event { double(segments.at(i).b.x()), double(segments.at(i).b.y()), End, i, i });
+        }
+
+        while (!events.empty())
+        {
+            const Event e = events.top();
+            events.pop();
+            sweepX = e.x;
+            sweepY = e.y;
+
+            if (e.type == Start)
+            {
+                const Status::iterator it = status.insert(e.s).first;
+                segmentSlot[e.s] = it;
+                active[e.s] = true;
+                checkThrough(it);
+                if (it != status.begin())
+                    check(std::prev(it), it);
+                if (std::next(it) != status.end())
+                    check(it, std::next(it));
+            }
+            else if (e.type == End)
+            {
+                const Status::iterator it = segmentSlot.at(e.s);
+                checkThrough(it);
+                const bool hasBelow = it != status.begin();
+                const Status::iterator below = hasBelow ? std::prev(it) : status.end();
+                const Status::iterator above = std::next(it);
+                status.erase(it);
+                active[e.s] = false;
+                if (hasBelow && above != status.end())
+                    check(below, above);
+            }
+            else
+            {
+                // Every crossing at this point, their segments form one run
+                // in the status that turns upside down.
+                QSet<int> involved;
+                involved << e.s << e.t;
+                while (!events.empty() && events.top().type == Cross && samePoint(events.top(), e))
+                {
+                    involved << events.top().s << events.top().t;
+                    events.pop();
+                }
+                // Rounding can leave a crossing behind an end.
+                if (active.at(e.s) && active.at(e.t))
+                    reverse(involved, e.s, e.t);
+            }
+        }
+        return issues;
+    }
+
+private:
+    enum EventType { End, Cross, Start };
+
+    struct Event
+    {
+        double x;
+        double y;
+        int type;
+        int s;
+        int t;
+
+        bool operator>(const Event &other) const
+        {
+            return std::tie(x, y, type, s, t) > std::tie(other.x, other.y, other.type, other.s, other.t);
+        }
+    };
+
+    struct Order
+    {
+        const Sweep *sweep;
+        bool operator()(int a, int b) const { return sweep->below(a, b); }
+    };
+
+    typedef std::set<int, Order> Status;
+
+    static bool samePoint(const Event &a, const Event &b)
+    {
+        return qAbs(a.x - b.x) <= 1e-9 * qMax(1.0, qAbs(a.x)) && qAbs(a.y - b.y) <= 1e-9 * qMax(1.0, qAbs(a.y));
+    }
+
+    // Height at the sweep position. A vertical segment is wherever the
+    // sweep is along it, the sweep moves up a vertical line point by point.
+    double yAt(int segment) const
+    {
+        const Segment &s = segments.at(segment);
+        if (s.a.x() == s.b.x())
+            return qBound(double(s.a.y()), sweepY, double(s.b.y()));
+        return s.a.y() + (sweepX - s.a.x()) * (s.b.y() - s.a.y()) / (s.b.x() - s.a.x());
+    }
+
+    double slope(int segment) const
+    {
+        const Segment &s = segments.at(segment);
+        if (s.a.x() == s.b.x())
+            return std::numeric_limits<double>::infinity();
+        return double(s.b.y() - s.a.y()) / (s.b.x() - s.a.x());
+    }
+
+    // Segments through the same point are ordered as they leave it.
+    bool below(int slotA, int slotB) const
+    {
+        if (slotA == slotB)
+            return false;
+        const int a = slotSegment.at(slotA);
+        const int b = slotSegment.at(slotB);
+        const double ya = yAt(a);
+        const double yb = yAt(b);
+        const double eps = 1e-9 * qMax(1.0, qAbs(ya));
+        if (ya < yb - eps)
+            return true;
+        if (yb < ya - eps)
+            return false;
+        const double sa = slope(a);
+        const double sb = slope(b);
+        if (sa != sb)
+            return sa < sb;
+        return a < b;
+    }
+
+    void check(Status::iterator lower, Status::iterator upper)
+    {
+        const int s = slotSegment.at(*lower);
+        const int t = slotSegment.at(*upper);
+        const quint64 pair = (quint64(qMin(s, t)) << 32) | quint32(qMax(s, t));
+        if (tested.contains(pair))
+            return;
+        tested.insert(pair);
+
+        Issue issue;
+        bool proper = false;
+        if (!testPair(segments.at(s), segments.at(t), &issue, &proper))
+            return;
+        issues.append(issue);
+
+        // A crossing right at the sweep point still has to swap the pair,
+        // rounding must not put it behind the sweep.
+        if (!proper)
+            return;
+        const Event here { sweepX, sweepY, Cross, 0, 0 };
+        const Event at { issue.at.x(), issue.at.y(), Cross, 0, 0 };
+        if (samePoint(at, here))
+            events.push(Event { sweepX, sweepY, Cross, qMin(s, t), qMax(s, t) });
+        else if (at.x > sweepX || (at.x == sweepX && at.y > sweepY))
+            events.push(Event { at.x, at.y, Cross, qMin(s, t), qMax(s, t) });
+    }
+
+    bool through(int slot) const
+    {
+        return qAbs(yAt(slotSegment.at(slot)) - sweepY) <= 1e-9 * qMax(1.0, qAbs(sweepY));
+    }
+
+    // An end resting on another segment, maybe with more segments through
+    // the same point in between.
+    void checkThrough(Status::iterator it)
+    {
+        for (Status::iterator other = it; other != status.begin() && through(*std::prev(other)); )
+        {
+            --other;
+            check(other, it);
+        }
+        for (Status::iterator other = std::next(it); other != status.end() && through(*other); ++other)
+            check(it, other);
+    }
+
+    bool isCrossing(const QSet<int> &involved, int slot) const
+    {
+        const int segment = slotSegment.at(slot);
+        return active.at(segment) && involved.contains(segment);
+    }
+
+    void reverse(const QSet<int> &involved, int s, int t)
+    {
+        Status::iterator lo = segmentSlot.at(s);
+        Status::iterator hi = lo;
+        while (lo != status.begin() && isCrossing(involved, *std::prev(lo)))
+            --lo;
+        while (std::next(hi) != status.end() && isCrossing(involved, *std::next(hi)))
+            ++hi;
+
+        QVector<Status::iterator> run;
+        for (Status::iterator it = lo; ; ++it)
+        {
+            run.append(it);
+            if (it == hi)
+                break;
+        }
+
+        // Rounding can split the run, then only a pair next to each other
+        // swaps.
+        if (run.size() < 2)
+        {
+            run.clear();
+            const Status::iterator first = segmentSlot.at(s);
+            const Status::iterator second = segmentSlot.at(t);
+            if (std::next(first) == second)
+                run << first << second;
+            else if (std::next(second) == first)
+                run << second << first;
+            else
+                return;
+        }
+
+        // Everything through the point crosses, not just the neighbours.
+        for (int i = 0; i < run.size(); i++)
+            for (int j = i + 1; j < run.size(); j++)
+                check(run.at(i), run.at(j));
+
+        QVector<int> order;
+        for (const Status::iterator &it : run)
+            order.append(slotSegment.at(*it));
+        for (int i = 0; i < run.size(); i++)
+        {
+            const int segment = order.at(run.size() - 1 - i);
+            slotSegment[*run.at(i)] = segment;
+            segmentSlot[segment] = run.at(i);
+        }
+
+        if (run.first() != status.begin())
+            check(std::prev(run.first()), run.first());
+        if (std::next(run.last()) != status.end())
+            check(run.last(), std::next(run.last()));
+    }
+
+    const QVector<Segment> &segments;
+    double sweepX = 0;
+    double sweepY = 0;
+    Status status;
+    QVector<int> slotSegment;
+    QVector<Status::iterator> segmentSlot;
+    QVector<bool> active;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    QSet<quint64> tested;
+    QVector<Issue> issues;
+};
+
+bool issueLess(const Issue &a, const Issue &b)
+{
+    return std::tie(a.polygon, a.index, a.kind, a.otherPolygon, a.otherIndex)
+         < std::tie(b.polygon, b.index, b.kind, b.otherPolygon, b.otherIndex);
+}
+
+Segment edgeSegment(const QPolygon &polygon, int polygonIndex, int edge)
+{
+    Segment s;
+    s.a = polygon.at(edge);
+    s.b = polygon.at(edge + 1 < polygon.length() ? edge + 1 : 0);
+    s.polygon = polygonIndex;
+    s.edge = edge;
+    return s;
+}
+
+}
+
+QVector<PolygonValidator::Issue> PolygonValidator::validate(const QList<QPolygon> &polygons)
+{
+    TRACE_SCOPE("validate");
+    QVector<Issue> issues;
+    QVector<Segment> segments;
+
+    for (int p = 0; p < polygons.length(); p++)
+    {
+        const QPolygon &polygon = polygons.at(p);
+        const int n = polygon.length();
+        if (n < 3)
+            continue;
+
+        QHash<quint64, int> seen;
+        for (int v = 0; v < n; v++)
+        {
+            Segment s = edgeSegment(polygon, p, v);
+            if (s.a == s.b)
+            {
+                Issue issue;
+                issue.kind = Issue::ZeroLengthEdge;
+                issue.polygon = p;
+                issue.index = v;
+                issue.at = QPointF(s.a);
+                issues.append(issue);
+            }
+            else
+            {
+                if (s.b.x() < s.a.x() || (s.b.x() == s.a.x() && s.b.y() < s.a.y()))
+                    std::swap(s.a, s.b);
+                segments.append(s);
+            }
+
+            const quint64 key = pointKey(polygon.at(v));
+            const auto first = seen.constFind(key);
+            if (first == seen.constEnd())
+            {
+                seen.insert(key, v);
+            }
+            else if (!adjacent(first.value(), v, n))
+            {
+                Issue issue;
+                issue.kind = Issue::DuplicateVertex;
+                issue.polygon = p;
+                issue.index = v;
+                issue.otherPolygon = p;
+                issue.otherIndex = first.value();
+                issue.at = QPointF(polygon.at(v));
+                issues.append(issue);
+            }
+        }
+    }
+
+    issues += Sweep(segments).run();
+    std::sort(issues.begin(), issues.end(), issueLess);
+    return issues;
+}
+
+QString PolygonValidator::describe(const Issue &issue)
+{
+    const QString at = QStringLiteral("(%1, %2)").arg(qRound(issue.at.x())).arg(qRound(issue.at.y()));
+    switch (issue.kind)
+    {
+    case Issue::Crossing:
+        if (issue.polygon == issue.otherPolygon)
+            return QStringLiteral("room %1 crosses itself at %2, edges %3 and %4")
+                    .arg(issue.polygon).arg(at).arg(issue.index).arg(issue.otherIndex);
+        return QStringLiteral("room %1 edge %2 crosses room %3 edge %4 at %5")
+                .arg(issue.polygon).arg(issue.index).arg(issue.otherPolygon).arg(issue.otherIndex).arg(at);
+    case Issue::Overlap:
+        return QStringLiteral("room %1 runs back along itself at %2, edges %3 and %4")
+                .arg(issue.polygon).arg(at).arg(issue.index).arg(issue.otherIndex);
+    case Issue::DuplicateVertex:
+        return QStringLiteral("room %1 uses point %2 twice, points %3 and %4")
+                .arg(issue.polygon).arg(at).arg(issue.otherIndex).arg(issue.index);
+    case Issue::ZeroLengthEdge:
+        return QStringLiteral("room %1 has a zero-length edge at point %2 %3")
+                .arg(issue.polygon).arg(issue.index).arg(at);
+    }
+    return QString();
+}
+
+PolygonValidator::PolygonValidator(const PolygonDocument *document, QObject *parent)
+    : QObject(parent), document(document)
+{
+    connect(document, &PolygonDocument::polygonInserted, this,
+            [this](PolygonDocument::Layer layer, int index) {
+        if (layer == PolygonDocument::Rooms)
+            polygonInserted(index);
+    });
+    connect(document, &PolygonDocument::polygonRemoved, this,
+            [this](PolygonDocument::Layer layer) {
+        if (layer == PolygonDocument::Rooms)
+            dropStale();
+    });
+    connect(document, &PolygonDocument::polygonReplaced, this,
+            [this](PolygonDocument::Layer layer, int index) {
+        if (layer == PolygonDocument::Rooms)
+            polygonReplaced(index);
+    });
+    connect(document, &PolygonDocument::vertexInserted, this,
+            [this](PolygonDocument::Layer layer, int index, int vertex) {
+        if (layer == PolygonDocument::Rooms)
+            vertexChanged(index, vertex);
+    });
+    connect(document, &PolygonDocument::vertexMoved, this,
+            [this](PolygonDocument::Layer layer, int index, int vertex) {
+        if (layer == PolygonDocument::Rooms)
+            vertexChanged(index, vertex);
+    });
+    connect(document, &PolygonDocument::vertexRemoved, this,
+            [this](PolygonDocument::Layer layer, int index, int vertex) {
+        if (layer == PolygonDocument::Rooms)
+            vertexRemoved(index, vertex);
+    });
+    connect(document, &PolygonDocument::documentReset, this, [this]() {
+        needsFull = true;
+        entries.clear();
+        entriesAt.clear();
+        emit issuesChanged();
+    });
+}
+
+QVector<PolygonValidator::Issue> PolygonValidator::issues()
+{
+    update();
+    return resolve(0);
+}
+
+QVector<PolygonValidator::Issue> PolygonValidator::issuesOf(int polygon)
+{
+    update();
+    return resolve(document->polygonId(PolygonDocument::Rooms, polygon));
+}
+
+int PolygonValidator::issueCount()
+{
+    update();
+    return entries.size();
+}
+
+void PolygonValidator::setValidated(const QVector<Issue> &issues)
+{
+    if (!needsFull)
+        return;
+    needsFull = false;
+    for (const Issue &issue : issues)
+        add(issue);
+    emit issuesChanged();
+}
+
+QVector<PolygonValidator::Issue> PolygonValidator::resolve(PolygonDocument::Id polygon) const
+{
+    // Vertex ids to indices, once per polygon that has issues rather than a
+    // scan of the polygon per issue.
+    QHash<PolygonDocument::Id, QHash<PolygonDocument::Id, int>> vertices;
+    auto find = [this, &vertices](const PolygonDocument::VertexHandle &handle, int *index, int *vertex) -> bool {
+        PolygonDocument::Layer layer;
+        if (!document->findPolygon(handle.polygon, &layer, index))
+            return false;
+        auto it = vertices.find(handle.polygon);
+        if (it == vertices.end())
+        {
+            it = vertices.insert(handle.polygon, QHash<PolygonDocument::Id, int>());
+            const int n = document->polygon(layer, *index).length();
+            it.value().reserve(n);
+            for (int v = 0; v < n; v++)
+                it.value().insert(document->vertexHandle(layer, *index, v).vertex, v);
+        }
+        *vertex = it.value().value(handle.vertex, -1);
+        return *vertex >= 0;
+    };
+
+    QVector<Issue> result;
+    for (const Entry &entry : entries)
+    {
+        if (polygon != 0 && entry.first.polygon != polygon && entry.second.polygon != polygon)
+            continue;
+
+        Issue issue;
+        issue.kind = entry.kind;
+        issue.at = entry.at;
+        if (!find(entry.first, &issue.polygon, &issue.index))
+            continue;
+        if (!entry.second.isNull() && !find(entry.second, &issue.otherPolygon, &issue.otherIndex))
+            continue;
+        result.append(issue);
+    }
+    std::sort(result.begin(), result.end(), issueLess);
+    return result;
+}
+
+void PolygonValidator::update()
+{
+    if (!needsFull)
+        return;
+    needsFull = false;
+    for (const Issue &issue : validate(document->polygons(PolygonDocument::Rooms)))
+        add(issue);
+}
+
+quint64 PolygonValidator::key(int polygon, int vertex) const
+{
+    const PolygonDocument::VertexHandle handle = document->vertexHandle(PolygonDocument::Rooms, polygon, vertex);
+    return (quint64(handle.polygon) << 32) | handle.vertex;
+}
+
+void PolygonValidator::add(const Issue &issue)
+{
+    Entry entry;
+    entry.kind = issue.kind;
+    entry.first = document->vertexHandle(PolygonDocument::Rooms, issue.polygon, issue.index);
+    if (issue.otherPolygon >= 0)
+        entry.second = document->vertexHandle(PolygonDocument::Rooms, issue.otherPolygon, issue.otherIndex);
+    entry.at = issue.at;
+
+    const quint64 a = (quint64(entry.first.polygon) << 32) | entry.first.vertex;
+    const quint64 b = entry.second.isNull() ? a : (quint64(entry.second.polygon) << 32) | entry.second.vertex;
+    const EntryKey entryKey(qMakePair(qMin(a, b), qMax(a, b)), int(issue.kind));
+    if (!entries.contains(entryKey))
+    {
+        entriesAt.insert(a, entryKey);
+        if (b != a)
+            entriesAt.insert(b, entryKey);
+    }
+    entries.insert(entryKey, entry);
+}
+
+QHash<PolygonValidator::EntryKey, PolygonValidator::Entry>::iterator PolygonValidator::erase(QHash<EntryKey, Entry>::iterator it)
+{
+    const EntryKey entryKey = it.key();
+    entriesAt.remove(entryKey.first.first, entryKey);
+    entriesAt.remove(entryKey.first.second, entryKey);
+    return entries.erase(it);
+}
+
+void PolygonValidator::dropEdge(quint64 edge)
+{
+    for (const EntryKey &entryKey : entriesAt.values(edge))
+    {
+        const auto it = entries.find(entryKey);
+        if (it != entries.end() && it.value().kind != Issue::DuplicateVertex)
+            erase(it);
+    }
+}
+
+void PolygonValidator::dropVertex(quint64 vertex)
+{
+    for (const EntryKey &entryKey : entriesAt.values(vertex))
+    {
+        const auto it = entries.find(entryKey);
+        if (it != entries.end() && it.value().kind == Issue::DuplicateVertex)
+            erase(it);
+    }
+}
+
+void PolygonValidator::checkEdge(int polygon, int edge)
+{
+    const QList<QPolygon> &all = document->polygons(PolygonDocument::Rooms);
+    const Segment s = edgeSegment(all.at(polygon), polygon, edge);
+
+    Issue issue;
+    if (s.a == s.b)
+    {
+        issue.kind = Issue::ZeroLengthEdge;
+        issue.polygon = polygon;
+        issue.index = edge;
+        issue.at = QPointF(s.a);
+        add(issue);
+        return;
+    }
+
+    bool proper = false;
+    for (const QPair<int, int> &hit : document->segmentIndex().edgesIn(QRect(s.a, s.b).normalized()))
+    {
+        if ((hit.first == polygon && hit.second == edge) || all.at(hit.first).length() < 3)
+            continue;
+        const Segment t = edgeSegment(all.at(hit.first), hit.first, hit.second);
+        if (t.a != t.b && testPair(s, t, &issue, &proper))
+            add(issue);
+    }
+}
+
+void PolygonValidator::checkVertex(int polygon, int vertex)
+{
+    const QPolygon &points = document->polygon(PolygonDocument::Rooms, polygon);
+    const QPoint pos = points.at(vertex);
+    for (const QPair<int, int> &hit : document->pointIndex(PolygonDocument::Rooms).pointsIn(QRect(pos, QSize(1, 1))))
+    {
+        if (hit.first != polygon || hit.second == vertex || adjacent(hit.second, vertex, points.length()))
+            continue;
+
+        Issue issue;
+        issue.kind = Issue::DuplicateVertex;
+        issue.polygon = polygon;
+        issue.index = vertex;
+        issue.otherPolygon = polygon;
+        issue.otherIndex = hit.second;
+        issue.at = QPointF(pos);
+        add(issue);
+    }
+}
+
+void PolygonValidator::vertexChanged(int polygon, int vertex)
+{
+    if (needsFull)
+        return;
+
+    const int n = document->polygon(PolygonDocument::Rooms, polygon).length();
+    if (n < 3)
+        return;
+    if (n == 3)
+    {
+        // Just became a room, or a triangle, all of it is cheap to check.
+        polygonInserted(polygon);
+        return;
+    }
+
+    // The edges ending and starting at the vertex.
+    const int before = (vertex + n - 1) % n;
+    dropEdge(key(polygon, before));
+    dropEdge(key(polygon, vertex));
+    dropVertex(key(polygon, vertex));
+    checkEdge(polygon, before);
+    checkEdge(polygon, vertex);
+    checkVertex(polygon, vertex);
+    emit issuesChanged();
+}
+
+void PolygonValidator::vertexRemoved(int polygon, int vertex)
+{
+    if (needsFull)
+        return;
+
+    // Issues of the removed vertex and its edge no longer resolve.
+    dropStale();
+
+    const int n = document->polygon(PolygonDocument::Rooms, polygon).length();
+    if (n < 3)
+    {
+        dropPolygon(polygon);
+        emit issuesChanged();
+        return;
+    }
+
+    const int before = (vertex + n - 1) % n;
+    dropEdge(key(polygon, before));
+    checkEdge(polygon, before);
+    emit issuesChanged();
+}
+
+void PolygonValidator::polygonReplaced(int polygon)
+{
+    if (needsFull)
+        return;
+
+    // None of the old vertices is left, nor are their issues.
+    dropPolygon(polygon);
+    if (document->polygon(PolygonDocument::Rooms, polygon).length() < 3)
+        emit issuesChanged();
+    else
+        polygonInserted(polygon);
+}
+
+void PolygonValidator::polygonInserted(int polygon)
+{
+    if (needsFull)
+        return;
+
+    const int n = document->polygon(PolygonDocument::Rooms, polygon).length();
+    if (n < 3)
+        return;
+    for (int v = 0; v < n; v++)
+    {
+        dropEdge(key(polygon, v));
+        dropVertex(key(polygon, v));
+    }
+    for (int v = 0; v < n; v++)
+    {
+        checkEdge(polygon, v);
+        checkVertex(polygon, v);
+    }
+    emit issuesChanged();
+}
+
+void PolygonValidator::dropPolygon(int polygon)
+{
+    const PolygonDocument::Id id = document->polygonId(PolygonDocument::Rooms, polygon);
+    for (auto it = entries.begin(); it != entries.end(); )
+    {
+        if (it.value().first.polygon == id || it.value().second.polygon == id)
+            it = erase(it);
+        else
+            ++it;
+    }
+}
+
+void PolygonValidator::dropStale()
+{
+    for (auto it = entries.begin(); it != entries.end(); )
+    {
+        PolygonDocument::Layer layer;
+        int index;
+        int vertex;
+        const bool stale = !document->findVertex(it.value().first, &layer, &index, &vertex)
+                || (!it.value().second.isNull() && !document->findVertex(it.value().second, &layer, &index, &vertex));
+        if (stale)
+            it = erase(it);
+        else
+            ++it;
+    }
+    emit issuesChanged();
+}
@@ -0,0 +1,99 @@
+#ifndef POLYGONVALIDATOR_H
+#define POLYGONVALIDATOR_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QPointF>
+#include <QPolygon>
+#include <QString>
+#include <QVector>
+#include "polygonDocument.h"
+
+// Finds room geometry that downstream tools reject: edges crossing each
+// other (within a room or between rooms), a room touching or running back
+// along itself, the same point used twice in a room and zero-length edges.
+// Rooms sharing a wall or a corner are fine. Rooms with fewer than three
+// points are still being drawn and are skipped.
+//
+// validate() checks a whole plan with a Bentley-Ottmann sweep. An object
+// watching a document keeps the result current: edits only recheck the
+// edges they touched against their neighbours from the segment index.
+class PolygonValidator : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Issue
+    {
+        enum Kind { Crossing, Overlap, DuplicateVertex, ZeroLengthEdge };
+
+        Kind kind = Crossing;
+        int polygon = -1;
+        int index = -1;             // edge, or vertex for DuplicateVertex
+        int otherPolygon = -1;
+        int otherIndex = -1;
+        QPointF at;
+    };
+
+    // O((n + k) log n) for n edges and k crossings.
+    static QVector<Issue> validate(const QList<QPolygon> &polygons);
+    static QString describe(const Issue &issue);
+
+    explicit PolygonValidator(const PolygonDocument *document, QObject *parent = nullptr);
+
+    // A full sweep runs first when the document was replaced.
+    QVector<Issue> issues();
+    QVector<Issue> issuesOf(int polygon);
+    int issueCount();
+    bool needsFullCheck() const { return needsFull; }
+    // validate() of the document as it is now, run elsewhere, in place of
+    // the full sweep.
+    void setValidated(const QVector<Issue> &issues);
+
+signals:
+    void issuesChanged();
+
+private:
+    typedef QPair<quint64, quint64> Pair;
+    // The vertex keys of an issue, lower first, and its kind.
+    typedef QPair<Pair, int> EntryKey;
+
+    // An issue in terms of vertex handles, so it survives index shifts.
+    // Edges are named by their first vertex.
+    struct Entry
+    {
+        Issue::Kind kind;
+        PolygonDocument::VertexHandle first;
+        PolygonDocument::VertexHandle second;
+        QPointF at;
+    };
+
+    void vertexChanged(int polygon, int vertex);
+    void vertexRemoved(int polygon, int vertex);
+    void polygonInserted(int polygon);
+    void polygonReplaced(int polygon);
+    void dropPolygon(int polygon);
+    void dropStale();
+    void update();
+    // Issues of one polygon id, or all for 0.
+    QVector<Issue> resolve(PolygonDocument::Id polygon) const;
+
+    quint64 key(int polygon, int vertex) const;
+    void add(const Issue &issue);
+    QHash<EntryKey, Entry>::iterator erase(QHash<EntryKey, Entry>::iterator it);
+    void dropEdge(quint64 edge);
+    void dropVertex(quint64 vertex);
+    void checkEdge(int polygon, int edge);
+    void checkVertex(int polygon, int vertex);
+
+    const PolygonDocument *document;
+    bool needsFull = true;
+    QHash<EntryKey, Entry> entries;
+    // Vertex key to the entries naming it, so an edit only looks at the
+    // issues of the vertices and edges it touched.
+    QMultiHash<quint64, EntryKey> entriesAt;
+};
+
+#endif // POLYGONVALIDATOR_H
@@ -0,0 +1,457 @@
+#include "projectIO.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+const char binaryMagic[4] = {'O', 'F', 'L', 'B'};
+const quint16 binaryVersion = 1;
+const int headerBytes = 32;
+const int recordBytes = 24;
+
+enum PolygonKind : quint8 { RoomKind = 0, DoorKind = 1 };
+
+quint64 align8(quint64 v)
+{
+    return (v + 7) & ~quint64(7);
+}
+
+// Files at least this large parse their blocks on all cores.
+const qint64 parallelParseBytes = 4 * 1024 * 1024;
+
+struct DatBlock
+{
+    bool door = false;
+    QString color;
+    int sizeHint = 0;
+    int firstLine = 0;
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    QPolygon points;
+    int errorLine = 0;
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool isBlankLine(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p))
+        p++;
+    return p == end;
+}
+
+// Reads one coordinate and truncates it to int like QPoint(float, float)
+// did with QString::toFloat. Plain integers never leave the fast path.
+bool parseCoordinate(const char *&p, const char *end, int *value)
+{
+    while (p < end && isSpace(*p))
+        p++;
+
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    const char *digits = p;
+    qint64 v = 0;
+    while (p < end && *p >= '0' && *p <= '9' && v <= INT_MAX)
+        v = v * 10 + (*p++ - '0');
+
+    if (p > digits && v <= INT_MAX && (p == end || isSpace(*p)))
+    {
+        *value = int(negative ? -v : v);
+        return true;
+    }
+
+    while (p < end && !isSpace(*p))
+        p++;
+
+    bool ok = false;
+    const float f = QByteArray::fromRawData(start, int(p - start)).toFloat(&ok);
+    if (!ok)
+        return false;
+    *value = int(qBound<float>(INT_MIN, f, INT_MAX));
+    return true;
+}
+
+bool parseDatHeader(const char *line, const char *end, DatBlock *block)
+{
+    // "P, <color>, <count>", the count is only a size hint.
+    const char *p = line;
+    while (p + 1 < end && !(p[0] == ',' && p[1] == ' '))
+        p++;
+    if (p + 1 >= end)
+        return false;
+
+    const char *color = p + 2;
+    const char *colorEnd = color;
+    while (colorEnd < end && *colorEnd != ',' && *colorEnd != '\r')
+        colorEnd++;
+    block->color = QString::fromUtf8(color, int(colorEnd - color));
+
+    if (colorEnd < end && *colorEnd == ',')
+    {
+        const char *count = colorEnd + 1;
+        int n = 0;
+        if (parseCoordinate(count, end, &n))
+            block->sizeHint = qMax(0, n);
+    }
+    return true;
+}
+
+void parseDatBlock(DatBlock &block)
+{
+    block.points.reserve(block.sizeHint);
+    int lineNumber = block.firstLine;
+    for (const char *line = block.begin; line < block.end; lineNumber++)
+    {
+        const char *next = static_cast<const char *>(std::memchr(line, '\n', size_t(block.end - line)));
+        const char *lineEnd = next ? next : block.end;
+
+        if (!isBlankLine(line, lineEnd))
+        {
+            const char *p = line;
+            int x = 0;
+            int y = 0;
+            if (!parseCoordinate(p, lineEnd, &x) || !parseCoordinate(p, lineEnd, &y))
+            {
+                block.errorLine = lineNumber;
+                return;
+            }
+            // Only spaces and the \r of a CRLF file may follow y.
+            while (p < lineEnd && isSpace(*p))
+                p++;
+            if (p != lineEnd)
+            {
+                block.errorLine = lineNumber;
+                return;
+            }
+            block.points.append(QPoint(x, y));
+        }
+        line = next ? next + 1 : block.end;
+    }
+}
+
+// True if a QPoint array has the same layout as the little endian
+// x, y int32 pairs of the binary format, so points can be block copied.
+bool pointsArePacked()
+{
+    static const bool packed = []() -> bool {
+        if (Q_BYTE_ORDER != Q_LITTLE_ENDIAN || sizeof(QPoint) != 2 * sizeof(qint32))
+            return false;
+        const QPoint p(1, 2);
+        const qint32 expected[2] = {1, 2};
+        return std::memcmp(&p, expected, sizeof(expected)) == 0;
+    }();
+    return packed;
+}
+
+}
+
+bool ProjectIO::isBinaryFile(const QString &fileName)
+{
+    return QFileInfo(fileName).suffix().compare("ofb", Qt::CaseInsensitive) == 0;
+}
+
+bool ProjectIO::read(const QString &fileName, ProjectData *data, QString *error)
+{
+    return isBinaryFile(fileName) ? readBinary(fileName, data, error)
+                                  : readDat(fileName, data, error);
+}
+
+bool ProjectIO::write(const QString &fileName, const ProjectData &data, QString *error)
+{
+    return isBinaryFile(fileName) ? writeBinary(fileName, data, error)
+                                  : writeDat(fileName, data, error);
+}
+
+bool ProjectIO::readDat(const QString &fileName, ProjectData *data, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        *error = file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    QByteArray buffer;
+    const char *base = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : nullptr;
+    if (!base)
+    {
+        buffer = file.readAll();
+        base = buffer.constData();
+    }
+    const char *const end = base + (buffer.isNull() ? size : buffer.size());
+
+    // First pass: find the block headers, every block then parses alone.
+    QVector<DatBlock> blocks;
+    int lineNumber = 0;
+    for (const char *line = base; line < end;)
+    {
+        const char *next = static_cast<const char *>(std::memchr(line, '\n', size_t(end - line)));
+        const char *lineEnd = next ? next : end;
+        next = next ? next + 1 : end;
+        lineNumber++;
+
+        if (*line == 'P' || *line == 'D')
+        {
+            if (!blocks.isEmpty())
+                blocks.last().end = line;
+
+            DatBlock block;
+            block.door = *line == 'D';
+            block.firstLine = lineNumber + 1;
+            block.begin = next;
+            block.end = end;
+            if (!block.door && !parseDatHeader(line, lineEnd, &block))
+            {
+                *error = QStringLiteral("%1:%2: expected \"P, <color>, <count>\"")
+                         .arg(QFileInfo(fileName).fileName()).arg(lineNumber);
+                return false;
+            }
+            blocks.append(block);
+        }
+        else if (blocks.isEmpty() && !isBlankLine(line, lineEnd))
+        {
+            *error = QStringLiteral("%1:%2: point outside of a polygon or door block")
+                     .arg(QFileInfo(fileName).fileName()).arg(lineNumber);
+            return false;
+        }
+        line = next;
+    }
+
+    if (size >= parallelParseBytes && blocks.length() > 1)
+        QtConcurrent::blockingMap(blocks, parseDatBlock);
+    else
+        std::for_each(blocks.begin(), blocks.end(), parseDatBlock);
+
+    *data = ProjectData();
+    for (const DatBlock &block : blocks)
+    {
+        if (block.errorLine > 0)
+        {
+            *error = QStringLiteral("%1:%2: expected \"<x> <y>\"")
+                     .arg(QFileInfo(fileName).fileName()).arg(block.errorLine);
+            return false;
+        }
+        if (block.door)
+        {
+            data->doors.append(block.points);
+        }
+        else
+        {
+            data->polygons.append(block.points);
+            data->colors.append(block.color);
+        }
+    }
+
+    return true;
+}
+
+bool ProjectIO::writeDat(const QString &fileName, const ProjectData &data, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        *error = file.errorString();
+        return false;
+    }
+
+    QTextStream out(&file);
+    for (int x = 0; x < data.polygons.length(); x++)
+    {
+        const QPolygon &poly = data.polygons.at(x);
+        out << QStringLiteral("P, %1, %2\n").arg(data.colors.at(x)).arg(poly.length());
+        for (const QPoint &point : poly)
+            out << QStringLiteral("%1 %2\n").arg(QString::number(point.x())).arg(QString::number(point.y()));
+    }
+    for (const QPolygon &door : data.doors)
+    {
+        out << QStringLiteral("D\n");
+        for (const QPoint &point : door)
+            out << QStringLiteral("%1 %2\n").arg(QString::number(point.x())).arg(QString::number(point.y()));
+    }
+
+    // A full disk only shows once the buffered text reaches the file.
+    out.flush();
+    file.flush();
+    if (out.status() != QTextStream::Ok || file.error() != QFileDevice::NoError)
+    {
+        *error = QStringLiteral("Cannot write %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool ProjectIO::readBinary(const QString &fileName, ProjectData *data, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        *error = file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    QByteArray buffer;
+    const uchar *base = size > 0 ? file.map(0, size) : nullptr;
+    if (!base)
+    {
+        buffer = file.readAll();
+        base = reinterpret_cast<const uchar *>(buffer.constData());
+    }
+
+    auto fail = [&](const QString &message) -> bool {
+        *error = QStringLiteral("%1: %2").arg(QFileInfo(fileName).fileName(), message);
+        return false;
+    };
+
+    if (size < headerBytes || std::memcmp(base, binaryMagic, 4) != 0)
+        return fail(QStringLiteral("not an OutlineFlow binary project"));
+    if (qFromLittleEndian<quint16>(base + 4) != binaryVersion)
+        return fail(QStringLiteral("unsupported version %1").arg(qFromLittleEndian<quint16>(base + 4)));
+
+    const quint64 headerSize = qFromLittleEndian<quint16>(base + 6);
+    const quint64 count = qFromLittleEndian<quint32>(base + 8);
+    const quint64 stringBytes = qFromLittleEndian<quint32>(base + 12);
+    const quint64 pointCount = qFromLittleEndian<quint64>(base + 16);
+
+    const quint64 stringsOffset = headerSize + count * recordBytes;
+    const quint64 pointsOffset = stringsOffset + align8(stringBytes);
+    if (headerSize < quint64(headerBytes) || pointCount > quint64(size) / 8
+            || pointsOffset + pointCount * 8 > quint64(size))
+        return fail(QStringLiteral("file is truncated"));
+
+    const char *strings = reinterpret_cast<const char *>(base + stringsOffset);
+    const uchar *points = base + pointsOffset;
+
+    *data = ProjectData();
+    for (quint64 i = 0; i < count; i++)
+    {
+        const uchar *record = base + headerSize + i * recordBytes;
+        const quint8 kind = record[0];
+        const quint32 colorOffset = qFromLittleEndian<quint32>(record + 4);
+        const quint32 colorLength = qFromLittleEndian<quint32>(record + 8);
+        const quint32 n = qFromLittleEndian<quint32>(record + 12);
+        const quint64 first = qFromLittleEndian<quint64>(record + 16);
+
+        if (quint64(colorOffset) + colorLength > stringBytes || first > pointCount || n > pointCount - first)
+            return fail(QStringLiteral("polygon %1 is out of bounds").arg(i));
+
+        QPolygon poly(int(n));
+        const uchar *src = points + first * 8;
+        if (n > 0 && pointsArePacked())
+        {
+            std::memcpy(poly.data(), src, size_t(n) * 8);
+        }
+        else
+        {
+            for (quint32 p = 0; p < n; p++)
+                poly[p] = QPoint(qFromLittleEndian<qint32>(src + p * 8),
+                                 qFromLittleEndian<qint32>(src + p * 8 + 4));
+        }
+
+        if (kind == RoomKind)
+        {
+            data->polygons.append(poly);
+            data->colors.append(QString::fromUtf8(strings + colorOffset, int(colorLength)));
+        }
+        else if (kind == DoorKind)
+        {
+            data->doors.append(poly);
+        }
+        else
+        {
+            return fail(QStringLiteral("polygon %1 has unknown kind %2").arg(i).arg(kind));
+        }
+    }
+
+    return true;
+}
+
+bool ProjectIO::writeBinary(const QString &fileName, const ProjectData &data, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        *error = file.errorString();
+        return false;
+    }
+
+    const int count = data.polygons.length() + data.doors.length();
+    QByteArray strings;
+    QByteArray table(count * recordBytes, '\0');
+    quint64 pointCount = 0;
+
+    auto addRecord = [&](int i, PolygonKind kind, const QByteArray &color, const QPolygon &poly) {
+        uchar *record = reinterpret_cast<uchar *>(table.data()) + i * recordBytes;
+        record[0] = kind;
+        qToLittleEndian<quint32>(quint32(strings.size()), record + 4);
+        qToLittleEndian<quint32>(quint32(color.size()), record + 8);
+        qToLittleEndian<quint32>(quint32(poly.length()), record + 12);
+        qToLittleEndian<quint64>(pointCount, record + 16);
+        strings += color;
+        pointCount += poly.length();
+    };
+
+    for (int i = 0; i < data.polygons.length(); i++)
+        addRecord(i, RoomKind, data.colors.at(i).toUtf8(), data.polygons.at(i));
+    for (int i = 0; i < data.doors.length(); i++)
+        addRecord(data.polygons.length() + i, DoorKind, QByteArray(), data.doors.at(i));
+
+    const int stringBytes = strings.size();
+    strings.append(QByteArray(int(align8(stringBytes) - stringBytes), '\0'));
+
+    uchar header[headerBytes] = {};
+    std::memcpy(header, binaryMagic, 4);
+    qToLittleEndian<quint16>(binaryVersion, header + 4);
+    qToLittleEndian<quint16>(headerBytes, header + 6);
+    qToLittleEndian<quint32>(quint32(count), header + 8);
+    qToLittleEndian<quint32>(quint32(stringBytes), header + 12);
+    qToLittleEndian<quint64>(pointCount, header + 16);
+
+    bool ok = file.write(reinterpret_cast<const char *>(header), headerBytes) == headerBytes
+            && file.write(table) == table.size()
+            && file.write(strings) == strings.size();
+
+    auto writePoints = [&](const QPolygon &poly) {
+        if (!ok || poly.isEmpty())
+            return;
+        if (pointsArePacked())
+        {
+            const qint64 bytes = qint64(poly.length()) * 8;
+            ok = file.write(reinterpret_cast<const char *>(poly.constData()), bytes) == bytes;
+            return;
+        }
+        QByteArray packed(poly.length() * 8, '\0');
+        uchar *dst = reinterpret_cast<uchar *>(packed.data());
+        for (int p = 0; p < poly.length(); p++)
+        {
+            qToLittleEndian<qint32>(poly.at(p).x(), dst + p * 8);
+            qToLittleEndian<qint32>(poly.at(p).y(), dst + p * 8 + 4);
+        }
+        ok = file.write(packed) == packed.size();
+    };
+
+    for (const QPolygon &poly : data.polygons)
+        writePoints(poly);
+    for (const QPolygon &door : data.doors)
+        writePoints(door);
+
+    if (!ok)
+    {
+        *error = file.errorString();
+        return false;
+    }
+    return true;
+}
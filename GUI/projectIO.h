@@ -0,0 +1,46 @@
+#ifndef PROJECTIO_H
+#define PROJECTIO_H
+
+#include <QList>
+#include <QPolygon>
+#include <QString>
+
+// The geometry that makes up a saved project.
+struct ProjectData
+{
+    QList<QPolygon> polygons;
+    QList<QString> colors;
+    QList<QPolygon> doors;
+};
+
+// Reading and writing of project files. Two formats are supported:
+//
+// .dat  line based text, "P, <color>, <count>" starts a polygon, "D" starts
+//       a door, every other line holds "<x> <y>".
+// .ofb  versioned binary, little endian:
+//       header    "OFLB", u16 version, u16 header size, u32 polygon count,
+//                 u32 string bytes, u64 point count, u64 reserved
+//       table     per polygon u8 kind (0 polygon, 1 door), 3 bytes padding,
+//                 u32 color offset, u32 color length, u32 point count,
+//                 u64 index of the first point
+//       strings   UTF-8 colors, padded to 8 bytes
+//       points    i32 x, i32 y per point
+//
+// Both formats carry the same information, converting between them is
+// lossless.
+class ProjectIO
+{
+public:
+    static bool isBinaryFile(const QString &fileName);
+
+    static bool read(const QString &fileName, ProjectData *data, QString *error);
+    static bool write(const QString &fileName, const ProjectData &data, QString *error);
+
+    static bool readDat(const QString &fileName, ProjectData *data, QString *error);
+    static bool writeDat(const QString &fileName, const ProjectData &data, QString *error);
+
+    static bool readBinary(const QString &fileName, ProjectData *data, QString *error);
+    static bool writeBinary(const QString &fileName, const ProjectData &data, QString *error);
+};
+
+#endif // PROJECTIO_H
@@ -0,0 +1,36 @@
+#include "redrawScheduler.h"
+#include <QGuiApplication>
+#include <QScreen>
+
+RedrawScheduler::RedrawScheduler(QObject *parent)
+    : QObject(parent)
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &RedrawScheduler::emitFrame);
+
+    if (QScreen *screen = QGuiApplication::primaryScreen())
+        setRefreshRate(screen->refreshRate());
+    clock.start();
+    lastFrame = -interval;
+}
+
+void RedrawScheduler::setRefreshRate(qreal hz)
+{
+    interval = hz > 0 ? qMax(1, qRound(1000 / hz)) : 16;
+}
+
+void RedrawScheduler::requestFrame()
+{
+    if (timer.isActive())
+        return;
+
+    const qint64 sinceLast = clock.elapsed() - lastFrame;
+    timer.start(int(qMax<qint64>(0, interval - sinceLast)));
+}
+
+void RedrawScheduler::emitFrame()
+{
+    lastFrame = clock.elapsed();
+    emit frame();
+}
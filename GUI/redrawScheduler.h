@@ -0,0 +1,33 @@
+#ifndef REDRAWSCHEDULER_H
+#define REDRAWSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+// Collapses any number of redraw requests into at most one frame() per
+// display refresh interval.
+class RedrawScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RedrawScheduler(QObject *parent = nullptr);
+
+    void requestFrame();
+    void setRefreshRate(qreal hz);
+
+signals:
+    void frame();
+
+private slots:
+    void emitFrame();
+
+private:
+    QTimer timer;
+    QElapsedTimer clock;
+    qint64 lastFrame = 0;
+    int interval = 16;
+};
+
+#endif // REDRAWSCHEDULER_H
@@ -0,0 +1,502 @@
+#include "roomAnalytics.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QtConcurrent>
+#include <QtMath>
+#include <algorithm>
+#include <functional>
+#include "geometryKernels.h"
+#include "trace.h"
+
+namespace {
+
+// Edges closer to parallel than about 15 degrees count as one wall.
+const double parallelSine = 0.26;
+
+double cross(const QPoint &o, const QPoint &a, const QPoint &b)
+{
+    return double(a.x() - o.x()) * (b.y() - o.y()) - double(a.y() - o.y()) * (b.x() - o.x());
+}
+
+bool segmentsCross(const QPoint &a, const QPoint &b, const QPoint &c, const QPoint &d)
+{
+    const double d1 = cross(c, d, a);
+    const double d2 = cross(c, d, b);
+    const double d3 = cross(a, b, c);
+    const double d4 = cross(a, b, d);
+    return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+}
+
+double segmentDistance(const QPoint &a, const QPoint &b, const QPoint &c, const QPoint &d)
+{
+    if (segmentsCross(a, b, c, d))
+        return 0;
+    return qMin(qMin(distToSegment(a, c, d), distToSegment(b, c, d)),
+                qMin(distToSegment(c, a, b), distToSegment(d, a, b)));
+}
+
+// How much of a-b the edge c-d runs alongside, within reach and close to
+// parallel.
+double alongside(const QPoint &a, const QPoint &b, const QPoint &c, const QPoint &d, int reach)
+{
+    const double ex = b.x() - a.x();
+    const double ey = b.y() - a.y();
+    const double length = qSqrt(ex * ex + ey * ey);
+    const double fx = d.x() - c.x();
+    const double fy = d.y() - c.y();
+    const double otherLength = qSqrt(fx * fx + fy * fy);
+    if (length == 0 || otherLength == 0)
+        return 0;
+    const double ux = ex / length;
+    const double uy = ey / length;
+    if (qAbs(ux * fy - uy * fx) / otherLength > parallelSine)
+        return 0;
+
+    // The part of a-b that c-d overlaps when projected onto it.
+    const double tc = (c.x() - a.x()) * ux + (c.y() - a.y()) * uy;
+    const double td = (d.x() - a.x()) * ux + (d.y() - a.y()) * uy;
+    const double from = qMax(0.0, qMin(tc, td));
+    const double to = qMin(length, qMax(tc, td));
+    if (to <= from)
+        return 0;
+
+    const double t = (from + to) / 2;
+    const QPoint middle(qRound(a.x() + ux * t), qRound(a.y() + uy * t));
+    return distToSegment(middle, c, d) <= reach ? to - from : 0;
+}
+
+QJsonArray pointsToJson(const QPolygon &polygon)
+{
+    QJsonArray points;
+    for (const QPoint &p : polygon)
+        points.append(QJsonArray { p.x(), p.y() });
+    return points;
+}
+
+QJsonArray indicesToJson(const QVector<int> &indices)
+{
+    QJsonArray array;
+    for (int i : indices)
+        array.append(i);
+    return array;
+}
+
+}
+
+RoomAnalytics::RoomAnalytics(const PolygonDocument *document, QObject *parent)
+    : QObject(parent), document(document)
+{
+    // Inserting or removing polygons shifts indices, that starts over.
+    connect(document, &PolygonDocument::polygonInserted, this, [this]() { invalidateAll(); });
+    connect(document, &PolygonDocument::polygonRemoved, this, [this]() { invalidateAll(); });
+    connect(document, &PolygonDocument::documentReset, this, [this]() { invalidateAll(); });
+
+    connect(document, &PolygonDocument::polygonReplaced, this,
+            [this](PolygonDocument::Layer layer, int index) {
+        if (layer == PolygonDocument::Rooms)
+            roomChanged(index);
+        else
+            doorChanged(index);
+    });
+    connect(document, &PolygonDocument::vertexInserted, this,
+            [this](PolygonDocument::Layer layer, int index) {
+        if (layer == PolygonDocument::Rooms)
+            roomChanged(index);
+        else
+            doorChanged(index);
+    });
+    connect(document, &PolygonDocument::vertexMoved, this,
+            [this](PolygonDocument::Layer layer, int index) {
+        if (layer == PolygonDocument::Rooms)
+            roomChanged(index);
+        else
+            doorChanged(index);
+    });
+    connect(document, &PolygonDocument::vertexRemoved, this,
+            [this](PolygonDocument::Layer layer, int index) {
+        if (layer == PolygonDocument::Rooms)
+            roomChanged(index);
+        else
+            doorChanged(index);
+    });
+}
+
+void RoomAnalytics::setReach(int pixels)
+{
+    pixels = qMax(1, pixels);
+    if (pixels == reachPixels)
+        return;
+    reachPixels = pixels;
+    invalidateAll();
+}
+
+void RoomAnalytics::roomChanged(int index)
+{
+    if (!allDirty)
+        dirtyRooms.insert(index);
+}
+
+void RoomAnalytics::doorChanged(int index)
+{
+    if (!allDirty)
+        dirtyDoors.insert(index);
+}
+
+void RoomAnalytics::invalidateAll()
+{
+    allDirty = true;
+    dirtyRooms.clear();
+    dirtyDoors.clear();
+}
+
+void RoomAnalytics::update()
+{
+    if (allDirty)
+    {
+        rebuild();
+        allDirty = false;
+        return;
+    }
+    if (dirtyRooms.isEmpty() && dirtyDoors.isEmpty())
+        return;
+
+    TRACE_SCOPE("roomAnalytics");
+    // Rooms first, they mark the doors around them.
+    for (int index : dirtyRooms)
+        updateRoom(index);
+    dirtyRooms.clear();
+    for (int index : dirtyDoors)
+        updateDoor(index);
+    dirtyDoors.clear();
+}
+
+RoomAnalytics::Tables RoomAnalytics::tables()
+{
+    update();
+
+    Tables t;
+    t.reach = reachPixels;
+    t.longestDoor = longestDoor;
+    t.rooms = rooms;
+    t.doors = doors;
+    t.walls = walls;
+    return t;
+}
+
+void RoomAnalytics::setTables(const Tables &tables)
+{
+    if (tables.reach != reachPixels)
+        return;
+
+    longestDoor = tables.longestDoor;
+    rooms = tables.rooms;
+    doors = tables.doors;
+    walls = tables.walls;
+    allDirty = false;
+    dirtyRooms.clear();
+    dirtyDoors.clear();
+}
+
+const RoomAnalytics::Room &RoomAnalytics::room(int index)
+{
+    update();
+    return rooms.at(index);
+}
+
+const RoomAnalytics::Door &RoomAnalytics::door(int index)
+{
+    update();
+    return doors.at(index);
+}
+
+QList<RoomAnalytics::Link> RoomAnalytics::links()
+{
+    update();
+
+    QMap<QPair<int, int>, Link> all;
+    for (int a = 0; a < walls.size(); a++)
+    {
+        for (auto it = walls.at(a).constBegin(); it != walls.at(a).constEnd(); ++it)
+        {
+            if (it.key() < a || it.value() < 2 * reachPixels)
+                continue;
+            Link &link = all[qMakePair(a, it.key())];
+            link.a = a;
+            link.b = it.key();
+            link.sharedWall = it.value();
+        }
+    }
+    for (const Door &d : doors)
+    {
+        for (int i = 0; i < d.rooms.size(); i++)
+        {
+            for (int j = i + 1; j < d.rooms.size(); j++)
+            {
+                Link &link = all[qMakePair(d.rooms.at(i), d.rooms.at(j))];
+                link.a = d.rooms.at(i);
+                link.b = d.rooms.at(j);
+                link.doors++;
+            }
+        }
+    }
+    return all.values();
+}
+
+QList<int> RoomAnalytics::neighbours(int index)
+{
+    update();
+
+    QSet<int> found;
+    const QMap<int, double> &shared = walls.at(index);
+    for (auto it = shared.constBegin(); it != shared.constEnd(); ++it)
+        if (it.value() >= 2 * reachPixels)
+            found.insert(it.key());
+    for (int d : rooms.at(index).doors)
+        for (int other : doors.at(d).rooms)
+            if (other != index)
+                found.insert(other);
+
+    QList<int> result = found.values();
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void RoomAnalytics::rebuild()
+{
+    TRACE_SCOPE("roomAnalyticsRebuild");
+    const int roomCount = document->count(PolygonDocument::Rooms);
+    rooms = QVector<Room>(roomCount);
+    walls = QVector<QMap<int, double>>(roomCount);
+
+    // Every room only reads the document and writes its own slot.
+    QVector<int> indices(roomCount);
+    for (int i = 0; i < roomCount; i++)
+        indices[i] = i;
+    Room *roomData = rooms.data();
+    QMap<int, double> *wallData = walls.data();
+    const std::function<void(int &)> work = [this, roomData, wallData](int &i) {
+        measure(document->polygon(PolygonDocument::Rooms, i), &roomData[i]);
+        wallData[i] = sharedWalls(i);
+    };
+    QtConcurrent::blockingMap(indices, work);
+
+    const int doorCount = document->count(PolygonDocument::Doors);
+    doors = QVector<Door>(doorCount);
+    longestDoor = 0;
+    for (int d = 0; d < doorCount; d++)
+    {
+        const QPolygon &points = document->polygon(PolygonDocument::Doors, d);
+        const QRect bounds = points.boundingRect();
+        longestDoor = qMax(longestDoor, qMax(bounds.width(), bounds.height()));
+        doors[d].rooms = roomsAtDoor(points);
+        for (int r : doors.at(d).rooms)
+            rooms[r].doors.append(d);
+    }
+}
+
+void RoomAnalytics::updateRoom(int index)
+{
+    if (index >= rooms.size())
+        return;
+
+    const QRect before = rooms.at(index).bounds;
+    measure(document->polygon(PolygonDocument::Rooms, index), &rooms[index]);
+
+    for (auto it = walls.at(index).constBegin(); it != walls.at(index).constEnd(); ++it)
+        walls[it.key()].remove(index);
+    walls[index] = sharedWalls(index);
+    for (auto it = walls.at(index).constBegin(); it != walls.at(index).constEnd(); ++it)
+        walls[it.key()][index] = it.value();
+
+    // Doors next to where the room was or is now may connect differently.
+    markDoorsNear(before.united(rooms.at(index).bounds));
+}
+
+void RoomAnalytics::updateDoor(int index)
+{
+    if (index >= doors.size())
+        return;
+
+    for (int r : doors.at(index).rooms)
+        rooms[r].doors.removeAll(index);
+
+    const QPolygon &points = document->polygon(PolygonDocument::Doors, index);
+    const QRect bounds = points.boundingRect();
+    longestDoor = qMax(longestDoor, qMax(bounds.width(), bounds.height()));
+    doors[index].rooms = roomsAtDoor(points);
+
+    for (int r : doors.at(index).rooms)
+    {
+        QVector<int> &list = rooms[r].doors;
+        list.insert(std::lower_bound(list.begin(), list.end(), index), index);
+    }
+}
+
+void RoomAnalytics::markDoorsNear(const QRect &area)
+{
+    if (area.isNull())
+        return;
+
+    // Door points are indexed, a door reaching into the area has a point
+    // at most its own length plus the reach away.
+    const int margin = reachPixels + longestDoor;
+    const QVector<QPair<int, int>> hits = document->pointIndex(PolygonDocument::Doors)
+            .pointsIn(area.adjusted(-margin, -margin, margin, margin));
+    for (const QPair<int, int> &hit : hits)
+        dirtyDoors.insert(hit.first);
+}
+
+void RoomAnalytics::measure(const QPolygon &polygon, Room *room)
+{
+    room->bounds = polygon.boundingRect();
+    room->area = 0;
+    room->perimeter = 0;
+
+    const int n = polygon.length();
+    if (n < 3)
+        return;
+
+    double twiceArea = 0;
+    for (int i = 0; i < n; i++)
+    {
+        const QPoint &a = polygon.at(i);
+        const QPoint &b = polygon.at(i + 1 < n ? i + 1 : 0);
+        twiceArea += double(a.x()) * b.y() - double(b.x()) * a.y();
+        room->perimeter += qSqrt(double(b.x() - a.x()) * (b.x() - a.x()) + double(b.y() - a.y()) * (b.y() - a.y()));
+    }
+    room->area = qAbs(twiceArea) / 2;
+}
+
+QMap<int, double> RoomAnalytics::sharedWalls(int index) const
+{
+    // Either side measures the wall along its own edges and the longer one
+    // counts. Both are taken from the same pairs of edges here, so a room
+    // measured alone agrees with its neighbours.
+    QMap<int, double> own;
+    QMap<int, double> theirs;
+    const QList<QPolygon> &all = document->polygons(PolygonDocument::Rooms);
+    const QPolygon &polygon = all.at(index);
+    const int n = polygon.length();
+    if (n < 3)
+        return own;
+
+    const SegmentIndex &edges = document->segmentIndex();
+    const int reach = reachPixels;
+    for (int e = 0; e < n; e++)
+    {
+        const QPoint a = polygon.at(e);
+        const QPoint b = polygon.at(e + 1 < n ? e + 1 : 0);
+        if (a == b)
+            continue;
+
+        const QRect area = QRect(a, b).normalized().adjusted(-reach, -reach, reach, reach);
+        for (const QPair<int, int> &hit : edges.edgesIn(area))
+        {
+            const QPolygon &other = all.at(hit.first);
+            if (hit.first == index || other.length() < 3)
+                continue;
+
+            const QPoint c = other.at(hit.second);
+            const QPoint d = other.at(hit.second + 1 < other.length() ? hit.second + 1 : 0);
+            own[hit.first] += alongside(a, b, c, d, reach);
+            theirs[hit.first] += alongside(c, d, a, b, reach);
+        }
+    }
+
+    QMap<int, double> shared;
+    for (auto it = own.constBegin(); it != own.constEnd(); ++it)
+    {
+        const double length = qMax(it.value(), theirs.value(it.key()));
+        if (length > 0)
+            shared.insert(it.key(), length);
+    }
+    return shared;
+}
+
+QVector<int> RoomAnalytics::roomsAtDoor(const QPolygon &door) const
+{
+    QVector<int> found;
+    if (door.length() < 2)
+        return found;
+
+    const QPoint a = door.at(0);
+    const QPoint b = door.at(1);
+    const QList<QPolygon> &all = document->polygons(PolygonDocument::Rooms);
+    const QRect area = QRect(a, b).normalized().adjusted(-reachPixels, -reachPixels, reachPixels, reachPixels);
+
+    // Hits come in room order, so found stays sorted.
+    for (const QPair<int, int> &hit : document->segmentIndex().edgesIn(area))
+    {
+        const QPolygon &room = all.at(hit.first);
+        if (room.length() < 3 || (!found.isEmpty() && found.last() == hit.first))
+            continue;
+
+        const QPoint c = room.at(hit.second);
+        const QPoint d = room.at(hit.second + 1 < room.length() ? hit.second + 1 : 0);
+        if (segmentDistance(a, b, c, d) <= reachPixels)
+            found.append(hit.first);
+    }
+    return found;
+}
+
+QJsonObject RoomAnalytics::toJson()
+{
+    update();
+
+    QJsonArray roomArray;
+    for (int i = 0; i < rooms.size(); i++)
+    {
+        const Room &r = rooms.at(i);
+        QJsonObject o;
+        o.insert("index", i);
+        o.insert("color", document->colors().at(i));
+        o.insert("area", r.area);
+        o.insert("perimeter", r.perimeter);
+        o.insert("points", pointsToJson(document->polygon(PolygonDocument::Rooms, i)));
+        o.insert("doors", indicesToJson(r.doors));
+        o.insert("neighbours", indicesToJson(neighbours(i).toVector()));
+        roomArray.append(o);
+    }
+
+    QJsonArray doorArray;
+    for (int d = 0; d < doors.size(); d++)
+    {
+        QJsonObject o;
+        o.insert("index", d);
+        o.insert("points", pointsToJson(document->polygon(PolygonDocument::Doors, d)));
+        o.insert("rooms", indicesToJson(doors.at(d).rooms));
+        doorArray.append(o);
+    }
+
+    QJsonArray linkArray;
+    for (const Link &link : links())
+    {
+        QJsonObject o;
+        o.insert("a", link.a);
+        o.insert("b", link.b);
+        o.insert("shared_wall", link.sharedWall);
+        o.insert("doors", link.doors);
+        linkArray.append(o);
+    }
+
+    QJsonObject root;
+    root.insert("reach", reachPixels);
+    root.insert("rooms", roomArray);
+    root.insert("doors", doorArray);
+    root.insert("adjacency", linkArray);
+    return root;
+}
+
+bool RoomAnalytics::exportJson(const QString &fileName, QString *error)
+{
+    const QByteArray json = QJsonDocument(toJson()).toJson();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size())
+    {
+        *error = file.errorString();
+        return false;
+    }
+    return true;
+}
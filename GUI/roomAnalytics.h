@@ -0,0 +1,111 @@
+#ifndef ROOMANALYTICS_H
+#define ROOMANALYTICS_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QRect>
+#include <QSet>
+#include <QVector>
+#include "polygonDocument.h"
+
+// Room metrics kept alongside a document: area and perimeter per room, the
+// rooms every door connects and which rooms are adjacent, either through a
+// door or a shared wall. Edits only mark the polygons they touch, the next
+// query recomputes just those, with the neighbours found through the
+// document's spatial indexes.
+//
+// A door connects the rooms whose outline comes within reach of the door
+// segment. Two rooms share a wall where their outlines run parallel within
+// reach of each other for at least twice the reach.
+class RoomAnalytics : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Room
+    {
+        double area = 0;            // square pixels
+        double perimeter = 0;       // pixels
+        QRect bounds;
+        QVector<int> doors;
+    };
+
+    struct Door
+    {
+        QVector<int> rooms;
+    };
+
+    struct Link
+    {
+        int a = 0;
+        int b = 0;
+        double sharedWall = 0;      // pixels
+        int doors = 0;
+    };
+
+    // Everything measured, so a rebuild done on another thread, on a copy
+    // of the same plan, can be handed over.
+    struct Tables
+    {
+        int reach = 0;
+        int longestDoor = 0;
+        QVector<Room> rooms;
+        QVector<Door> doors;
+        QVector<QMap<int, double>> walls;
+    };
+
+    explicit RoomAnalytics(const PolygonDocument *document, QObject *parent = nullptr);
+
+    void setReach(int pixels);
+    int reach() const { return reachPixels; }
+
+    // Recomputes what was edited since the last call. The getters below
+    // call it themselves. After polygons came or went, or the document
+    // was replaced, that is a full rebuild.
+    void update();
+    bool needsRebuild() const { return allDirty; }
+
+    Tables tables();
+    // tables has to be measured on the document as it is now.
+    void setTables(const Tables &tables);
+
+    const Room &room(int index);
+    const Door &door(int index);
+    QList<Link> links();
+    QList<int> neighbours(int room);
+
+    // Geometry, metrics, door assignment and adjacency.
+    QJsonObject toJson();
+    bool exportJson(const QString &fileName, QString *error);
+
+private:
+    void roomChanged(int index);
+    void doorChanged(int index);
+    void invalidateAll();
+
+    void rebuild();
+    void updateRoom(int index);
+    void updateDoor(int index);
+    void markDoorsNear(const QRect &area);
+
+    static void measure(const QPolygon &polygon, Room *room);
+    QMap<int, double> sharedWalls(int index) const;
+    QVector<int> roomsAtDoor(const QPolygon &door) const;
+
+    const PolygonDocument *document;
+    int reachPixels = 12;
+    int longestDoor = 0;
+
+    QVector<Room> rooms;
+    QVector<Door> doors;
+    // Shared wall length per neighbour, every entry is mirrored.
+    QVector<QMap<int, double>> walls;
+
+    bool allDirty = true;
+    QSet<int> dirtyRooms;
+    QSet<int> dirtyDoors;
+};
+
+#endif // ROOMANALYTICS_H
@@ -0,0 +1,382 @@
+#include "segmentIndex.h"
+#include "geometryKernels.h"
+#include <QtMath>
+#include <algorithm>
+#include <limits>
+
+SegmentIndex::SegmentIndex(int cellSize)
+    : cellSize(qMax(1, cellSize))
+{
+}
+
+void SegmentIndex::rebuild(const QList<QPolygon> &source)
+{
+    clear();
+    lists = &source;
+    for (int l = 0; l < source.length(); l++)
+        addEdges(l, 0, source.at(l).length());
+}
+
+void SegmentIndex::clear()
+{
+    cells.clear();
+    lists = nullptr;
+    edgeCount = 0;
+    hasBounds = false;
+}
+
+void SegmentIndex::insertList(int list)
+{
+    // From the back, so a renamed edge never meets one still carrying its
+    // new name.
+    for (int l = lists->length() - 1; l > list; l--)
+    {
+        const QPolygon &poly = lists->at(l);
+        for (int e = 0; e < poly.length(); e++)
+            renameEdge(l - 1, e, poly.at(e), poly.at(e + 1 < poly.length() ? e + 1 : 0), l, e);
+    }
+    addEdges(list, 0, lists->at(list).length());
+}
+
+void SegmentIndex::removeList(int list, const QPolygon &removed)
+{
+    for (int e = 0; e < removed.length(); e++)
+        takeEdge(list, e, removed.at(e), removed.at(e + 1 < removed.length() ? e + 1 : 0));
+
+    for (int l = list; l < lists->length(); l++)
+    {
+        const QPolygon &poly = lists->at(l);
+        for (int e = 0; e < poly.length(); e++)
+            renameEdge(l + 1, e, poly.at(e), poly.at(e + 1 < poly.length() ? e + 1 : 0), l, e);
+    }
+}
+
+void SegmentIndex::replaceList(int list, const QPolygon &old)
+{
+    for (int e = 0; e < old.length(); e++)
+        takeEdge(list, e, old.at(e), old.at(e + 1 < old.length() ? e + 1 : 0));
+    addEdges(list, 0, lists->at(list).length());
+}
+
+void SegmentIndex::insertPoint(int list, int point)
+{
+    const QPolygon &poly = lists->at(list);
+    const int n = poly.length();
+    const int old = n - 1;
+    if (old > 0)
+    {
+        // The old edge into the new point's place is split in two. Named
+        // point - 1, or the wrap-around edge when the point went first.
+        const int split = (point + old - 1) % old;
+        takeEdge(list, split, poly.at((point + n - 1) % n), poly.at((point + 1) % n));
+
+        // The edges after it only move up by one.
+        for (int e = old - 1; e >= point; e--)
+        {
+            if (e != split)
+                renameEdge(list, e, poly.at(e + 1), poly.at(e + 2 < n ? e + 2 : 0), list, e + 1);
+        }
+    }
+
+    const int before = (point + n - 1) % n;
+    addEdge(list, before, poly.at(before), poly.at(point));
+    if (before != point)
+        addEdge(list, point, poly.at(point), poly.at((point + 1) % n));
+}
+
+void SegmentIndex::movePoint(int list, int point, const QPoint &from)
+{
+    const QPolygon &poly = lists->at(list);
+    const int n = poly.length();
+    const int prev = (point + n - 1) % n;
+    const QPoint &next = poly.at((point + 1) % n);
+
+    if (prev == point)
+    {
+        takeEdge(list, point, from, from);
+        addEdge(list, point, poly.at(point), poly.at(point));
+        return;
+    }
+    takeEdge(list, point, from, next);
+    takeEdge(list, prev, poly.at(prev), from);
+    addEdge(list, point, poly.at(point), next);
+    addEdge(list, prev, poly.at(prev), poly.at(point));
+}
+
+void SegmentIndex::removePoint(int list, int point, const QPoint &from)
+{
+    const QPolygon &poly = lists->at(list);
+    const int n = poly.length();
+    const int old = n + 1;
+    if (n == 0)
+    {
+        takeEdge(list, 0, from, from);
+        return;
+    }
+
+    // The two edges at the removed point become one.
+    const int before = (point + old - 1) % old;
+    const QPoint &a = poly.at((point + n - 1) % n);
+    const QPoint &b = poly.at(point % n);
+    takeEdge(list, before, a, from);
+    takeEdge(list, point, from, b);
+
+    // The edges after it only move down by one.
+    for (int e = point + 1; e < old; e++)
+    {
+        if (e != before)
+            renameEdge(list, e, poly.at(e - 1), poly.at(e < n ? e : 0), list, e - 1);
+    }
+
+    const int joined = (point + n - 1) % n;
+    addEdge(list, joined, a, b);
+}
+
+bool SegmentIndex::nearest(const QPoint &pos, int *list, int *edge, float *distance) const
+{
+    if (edgeCount == 0)
+        return false;
+
+    QVector<Entry> candidates;
+    QVector<float> x1, y1, x2, y2, dist;
+    float best = std::numeric_limits<float>::max();
+    int bestList = -1;
+    int bestEdge = -1;
+
+    auto collect = [&](int l, int e) {
+        const QPolygon &poly = lists->at(l);
+        const QPoint &a = poly.at(e);
+        const QPoint &b = poly.at(e + 1 < poly.length() ? e + 1 : 0);
+        candidates.append({l, e});
+        x1.append(a.x());
+        y1.append(a.y());
+        x2.append(b.x());
+        y2.append(b.y());
+    };
+
+    auto flush = [&]() {
+        dist.resize(candidates.length());
+        distToSegments(pos, x1.constData(), y1.constData(), x2.constData(), y2.constData(),
+                       dist.data(), candidates.length());
+        for (int i = 0; i < candidates.length(); i++)
+        {
+            const Entry &c = candidates.at(i);
+            if (dist.at(i) < best || (dist.at(i) == best && (c.list < bestList
+                    || (c.list == bestList && c.edge < bestEdge))))
+            {
+                best = dist.at(i);
+                bestList = c.list;
+                bestEdge = c.edge;
+            }
+        }
+        candidates.clear();
+        x1.clear();
+        y1.clear();
+        x2.clear();
+        y2.clear();
+    };
+
+    auto visit = [&](int cx, int cy) {
+        auto it = cells.constFind(gridCellKey(cx, cy));
+        if (it == cells.constEnd())
+            return;
+        for (const Entry &entry : it.value())
+            collect(entry.list, entry.edge);
+    };
+
+    const int cx = floorDiv(pos.x());
+    const int cy = floorDiv(pos.y());
+    const int maxRing = qMax(qMax(qAbs(cx - minCellX), qAbs(cx - maxCellX)),
+                             qMax(qAbs(cy - minCellY), qAbs(cy - maxCellY)));
+
+    for (int r = 0; r <= maxRing; r++)
+    {
+        // Past this point a plain pass over every edge is cheaper than
+        // probing mostly empty cells.
+        if (8 * r > cells.size())
+        {
+            for (int l = 0; l < lists->length(); l++)
+                for (int e = 0; e < lists->at(l).length(); e++)
+                    collect(l, e);
+            flush();
+            break;
+        }
+
+        if (r == 0)
+        {
+            visit(cx, cy);
+        }
+        else
+        {
+            for (int x = cx - r; x <= cx + r; x++)
+            {
+                visit(x, cy - r);
+                visit(x, cy + r);
+            }
+            for (int y = cy - r + 1; y <= cy + r - 1; y++)
+            {
+                visit(cx - r, y);
+                visit(cx + r, y);
+            }
+        }
+        flush();
+
+        // Edges not seen yet only touch cells at least r cells away.
+        if (bestList >= 0 && best < r * cellSize)
+            break;
+    }
+
+    *list = bestList;
+    *edge = bestEdge;
+    *distance = best;
+    return bestList >= 0;
+}
+
+QVector<QPair<int, int>> SegmentIndex::edgesIn(const QRect &rect) const
+{
+    QVector<QPair<int, int>> hits;
+    if (edgeCount == 0 || rect.isEmpty())
+        return hits;
+
+    const int cx0 = qMax(floorDiv(rect.left()), minCellX);
+    const int cx1 = qMin(floorDiv(rect.right()), maxCellX);
+    const int cy0 = qMax(floorDiv(rect.top()), minCellY);
+    const int cy1 = qMin(floorDiv(rect.bottom()), maxCellY);
+    if (qint64(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > cells.size())
+    {
+        for (int l = 0; l < lists->length(); l++)
+        {
+            const QPolygon &poly = lists->at(l);
+            for (int e = 0; e < poly.length(); e++)
+            {
+                const QRect box = QRect(poly.at(e), poly.at(e + 1 < poly.length() ? e + 1 : 0)).normalized();
+                if (box.intersects(rect))
+                    hits.append(qMakePair(l, e));
+            }
+        }
+        return hits;
+    }
+
+    for (int cx = cx0; cx <= cx1; cx++)
+    {
+        for (int cy = cy0; cy <= cy1; cy++)
+        {
+            auto it = cells.constFind(gridCellKey(cx, cy));
+            if (it == cells.constEnd())
+                continue;
+            for (const Entry &entry : it.value())
+                hits.append(qMakePair(entry.list, entry.edge));
+        }
+    }
+    // Long edges are registered in several cells.
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+    return hits;
+}
+
+QVector<quint64> SegmentIndex::edgeCells(QPoint a, QPoint b) const
+{
+    QVector<quint64> keys;
+    if (a.x() > b.x())
+        qSwap(a, b);
+
+    const int cx0 = floorDiv(a.x());
+    const int cx1 = floorDiv(b.x());
+    for (int cx = cx0; cx <= cx1; cx++)
+    {
+        double ya = a.y();
+        double yb = b.y();
+        if (a.x() != b.x())
+        {
+            // Clip the segment to the column and take its y extent there.
+            const double slope = double(b.y() - a.y()) / (b.x() - a.x());
+            const double xl = qMax<double>(a.x(), double(cx) * cellSize);
+            const double xr = qMin<double>(b.x(), double(cx + 1) * cellSize);
+            ya = a.y() + (xl - a.x()) * slope;
+            yb = a.y() + (xr - a.x()) * slope;
+        }
+        const int cy0 = floorDiv(qFloor(qMin(ya, yb)));
+        const int cy1 = floorDiv(qCeil(qMax(ya, yb)));
+        for (int cy = cy0; cy <= cy1; cy++)
+            keys.append(gridCellKey(cx, cy));
+    }
+    return keys;
+}
+
+void SegmentIndex::addEdge(int list, int edge, const QPoint &a, const QPoint &b)
+{
+    for (quint64 key : edgeCells(a, b))
+        cells[key].append({list, edge});
+    edgeCount++;
+
+    const int lx = floorDiv(qMin(a.x(), b.x()));
+    const int hx = floorDiv(qMax(a.x(), b.x()));
+    const int ly = floorDiv(qMin(a.y(), b.y()));
+    const int hy = floorDiv(qMax(a.y(), b.y()));
+    if (!hasBounds)
+    {
+        minCellX = lx;
+        maxCellX = hx;
+        minCellY = ly;
+        maxCellY = hy;
+        hasBounds = true;
+    }
+    else
+    {
+        minCellX = qMin(minCellX, lx);
+        maxCellX = qMax(maxCellX, hx);
+        minCellY = qMin(minCellY, ly);
+        maxCellY = qMax(maxCellY, hy);
+    }
+}
+
+void SegmentIndex::takeEdge(int list, int edge, const QPoint &a, const QPoint &b)
+{
+    for (quint64 key : edgeCells(a, b))
+    {
+        auto it = cells.find(key);
+        if (it == cells.end())
+            continue;
+
+        QVector<Entry> &cell = it.value();
+        for (int i = 0; i < cell.length(); i++)
+        {
+            if (cell.at(i).list == list && cell.at(i).edge == edge)
+            {
+                cell[i] = cell.last();
+                cell.removeLast();
+                break;
+            }
+        }
+        if (cell.isEmpty())
+            cells.erase(it);
+    }
+    edgeCount--;
+}
+
+void SegmentIndex::renameEdge(int list, int edge, const QPoint &a, const QPoint &b, int newList, int newEdge)
+{
+    for (quint64 key : edgeCells(a, b))
+    {
+        auto it = cells.find(key);
+        if (it == cells.end())
+            continue;
+
+        for (Entry &entry : it.value())
+        {
+            if (entry.list == list && entry.edge == edge)
+            {
+                entry.list = newList;
+                entry.edge = newEdge;
+                break;
+            }
+        }
+    }
+}
+
+void SegmentIndex::addEdges(int list, int from, int to)
+{
+    const QPolygon &poly = lists->at(list);
+    for (int e = from; e < to; e++)
+        addEdge(list, e, poly.at(e), poly.at(e + 1 < poly.length() ? e + 1 : 0));
+}
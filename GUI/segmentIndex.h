@@ -0,0 +1,72 @@
+#ifndef SEGMENTINDEX_H
+#define SEGMENTINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QPoint>
+#include <QPair>
+#include <QPolygon>
+#include <QRect>
+#include <QVector>
+#include "gridCell.h"
+
+// Uniform grid over the closed edges of a polygon list. Edge i of a polygon
+// runs from point i to point i + 1, the last one wraps around to point 0.
+// Every edge is registered in each cell it passes through.
+//
+// Like PointIndex, the index reads positions from the list it mirrors and
+// is told about every edit of it afterwards. Edges only renumbered by an
+// edit keep their cells, only the ones that changed shape are re-placed.
+class SegmentIndex
+{
+public:
+    explicit SegmentIndex(int cellSize = 64);
+
+    // source has to outlive the index, or the next rebuild().
+    void rebuild(const QList<QPolygon> &source);
+    void clear();
+
+    // After source gained or lost a polygon at list.
+    void insertList(int list);
+    void removeList(int list, const QPolygon &removed);
+    // After the polygon at list got new points, old being the ones it had.
+    void replaceList(int list, const QPolygon &old);
+    // After source gained, moved or lost a point.
+    void insertPoint(int list, int point);
+    void movePoint(int list, int point, const QPoint &from);
+    void removePoint(int list, int point, const QPoint &from);
+
+    // Nearest edge by distToSegment. Ties resolve to the lowest (list, edge)
+    // pair, like a linear scan in list order would.
+    bool nearest(const QPoint &pos, int *list, int *edge, float *distance) const;
+
+    // (list, edge) pairs of the edges that may cross rect, in list order.
+    QVector<QPair<int, int>> edgesIn(const QRect &rect) const;
+
+private:
+    struct Entry
+    {
+        int list;
+        int edge;
+    };
+
+    int floorDiv(int v) const { return gridFloorDiv(v, cellSize); }
+    QVector<quint64> edgeCells(QPoint a, QPoint b) const;
+    void addEdge(int list, int edge, const QPoint &a, const QPoint &b);
+    void takeEdge(int list, int edge, const QPoint &a, const QPoint &b);
+    void renameEdge(int list, int edge, const QPoint &a, const QPoint &b, int newList, int newEdge);
+    void addEdges(int list, int from, int to);
+
+    int cellSize;
+    int edgeCount = 0;
+    QHash<quint64, QVector<Entry>> cells;
+    const QList<QPolygon> *lists = nullptr;
+
+    bool hasBounds = false;
+    int minCellX = 0;
+    int minCellY = 0;
+    int maxCellX = 0;
+    int maxCellY = 0;
+};
+
+#endif // SEGMENTINDEX_H
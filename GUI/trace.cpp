@@ -0,0 +1,216 @@
+#include "trace.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+
+namespace {
+
+const char *const inputToPixel = "input to pixel";
+
+// Spans kept for export, the oldest are overwritten.
+const int eventCapacity = 1 << 18;
+// Spans per name the percentiles are computed from.
+const int windowSize = 512;
+
+struct Event
+{
+    const char *name;
+    qint64 start;
+    qint64 duration;
+    int thread;
+};
+
+struct Window
+{
+    QVector<qint64> durations;
+    int next = 0;
+
+    void add(qint64 duration)
+    {
+        if (durations.length() < windowSize)
+        {
+            durations.append(duration);
+            return;
+        }
+        durations[next] = duration;
+        next = (next + 1) % windowSize;
+    }
+};
+
+struct State
+{
+    QMutex mutex;
+    QElapsedTimer clock;
+    QVector<Event> events;
+    int nextEvent = 0;
+    QHash<const char *, Window> windows;
+    qint64 pendingInput = -1;
+    std::atomic<int> threads{0};
+
+    State() { clock.start(); }
+};
+
+State &state()
+{
+    static State s;
+    return s;
+}
+
+int threadNumber()
+{
+    static thread_local int number = ++state().threads;
+    return number;
+}
+
+void store(State &s, const char *name, qint64 start, qint64 duration, int thread)
+{
+    const Event event = { name, start, duration, thread };
+    if (s.events.length() < eventCapacity)
+        s.events.append(event);
+    else
+        s.events[s.nextEvent] = event;
+    s.nextEvent = (s.nextEvent + 1) % eventCapacity;
+    s.windows[name].add(duration);
+}
+
+double percentile(const QVector<qint64> &sorted, double p)
+{
+    const int i = qBound(0, int(p * (sorted.length() - 1) + 0.5), sorted.length() - 1);
+    return sorted.at(i) / 1e6;
+}
+
+}
+
+std::atomic<bool> Trace::enabled(false);
+
+void Trace::setEnabled(bool on)
+{
+    state();
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+void Trace::clear()
+{
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    s.events.clear();
+    s.nextEvent = 0;
+    s.windows.clear();
+    s.pendingInput = -1;
+}
+
+qint64 Trace::now()
+{
+    return state().clock.nsecsElapsed();
+}
+
+void Trace::record(const char *name, qint64 start, qint64 duration)
+{
+    const int thread = threadNumber();
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    store(s, name, start, duration, thread);
+}
+
+void Trace::markInput()
+{
+    if (!isEnabled())
+        return;
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    if (s.pendingInput < 0)
+        s.pendingInput = s.clock.nsecsElapsed();
+}
+
+void Trace::markPresented()
+{
+    if (!isEnabled())
+        return;
+    const int thread = threadNumber();
+    State &s = state();
+    QMutexLocker lock(&s.mutex);
+    if (s.pendingInput < 0)
+        return;
+    store(s, inputToPixel, s.pendingInput, s.clock.nsecsElapsed() - s.pendingInput, thread);
+    s.pendingInput = -1;
+}
+
+QList<Trace::Stats> Trace::summary()
+{
+    // The same name may come from different string literals.
+    QHash<QString, QVector<qint64>> merged;
+    {
+        State &s = state();
+        QMutexLocker lock(&s.mutex);
+        for (auto it = s.windows.constBegin(); it != s.windows.constEnd(); ++it)
+            merged[QString::fromLatin1(it.key())] += it.value().durations;
+    }
+
+    QList<Stats> result;
+    for (auto it = merged.begin(); it != merged.end(); ++it)
+    {
+        QVector<qint64> &sorted = it.value();
+        std::sort(sorted.begin(), sorted.end());
+
+        Stats stats;
+        stats.name = it.key();
+        stats.count = sorted.length();
+        stats.p50 = percentile(sorted, 0.50);
+        stats.p95 = percentile(sorted, 0.95);
+        stats.p99 = percentile(sorted, 0.99);
+        stats.max = sorted.last() / 1e6;
+        result.append(stats);
+    }
+
+    std::sort(result.begin(), result.end(), [](const Stats &a, const Stats &b) {
+        return a.name < b.name;
+    });
+    return result;
+}
+
+bool Trace::writeChromeTrace(const QString &fileName, QString *error)
+{
+    QVector<Event> events;
+    {
+        State &s = state();
+        QMutexLocker lock(&s.mutex);
+        // Oldest first once the ring has wrapped.
+        if (s.events.length() == eventCapacity)
+            events = s.events.mid(s.nextEvent) + s.events.mid(0, s.nextEvent);
+        else
+            events = s.events;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        *error = QStringLiteral("Cannot write %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+
+    // Complete events ("ph": "X"), timestamps and durations in microseconds.
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (int i = 0; i < events.length(); i++)
+    {
+        const Event &e = events.at(i);
+        out << (i ? ",\n" : "")
+            << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+            << ",\"ts\":" << QString::number(e.start / 1e3, 'f', 3)
+            << ",\"dur\":" << QString::number(e.duration / 1e3, 'f', 3) << "}";
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    if (file.error() != QFileDevice::NoError)
+    {
+        *error = QStringLiteral("Cannot write %1: %2").arg(fileName, file.errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QList>
+#include <QString>
+#include <atomic>
+
+// Timing of named scopes, off by default. A disabled scope costs one relaxed
+// atomic load, defining OUTLINEFLOW_NO_TRACE removes the scopes entirely.
+// Recorded spans feed the latency HUD and can be saved as Chrome trace
+// event JSON (chrome://tracing, Perfetto).
+class Trace
+{
+public:
+    struct Stats
+    {
+        QString name;
+        int count = 0;      // spans in the window
+        double p50 = 0;     // milliseconds
+        double p95 = 0;
+        double p99 = 0;
+        double max = 0;
+    };
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool on);
+    static void clear();
+
+    // Nanoseconds on a monotonic clock shared by all threads.
+    static qint64 now();
+    static void record(const char *name, qint64 start, qint64 duration);
+
+    // Event-to-pixel latency: markInput() when an input event arrives,
+    // markPresented() once a frame has been painted. The span runs from the
+    // oldest input not yet on screen.
+    static void markInput();
+    static void markPresented();
+
+    // Percentiles over the most recent spans of every name, the input to
+    // pixel latency is reported as "input to pixel".
+    static QList<Stats> summary();
+
+    static bool writeChromeTrace(const QString &fileName, QString *error);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *label)
+        : name(Trace::isEnabled() ? label : nullptr), start(name ? Trace::now() : 0) {}
+    ~TraceScope()
+    {
+        if (name)
+            Trace::record(name, start, Trace::now() - start);
+    }
+
+private:
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    const char *name;
+    qint64 start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef OUTLINEFLOW_NO_TRACE
+#define TRACE_SCOPE(name) do {} while (false)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,44 @@
+#include "traceHud.h"
+#include "trace.h"
+#include <QFontDatabase>
+
+TraceHud::TraceHud(QWidget *parent)
+    : QLabel(parent)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setStyleSheet("background: rgba(0, 0, 0, 170); color: white; padding: 6px;");
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setTextFormat(Qt::PlainText);
+
+    timer.setInterval(500);
+    connect(&timer, &QTimer::timeout, this, &TraceHud::refresh);
+}
+
+void TraceHud::showEvent(QShowEvent *event)
+{
+    QLabel::showEvent(event);
+    refresh();
+    timer.start();
+}
+
+void TraceHud::hideEvent(QHideEvent *event)
+{
+    timer.stop();
+    QLabel::hideEvent(event);
+}
+
+void TraceHud::refresh()
+{
+    QStringList lines;
+    lines << QStringLiteral("%1 %2 %3 %4 %5 %6")
+             .arg("ms", -18).arg("n", 5).arg("p50", 7).arg("p95", 7).arg("p99", 7).arg("max", 7);
+    for (const Trace::Stats &s : Trace::summary())
+    {
+        lines << QStringLiteral("%1 %2 %3 %4 %5 %6")
+                 .arg(s.name.left(18), -18).arg(s.count, 5)
+                 .arg(s.p50, 7, 'f', 2).arg(s.p95, 7, 'f', 2)
+                 .arg(s.p99, 7, 'f', 2).arg(s.max, 7, 'f', 2);
+    }
+    setText(lines.join('\n'));
+    adjustSize();
+}
@@ -0,0 +1,27 @@
+#ifndef TRACEHUD_H
+#define TRACEHUD_H
+
+#include <QLabel>
+#include <QTimer>
+
+// Small overlay listing p50/p95/p99 and max of every traced scope and the
+// input to pixel latency. Refreshes twice a second while visible.
+class TraceHud : public QLabel
+{
+    Q_OBJECT
+
+public:
+    explicit TraceHud(QWidget *parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    void refresh();
+
+private:
+    QTimer timer;
+};
+
+#endif // TRACEHUD_H
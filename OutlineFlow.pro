@@ -0,0 +1,8 @@
+# The editor, its benchmarks and the unit tests. "make check" runs the
+# tests.
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    GUI \
+    benchmark \
+    tests
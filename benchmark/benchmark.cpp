@@ -0,0 +1,438 @@
+#include "benchmark.h"
+#include "geometryKernels.h"
+#include "imagePyramid.h"
+#include "overlayRenderer.h"
+#include "pointIndex.h"
+#include "polygonDocument.h"
+#include "polygonLod.h"
+#include "polygonSimplifier.h"
+#include "polygonValidator.h"
+#include "segmentIndex.h"
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+namespace {
+
+const int viewportWidth = 1280;
+const int viewportHeight = 800;
+
+QJsonObject toJson(const Benchmark::Sample &s)
+{
+    QJsonObject o;
+    o.insert("name", s.name);
+    o.insert("vertices", s.vertices);
+    o.insert("image", s.imageSide);
+    o.insert("operations", s.operations);
+    o.insert("iterations", s.iterations);
+    o.insert("mean_ns", s.meanNs);
+    o.insert("median_ns", s.medianNs);
+    o.insert("min_ns", s.minNs);
+    return o;
+}
+
+QString toCsv(const Benchmark::Sample &s)
+{
+    return QStringLiteral("%1,%2,%3,%4,%5,%6,%7,%8")
+            .arg(s.name).arg(s.vertices).arg(s.imageSide).arg(s.operations).arg(s.iterations)
+            .arg(s.meanNs, 0, 'f', 1).arg(s.medianNs, 0, 'f', 1).arg(s.minNs, 0, 'f', 1);
+}
+
+QImage syntheticImage(int side)
+{
+    // Grayscale keeps a 16k plan at 256 MB, the rows vary so tiles are not
+    // all identical.
+    QImage image(side, side, QImage::Format_Grayscale8);
+    for (int y = 0; y < side; y++)
+        memset(image.scanLine(y), 160 + (y / 16) % 64, size_t(side));
+    return image;
+}
+
+QVector<QPoint> randomPoints(int count, int side, quint32 seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> coord(0, side - 1);
+    QVector<QPoint> points(count);
+    for (QPoint &p : points)
+        p = QPoint(coord(rng), coord(rng));
+    return points;
+}
+
+}
+
+ProjectData Benchmark::syntheticPlan(int vertices, int side, quint32 seed)
+{
+    static const char *const palette[] = { "#00ff00", "#ff0000", "#0000ff" };
+    const int perRoom = 20;
+
+    ProjectData data;
+    const int rooms = qMax(1, (vertices + perRoom - 1) / perRoom);
+    const int columns = qMax(1, int(std::ceil(std::sqrt(double(rooms)))));
+    const double cell = double(side) / columns;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> jitter(0.75, 1.0);
+
+    int left = vertices;
+    for (int r = 0; r < rooms; r++)
+    {
+        const int n = qMin(perRoom, left);
+        left -= n;
+
+        const double cx = (r % columns + 0.5) * cell;
+        const double cy = (r / columns + 0.5) * cell;
+        const double radius = cell * 0.45;
+
+        // Points ordered by angle keep every room a simple polygon.
+        QPolygon room(n);
+        for (int i = 0; i < n; i++)
+        {
+            const double a = 2 * M_PI * i / n;
+            const double d = radius * jitter(rng);
+            room[i] = QPoint(int(cx + d * std::cos(a)), int(cy + d * std::sin(a)));
+        }
+        data.polygons.append(room);
+        data.colors.append(palette[r % 3]);
+
+        if (n >= 2)
+        {
+            QPolygon door;
+            door << room.at(0) << room.at(1);
+            data.doors.append(door);
+        }
+    }
+    return data;
+}
+
+Benchmark::Sample Benchmark::measure(const QString &name, int operations,
+                                     const std::function<void()> &op, int minMs, int maxIterations)
+{
+    Sample s;
+    s.name = name;
+    s.operations = operations;
+
+    QVector<qint64> times;
+    QElapsedTimer total;
+    total.start();
+    QElapsedTimer timer;
+    do
+    {
+        timer.start();
+        op();
+        times.append(timer.nsecsElapsed());
+    } while (total.elapsed() < minMs && times.length() < maxIterations);
+
+    std::sort(times.begin(), times.end());
+    qint64 sum = 0;
+    for (qint64 t : times)
+        sum += t;
+
+    s.iterations = times.length();
+    s.meanNs = double(sum) / times.length() / operations;
+    s.medianNs = double(times.at(times.length() / 2)) / operations;
+    s.minNs = double(times.first()) / operations;
+    return s;
+}
+
+int Benchmark::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the editor's geometry, drawing and file hot paths on generated plans.");
+    parser.addHelpOption();
+
+    QCommandLineOption formatOption(QStringList() << "f" << "format",
+            "Output format, json (default) or csv.", "format", "json");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+            "Writes the results to <file> instead of stdout.", "file");
+    QCommandLineOption verticesOption("max-vertices",
+            "Largest plan, 100 to 1000000 vertices (default).", "n", "1000000");
+    QCommandLineOption imageOption("max-image",
+            "Largest image side, 1024 to 16384 pixels (default).", "side", "16384");
+    QCommandLineOption filterOption("filter",
+            "Only runs benchmarks whose name contains <text>.", "text");
+    parser.addOption(formatOption);
+    parser.addOption(outputOption);
+    parser.addOption(verticesOption);
+    parser.addOption(imageOption);
+    parser.addOption(filterOption);
+    parser.process(arguments);
+
+    QTextStream err(stderr);
+
+    const QString format = parser.value(formatOption).toLower();
+    if (format != "json" && format != "csv")
+    {
+        err << "Unknown format " << format << ", expected json or csv.\n";
+        return 2;
+    }
+    const int maxVertices = qBound(100, parser.value(verticesOption).toInt(), 1000000);
+    const int maxImage = qBound(1024, parser.value(imageOption).toInt(), 16384);
+    const QString filter = parser.value(filterOption);
+
+    QTemporaryDir tempDir;
+    if (!tempDir.isValid())
+    {
+        err << "Cannot create a temporary directory.\n";
+        return 2;
+    }
+
+    QVector<int> vertexCounts;
+    for (int n = 100; n <= maxVertices; n *= 10)
+        vertexCounts << n;
+    QVector<int> imageSides;
+    for (int side = 1024; side <= maxImage; side *= 4)
+        imageSides << side;
+    if (imageSides.last() != maxImage)
+        imageSides << maxImage;
+
+    QVector<Sample> samples;
+    auto wanted = [&filter](const QString &name) {
+        return filter.isEmpty() || name.contains(filter);
+    };
+    auto add = [&samples, &err](Sample s, int vertices, int side) {
+        s.vertices = vertices;
+        s.imageSide = side;
+        samples.append(s);
+        err << s.name << " " << vertices << " vertices " << side << " px: "
+            << QString::number(s.medianNs, 'f', 1) << " ns\n";
+        err.flush();
+    };
+
+    for (int side : imageSides)
+    {
+        ImagePyramid pyramid;
+        pyramid.setSource(syntheticImage(side));
+        const bool largest = side == imageSides.last();
+
+        for (int vertices : vertexCounts)
+        {
+            ProjectData plan = syntheticPlan(vertices, side);
+            PointIndex pointIndex;
+            SegmentIndex segmentIndex;
+            pointIndex.rebuild(plan.polygons);
+            segmentIndex.rebuild(plan.polygons);
+
+            // Geometry and file formats do not depend on the image, they are
+            // only run once, on the largest plan area.
+            if (largest)
+            {
+                const QVector<QPoint> queries = randomPoints(1000, side, 2);
+
+                if (wanted("index_build"))
+                    add(measure("index_build", 1, [&]() {
+                        PointIndex p;
+                        SegmentIndex s;
+                        p.rebuild(plan.polygons);
+                        s.rebuild(plan.polygons);
+                    }), vertices, side);
+
+                if (wanted("get_closest_point"))
+                    add(measure("get_closest_point", queries.length(), [&]() {
+                        int list, point;
+                        QPoint closest;
+                        for (const QPoint &q : queries)
+                            pointIndex.closest(q, &list, &point, &closest);
+                    }), vertices, side);
+
+                if (wanted("insert_new_point"))
+                {
+                    // Every iteration adds to the document like repeated
+                    // clicks would.
+                    PolygonDocument document;
+                    document.setProjectData(plan);
+                    add(measure("insert_new_point", queries.length(), [&]() {
+                        int list, edge;
+                        float distance;
+                        for (const QPoint &q : queries)
+                        {
+                            if (!document.segmentIndex().nearest(q, &list, &edge, &distance))
+                                continue;
+                            document.insertVertex(PolygonDocument::Rooms, list, edge + 1, q);
+                        }
+                    }, 200, 20), vertices, side);
+                }
+
+                // Distance from one point to every edge, per segment.
+                QVector<float> x1, y1, x2, y2;
+                for (const QPolygon &poly : plan.polygons)
+                {
+                    for (int i = 0; i < poly.length(); i++)
+                    {
+                        const QPoint &a = poly.at(i);
+                        const QPoint &b = poly.at(i + 1 < poly.length() ? i + 1 : 0);
+                        x1 << a.x(); y1 << a.y(); x2 << b.x(); y2 << b.y();
+                    }
+                }
+                QVector<float> distances(x1.length());
+                const QPoint probe(side / 3, side / 3);
+
+                if (wanted("dist_to_segment"))
+                    add(measure("dist_to_segment", x1.length(), [&]() {
+                        for (int i = 0; i < x1.length(); i++)
+                            distances[i] = distToSegment(probe, QPoint(int(x1.at(i)), int(y1.at(i))),
+                                                         QPoint(int(x2.at(i)), int(y2.at(i))));
+                    }), vertices, side);
+
+                if (wanted("dist_to_segments"))
+                    add(measure("dist_to_segments", x1.length(), [&]() {
+                        distToSegments(probe, x1.constData(), y1.constData(), x2.constData(),
+                                       y2.constData(), distances.data(), x1.length());
+                    }), vertices, side);
+
+                // Rotating every vertex a little around the plan's center,
+                // as a bulk edit of a selection does.
+                if (wanted("transform_points"))
+                {
+                    QVector<int> xs, ys;
+                    for (const QPolygon &poly : plan.polygons)
+                        for (const QPoint &p : poly)
+                        {
+                            xs << p.x();
+                            ys << p.y();
+                        }
+                    QTransform rotation;
+                    rotation.translate(side / 2, side / 2);
+                    rotation.rotate(0.5);
+                    rotation.translate(-side / 2, -side / 2);
+                    add(measure("transform_points", xs.length(), [&]() {
+                        transformPoints(rotation, xs.data(), ys.data(), xs.length());
+                    }), vertices, side);
+                }
+
+                if (wanted("simplify_dp"))
+                    add(measure("simplify_dp", vertices, [&]() {
+                        PolygonSimplifier::simplify(plan.polygons, PolygonSimplifier::DouglasPeucker, 2.0);
+                    }), vertices, side);
+                if (wanted("simplify_vw"))
+                    add(measure("simplify_vw", vertices, [&]() {
+                        PolygonSimplifier::simplify(plan.polygons, PolygonSimplifier::VisvalingamWhyatt, 2.0);
+                    }), vertices, side);
+                if (wanted("validate"))
+                    add(measure("validate", vertices, [&]() {
+                        PolygonValidator::validate(plan.polygons);
+                    }), vertices, side);
+
+                const QString datFile = tempDir.filePath(QStringLiteral("plan%1.dat").arg(vertices));
+                const QString ofbFile = tempDir.filePath(QStringLiteral("plan%1.ofb").arg(vertices));
+                QString error;
+                auto check = [&error, &err](bool ok) {
+                    if (!ok)
+                        err << error << "\n";
+                };
+
+                if (wanted("export_dat"))
+                    add(measure("export_dat", 1, [&]() {
+                        check(ProjectIO::writeDat(datFile, plan, &error));
+                    }), vertices, side);
+                if (wanted("import_dat") && (QFile::exists(datFile) || ProjectIO::writeDat(datFile, plan, &error)))
+                    add(measure("import_dat", 1, [&]() {
+                        ProjectData data;
+                        check(ProjectIO::readDat(datFile, &data, &error));
+                    }), vertices, side);
+                if (wanted("export_ofb"))
+                    add(measure("export_ofb", 1, [&]() {
+                        check(ProjectIO::writeBinary(ofbFile, plan, &error));
+                    }), vertices, side);
+                if (wanted("import_ofb") && (QFile::exists(ofbFile) || ProjectIO::writeBinary(ofbFile, plan, &error)))
+                    add(measure("import_ofb", 1, [&]() {
+                        ProjectData data;
+                        check(ProjectIO::readBinary(ofbFile, &data, &error));
+                    }), vertices, side);
+            }
+
+            // Drawing like PlanView does: background tiles, then the overlay
+            // for the exposed image area.
+            OverlayRenderer renderer(plan.polygons, plan.colors, plan.doors, pointIndex, segmentIndex);
+            QImage target(viewportWidth, viewportHeight, QImage::Format_ARGB32_Premultiplied);
+
+            auto draw = [&](qreal scale, const QRect &area) {
+                QPainter painter(&target);
+                painter.scale(scale, scale);
+                painter.translate(-area.topLeft());
+                pyramid.draw(painter, area);
+                renderer.paint(painter, area.adjusted(-3, -3, 3, 3));
+            };
+
+            if (wanted("draw_polygon_viewport"))
+            {
+                const QRect area(side / 2 - viewportWidth / 2, side / 2 - viewportHeight / 2,
+                                 viewportWidth, viewportHeight);
+                add(measure("draw_polygon_viewport", 1, [&]() { draw(1.0, area); }), vertices, side);
+            }
+            if (wanted("draw_polygon_fit"))
+            {
+                const qreal scale = qreal(viewportHeight) / side;
+                add(measure("draw_polygon_fit", 1, [&]() { draw(scale, QRect(0, 0, side, side)); }),
+                    vertices, side);
+            }
+            if (wanted("draw_polygon_fit_lod"))
+            {
+                // The same with the outlines PlanView draws when zoomed out,
+                // built once up front like the view's cache.
+                const qreal scale = qreal(viewportHeight) / side;
+                PolygonLod lod;
+                renderer.setLevelOfDetail(&lod.level(plan.polygons, qMax(1, PolygonLod::levelFor(scale))));
+                add(measure("draw_polygon_fit_lod", 1, [&]() { draw(scale, QRect(0, 0, side, side)); }),
+                    vertices, side);
+                renderer.setLevelOfDetail(nullptr);
+            }
+            if (wanted("draw_polygon_drag"))
+            {
+                // The area one dragged vertex dirties per frame.
+                const QPoint v = plan.polygons.at(plan.polygons.length() / 2).at(0);
+                const QRect area(v - QPoint(48, 48), QSize(96, 96));
+                add(measure("draw_polygon_drag", 1, [&]() { draw(1.0, area); }), vertices, side);
+            }
+        }
+    }
+
+    QByteArray output;
+    if (format == "json")
+    {
+        QJsonArray results;
+        for (const Sample &s : samples)
+            results.append(toJson(s));
+        QJsonObject root;
+        root.insert("qt", QString(qVersion()));
+        root.insert("threads", QThread::idealThreadCount());
+        root.insert("results", results);
+        output = QJsonDocument(root).toJson();
+    }
+    else
+    {
+        QStringList lines;
+        lines << "name,vertices,image,operations,iterations,mean_ns,median_ns,min_ns";
+        for (const Sample &s : samples)
+            lines << toCsv(s);
+        output = lines.join("\n").toUtf8() + "\n";
+    }
+
+    if (parser.isSet(outputOption))
+    {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(output) != output.size())
+        {
+            err << "Cannot write " << file.fileName() << ": " << file.errorString() << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(output);
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QStringList>
+#include <functional>
+#include "projectIO.h"
+
+// Headless benchmarks, the outlineflow-bench executable. Runs the
+// editor's hot paths (closest point, point insertion, distance to segment,
+// overlay drawing, import and export) on generated plans and writes the
+// timings as JSON or CSV, so runs of different versions can be compared.
+class Benchmark
+{
+public:
+    struct Sample
+    {
+        QString name;
+        int vertices = 0;
+        int imageSide = 0;
+        int operations = 1;     // operations per timed iteration
+        int iterations = 0;
+        double meanNs = 0;      // per operation
+        double medianNs = 0;
+        double minNs = 0;
+    };
+
+    static int run(const QStringList &arguments);
+
+    // Rooms of about 20 vertices laid out on a grid over a side x side
+    // image, with one door per room. The same seed gives the same plan.
+    static ProjectData syntheticPlan(int vertices, int side, quint32 seed = 1);
+
+    // Repeats op, which performs the given number of operations, until
+    // minMs have passed or maxIterations are done.
+    static Sample measure(const QString &name, int operations, const std::function<void()> &op,
+                          int minMs = 200, int maxIterations = 1000);
+};
+
+#endif // BENCHMARK_H
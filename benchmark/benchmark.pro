@@ -0,0 +1,17 @@
+# Times the editor's hot paths on generated plans, see benchmark.h.
+QT += core gui concurrent
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = outlineflow-bench
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../GUI/core.pri)
+
+SOURCES += \
+    main.cpp \
+    benchmark.cpp
+
+HEADERS += \
+    benchmark.h
@@ -0,0 +1,12 @@
+#include "benchmark.h"
+
+#include <QGuiApplication>
+
+int main(int argc, char *argv[])
+{
+    // Painting into images wants a gui application but no display.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication a(argc, argv);
+    return Benchmark::run(a.arguments());
+}
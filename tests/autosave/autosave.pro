@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_autosave
+
+SOURCES += \
+    tst_autosave.cpp
@@ -0,0 +1,196 @@
+#include <QDir>
+#include <QFile>
+#include <QScopedPointer>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "autosave.h"
+#include "polygonDocument.h"
+
+class TestAutosave : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void replaysEdits();
+    void mergedMovesReplay();
+    void tornRecordIgnored();
+    void compactionKeepsContent();
+    void removesFilesOnExit();
+    void basesInCreationOrder();
+
+private:
+    static void edit(PolygonDocument *document);
+    // True once the files under base hold what document holds.
+    static bool recovers(const QString &base, const PolygonDocument &document, const QString &imageFile = QString());
+    QString journalFile() const;
+
+    QScopedPointer<QTemporaryDir> dir;
+    QString base;
+};
+
+void TestAutosave::init()
+{
+    dir.reset(new QTemporaryDir);
+    QVERIFY(dir->isValid());
+    base = dir->filePath("floor1");
+}
+
+void TestAutosave::edit(PolygonDocument *document)
+{
+    const int room = document->appendPolygon(PolygonDocument::Rooms, QPolygon(), "blue");
+    document->appendVertex(PolygonDocument::Rooms, room, QPoint(0, 0));
+    document->appendVertex(PolygonDocument::Rooms, room, QPoint(100, 0));
+    document->appendVertex(PolygonDocument::Rooms, room, QPoint(100, 80));
+    document->insertVertex(PolygonDocument::Rooms, room, 1, QPoint(50, -10));
+    document->moveVertex(PolygonDocument::Rooms, room, 1, QPoint(50, 0));
+    document->removeVertex(PolygonDocument::Rooms, room, 1);
+
+    const int door = document->appendPolygon(PolygonDocument::Doors, QPolygon() << QPoint(100, 20) << QPoint(100, 40));
+    document->insertPolygon(PolygonDocument::Rooms, 0, QPolygon() << QPoint(-5, -5) << QPoint(-1, -5) << QPoint(-1, -1), "#00ff00");
+    document->removePolygon(PolygonDocument::Doors, door);
+    document->appendPolygon(PolygonDocument::Doors, QPolygon() << QPoint(0, 40) << QPoint(0, 60));
+    document->replacePolygon(PolygonDocument::Rooms, 0, QPolygon() << QPoint(-6, -5) << QPoint(-1, -5) << QPoint(-1, -1));
+}
+
+bool TestAutosave::recovers(const QString &base, const PolygonDocument &document, const QString &imageFile)
+{
+    ProjectData data;
+    QString image;
+    QString error;
+    if (!Autosave::recover(base, &data, &image, &error))
+        return false;
+    const ProjectData expected = document.toProjectData();
+    return data.polygons == expected.polygons && data.colors == expected.colors
+            && data.doors == expected.doors && image == imageFile;
+}
+
+QString TestAutosave::journalFile() const
+{
+    const QDir directory(dir->path());
+    const QStringList journals = directory.entryList(QStringList() << "*.ofj", QDir::Files);
+    return journals.length() == 1 ? directory.filePath(journals.first()) : QString();
+}
+
+void TestAutosave::replaysEdits()
+{
+    PolygonDocument document;
+    Autosave autosave(&document, base);
+    autosave.setImageFile("/plans/floor1.png");
+    edit(&document);
+    autosave.flush();
+
+    // The worker writes in the background, recovering is what a crash
+    // would see at any moment.
+    QTRY_VERIFY(recovers(base, document, "/plans/floor1.png"));
+}
+
+void TestAutosave::mergedMovesReplay()
+{
+    PolygonDocument document;
+    document.appendPolygon(PolygonDocument::Rooms, QPolygon() << QPoint(0, 0) << QPoint(10, 0) << QPoint(10, 10), "blue");
+    Autosave autosave(&document, base);
+
+    // A drag, then another vertex, then the first one again.
+    for (int i = 0; i < 50; i++)
+        document.moveVertex(PolygonDocument::Rooms, 0, 2, QPoint(10 + i, 10 + i));
+    document.moveVertex(PolygonDocument::Rooms, 0, 1, QPoint(20, -3));
+    document.moveVertex(PolygonDocument::Rooms, 0, 2, QPoint(7, 7));
+    autosave.flush();
+
+    QTRY_VERIFY(recovers(base, document));
+}
+
+void TestAutosave::tornRecordIgnored()
+{
+    PolygonDocument document;
+    Autosave autosave(&document, base);
+    edit(&document);
+    autosave.flush();
+    QTRY_VERIFY(recovers(base, document));
+    const ProjectData complete = document.toProjectData();
+
+    // One more edit, the damage below takes it away again.
+    document.appendVertex(PolygonDocument::Rooms, 0, QPoint(-3, -8));
+    autosave.flush();
+    QTRY_VERIFY(recovers(base, document));
+
+    QFile journal(journalFile());
+    QVERIFY(journal.exists());
+    ProjectData data;
+    QString image;
+    QString error;
+
+    // A damaged checksum ends the replay before that record.
+    QVERIFY(journal.open(QIODevice::ReadWrite));
+    QVERIFY(journal.seek(journal.size() - 1));
+    char last = 0;
+    QVERIFY(journal.getChar(&last));
+    QVERIFY(journal.seek(journal.size() - 1));
+    QVERIFY(journal.putChar(char(last ^ 0x55)));
+    journal.close();
+    QVERIFY2(Autosave::recover(base, &data, &image, &error), qPrintable(error));
+    QCOMPARE(data.polygons, complete.polygons);
+    QCOMPARE(data.colors, complete.colors);
+    QCOMPARE(data.doors, complete.doors);
+
+    // So does a record cut short.
+    QVERIFY(journal.resize(journal.size() - 3));
+    QVERIFY2(Autosave::recover(base, &data, &image, &error), qPrintable(error));
+    QCOMPARE(data.polygons, complete.polygons);
+    QCOMPARE(data.doors, complete.doors);
+}
+
+void TestAutosave::compactionKeepsContent()
+{
+    PolygonDocument document;
+    Autosave autosave(&document, base);
+    autosave.setImageFile("plan.png");
+
+    // Enough records for the journal to outgrow the snapshot several times.
+    const int room = document.appendPolygon(PolygonDocument::Rooms, QPolygon(), "blue");
+    for (int i = 0; i < 20000; i++)
+    {
+        document.appendVertex(PolygonDocument::Rooms, room, QPoint(i, i % 7));
+        if (i % 1000 == 999)
+            autosave.flush();
+    }
+    for (int i = 0; i < 5000; i++)
+        document.removeVertex(PolygonDocument::Rooms, room, 0);
+    autosave.flush();
+
+    QTRY_VERIFY(recovers(base, document, "plan.png"));
+    // Old generations are gone once the newer ones are complete.
+    QTRY_COMPARE(QDir(dir->path()).entryList(QStringList() << "*.ofb", QDir::Files).length(), 1);
+}
+
+void TestAutosave::removesFilesOnExit()
+{
+    {
+        PolygonDocument document;
+        Autosave autosave(&document, base);
+        edit(&document);
+        autosave.flush();
+        QTRY_VERIFY(recovers(base, document));
+    }
+    QVERIFY(QDir(dir->path()).entryList(QDir::Files).isEmpty());
+    QVERIFY(Autosave::bases(dir->path()).isEmpty());
+}
+
+void TestAutosave::basesInCreationOrder()
+{
+    PolygonDocument document;
+    QList<Autosave *> floors;
+    for (int i = 1; i <= 11; i++)
+        floors << new Autosave(&document, dir->filePath(QStringLiteral("floor%1").arg(i)));
+
+    QStringList expected;
+    for (int i = 1; i <= 11; i++)
+        expected << dir->filePath(QStringLiteral("floor%1").arg(i));
+    QTRY_COMPARE(Autosave::bases(dir->path()), expected);
+    qDeleteAll(floors);
+}
+
+QTEST_GUILESS_MAIN(TestAutosave)
+
+#include "tst_autosave.moc"
@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_geometryKernels
+
+SOURCES += \
+    tst_geometryKernels.cpp
@@ -0,0 +1,161 @@
+#include <QVector>
+#include <QtTest>
+#include <random>
+#include "geometryKernels.h"
+
+// The batched kernels take four points at a time with SSE2 and finish the
+// rest one by one. Both paths have to give exactly the values of the
+// scalar code, so a build with or without SSE2 draws and snaps the same.
+class TestGeometryKernels : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void distToSegments_data();
+    void distToSegments();
+    void transformPoints_data();
+    void transformPoints();
+    void transformRoundsHalfToEven_data();
+    void transformRoundsHalfToEven();
+};
+
+void TestGeometryKernels::distToSegments_data()
+{
+    QTest::addColumn<quint32>("seed");
+    QTest::addColumn<int>("count");
+    QTest::addColumn<bool>("degenerate");
+
+    // Counts around the width of a vector, so every lane and the scalar
+    // tail after it are covered.
+    for (int count : {1, 3, 4, 5, 7, 8, 13, 64, 101})
+    {
+        QTest::newRow(qPrintable(QStringLiteral("random %1").arg(count))) << quint32(count) << count << false;
+        QTest::newRow(qPrintable(QStringLiteral("zero length %1").arg(count))) << quint32(count) << count << true;
+    }
+}
+
+void TestGeometryKernels::distToSegments()
+{
+    QFETCH(quint32, seed);
+    QFETCH(int, count);
+    QFETCH(bool, degenerate);
+
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> coordinate(-5000, 5000);
+    std::uniform_int_distribution<int> near(-3, 3);
+
+    QVector<float> x1(count), y1(count), x2(count), y2(count);
+    for (int i = 0; i < count; i++)
+    {
+        x1[i] = coordinate(random);
+        y1[i] = coordinate(random);
+        // Every other segment has no length, or nearly none.
+        if (degenerate && i % 2 == 0)
+        {
+            x2[i] = x1[i];
+            y2[i] = y1[i];
+        }
+        else if (degenerate)
+        {
+            x2[i] = x1[i] + near(random);
+            y2[i] = y1[i] + near(random);
+        }
+        else
+        {
+            x2[i] = coordinate(random);
+            y2[i] = coordinate(random);
+        }
+    }
+
+    for (int query = 0; query < 20; query++)
+    {
+        // The first query lies on a segment's end point, distance zero.
+        const QPoint pos = query == 0 ? QPoint(int(x1[0]), int(y1[0]))
+                                      : QPoint(coordinate(random), coordinate(random));
+        QVector<float> dist(count, -1);
+        ::distToSegments(pos, x1.constData(), y1.constData(), x2.constData(), y2.constData(), dist.data(), count);
+
+        for (int i = 0; i < count; i++)
+        {
+            const float expected = distToSegment(pos, QPoint(int(x1[i]), int(y1[i])), QPoint(int(x2[i]), int(y2[i])));
+            // Exact, not QCOMPARE's fuzzy float comparison.
+            QVERIFY2(dist.at(i) == expected,
+                     qPrintable(QStringLiteral("segment %1: %2, scalar %3").arg(i).arg(dist.at(i)).arg(expected)));
+        }
+    }
+}
+
+void TestGeometryKernels::transformPoints_data()
+{
+    QTest::addColumn<QTransform>("transform");
+    QTest::addColumn<int>("count");
+
+    const QTransform rotated = QTransform().translate(12.5, -7.25).rotate(33).scale(1.7, 0.6);
+    for (int count : {1, 3, 4, 6, 9, 64, 103})
+    {
+        QTest::newRow(qPrintable(QStringLiteral("scale %1").arg(count))) << QTransform::fromScale(0.37, 2.5) << count;
+        QTest::newRow(qPrintable(QStringLiteral("rotate %1").arg(count))) << rotated << count;
+        QTest::newRow(qPrintable(QStringLiteral("halves %1").arg(count)))
+                << QTransform(0.5, 0, 0, 0.5, 0.5, -0.5) << count;
+    }
+}
+
+void TestGeometryKernels::transformPoints()
+{
+    QFETCH(QTransform, transform);
+    QFETCH(int, count);
+
+    std::mt19937 random(quint32(count));
+    std::uniform_int_distribution<int> coordinate(-20000, 20000);
+
+    QVector<int> x(count), y(count);
+    for (int i = 0; i < count; i++)
+    {
+        x[i] = coordinate(random);
+        y[i] = coordinate(random);
+    }
+
+    // One point at a time always takes the scalar path.
+    QVector<int> expectedX = x;
+    QVector<int> expectedY = y;
+    for (int i = 0; i < count; i++)
+        ::transformPoints(transform, expectedX.data() + i, expectedY.data() + i, 1);
+
+    ::transformPoints(transform, x.data(), y.data(), count);
+    QCOMPARE(x, expectedX);
+    QCOMPARE(y, expectedY);
+}
+
+void TestGeometryKernels::transformRoundsHalfToEven_data()
+{
+    QTest::addColumn<int>("count");
+    for (int count : {1, 4, 5, 8, 11})
+        QTest::newRow(qPrintable(QString::number(count))) << count;
+}
+
+void TestGeometryKernels::transformRoundsHalfToEven()
+{
+    QFETCH(int, count);
+
+    // Halving odd coordinates lands exactly between two pixels.
+    const int odd[] = {1, 3, 5, 7, -1, -3, -5, -7, 9, 11, -9};
+    const int even[] = {0, 2, 2, 4, 0, -2, -2, -4, 4, 6, -4};
+
+    QVector<int> x(count), y(count);
+    for (int i = 0; i < count; i++)
+    {
+        x[i] = odd[i];
+        y[i] = -odd[i];
+    }
+    ::transformPoints(QTransform::fromScale(0.5, 0.5), x.data(), y.data(), count);
+
+    for (int i = 0; i < count; i++)
+    {
+        QCOMPARE(x.at(i), even[i]);
+        QCOMPARE(y.at(i), -even[i]);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestGeometryKernels)
+
+#include "tst_geometryKernels.moc"
@@ -0,0 +1,15 @@
+include(../tests.pri)
+
+QT += network
+
+TARGET = tst_liveStream
+
+# The stream is part of the editor, not of the core sources.
+SOURCES += \
+    tst_liveStream.cpp \
+    ../../GUI/liveStream.cpp \
+    ../../GUI/redrawScheduler.cpp
+
+HEADERS += \
+    ../../GUI/liveStream.h \
+    ../../GUI/redrawScheduler.h
@@ -0,0 +1,166 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QScopedPointer>
+#include <QtEndian>
+#include <QtTest>
+#include "liveStream.h"
+#include "polygonDocument.h"
+#include "redrawScheduler.h"
+
+class TestLiveStream : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void snapshotOnConnect();
+    void reconnectAfterEdits();
+
+private:
+    struct Message
+    {
+        quint8 type = 0;
+        QByteArray body;
+    };
+
+    // Connects and waits for the hello and the snapshot.
+    QLocalSocket *connectClient();
+    // Reads messages off client until one of type arrives.
+    static bool waitFor(QLocalSocket *client, QByteArray *buffer, quint8 type, Message *message);
+    static ProjectData parseSnapshot(const QByteArray &body);
+
+    QScopedPointer<RedrawScheduler> scheduler;
+    QScopedPointer<LiveStream> stream;
+    PolygonDocument document;
+    Message snapshot;
+};
+
+void TestLiveStream::init()
+{
+    document.clear();
+    document.appendPolygon(PolygonDocument::Rooms, QPolygon() << QPoint(0, 0) << QPoint(10, 0) << QPoint(10, 10), "blue");
+    scheduler.reset(new RedrawScheduler);
+    stream.reset(new LiveStream(scheduler.data()));
+
+    QString error;
+    const QString name = QStringLiteral("outlineflow-test-%1").arg(QCoreApplication::applicationPid());
+    QVERIFY2(stream->listen(name, &error), qPrintable(error));
+    stream->setDocument(&document, "plan.png");
+}
+
+void TestLiveStream::cleanup()
+{
+    stream.reset();
+    scheduler.reset();
+}
+
+QLocalSocket *TestLiveStream::connectClient()
+{
+    QLocalSocket *client = new QLocalSocket;
+    client->connectToServer(stream->serverName());
+    QByteArray buffer;
+    Message hello;
+    if (!waitFor(client, &buffer, 3, &hello) || hello.body.size() != 4
+            || qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(hello.body.constData())) != 2
+            || !waitFor(client, &buffer, 1, &snapshot))
+    {
+        delete client;
+        return nullptr;
+    }
+    return client;
+}
+
+bool TestLiveStream::waitFor(QLocalSocket *client, QByteArray *buffer, quint8 type, Message *message)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < 5000)
+    {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 20);
+        buffer->append(client->readAll());
+        while (buffer->size() >= 5)
+        {
+            const quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(buffer->constData()));
+            if (quint32(buffer->size()) < 4 + size)
+                break;
+            message->type = quint8(buffer->at(4));
+            message->body = buffer->mid(5, int(size) - 1);
+            buffer->remove(0, int(size) + 4);
+            if (message->type == type)
+                return true;
+        }
+    }
+    return false;
+}
+
+ProjectData TestLiveStream::parseSnapshot(const QByteArray &body)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(body.constData());
+    auto take = [&p]() {
+        const quint32 value = qFromLittleEndian<quint32>(p);
+        p += 4;
+        return value;
+    };
+    auto takeString = [&p, &take]() {
+        const quint32 bytes = take();
+        const QString text = QString::fromUtf8(reinterpret_cast<const char *>(p), int(bytes));
+        p += bytes;
+        return text;
+    };
+    auto takePolygon = [&take]() {
+        QPolygon poly(int(take()));
+        for (int i = 0; i < poly.size(); i++)
+        {
+            const int x = int(take());
+            const int y = int(take());
+            poly[i] = QPoint(x, y);
+        }
+        return poly;
+    };
+
+    ProjectData data;
+    take();
+    takeString();
+    for (quint32 rooms = take(); rooms > 0; rooms--)
+    {
+        data.colors << takeString();
+        data.polygons << takePolygon();
+    }
+    for (quint32 doors = take(); doors > 0; doors--)
+        data.doors << takePolygon();
+    return data;
+}
+
+void TestLiveStream::snapshotOnConnect()
+{
+    QScopedPointer<QLocalSocket> client(connectClient());
+    QVERIFY(client);
+    const ProjectData data = parseSnapshot(snapshot.body);
+    QCOMPARE(data.polygons, document.polygons(PolygonDocument::Rooms));
+    QCOMPARE(data.colors, document.colors());
+}
+
+void TestLiveStream::reconnectAfterEdits()
+{
+    // The first client leaves a snapshot behind.
+    QScopedPointer<QLocalSocket> client(connectClient());
+    QVERIFY(client);
+    client->disconnectFromServer();
+    QTRY_COMPARE(stream->clientCount(), 0);
+
+    // Edits nobody streams.
+    document.moveVertex(PolygonDocument::Rooms, 0, 2, QPoint(20, 30));
+    document.appendPolygon(PolygonDocument::Rooms, QPolygon() << QPoint(-5, -5) << QPoint(-1, -5) << QPoint(-1, -1), "red");
+
+    client.reset(connectClient());
+    QVERIFY(client);
+    const ProjectData data = parseSnapshot(snapshot.body);
+    QCOMPARE(data.polygons, document.polygons(PolygonDocument::Rooms));
+    QCOMPARE(data.colors, document.colors());
+}
+
+QTEST_GUILESS_MAIN(TestLiveStream)
+
+#include "tst_liveStream.moc"
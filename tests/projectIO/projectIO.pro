@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_projectIO
+
+SOURCES += \
+    tst_projectIO.cpp
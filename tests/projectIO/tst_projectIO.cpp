@@ -0,0 +1,167 @@
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "projectIO.h"
+
+class TestProjectIO : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void formatsAgree();
+    void truncatedBinaryFails();
+    void datLines_data();
+    void datLines();
+
+private:
+    static ProjectData smallPlan();
+    static ProjectData largePlan();
+    static void compare(const ProjectData &actual, const ProjectData &expected);
+
+    QTemporaryDir dir;
+};
+
+ProjectData TestProjectIO::smallPlan()
+{
+    ProjectData data;
+    data.polygons << (QPolygon() << QPoint(0, 0) << QPoint(100, 0) << QPoint(100, 80) << QPoint(0, 80));
+    data.colors << "#0000ff";
+    data.polygons << (QPolygon() << QPoint(-20, 5) << QPoint(-5, 5) << QPoint(-5, 40));
+    data.colors << "green";
+    // The editor always has a room being drawn, possibly without points.
+    data.polygons << QPolygon();
+    data.colors << "blue";
+    data.doors << (QPolygon() << QPoint(100, 20) << QPoint(100, 40));
+    return data;
+}
+
+ProjectData TestProjectIO::largePlan()
+{
+    // Large enough for the .dat blocks to be parsed in parallel.
+    ProjectData data;
+    for (int room = 0; room < 2000; room++)
+    {
+        QPolygon poly;
+        for (int i = 0; i < 300; i++)
+            poly << QPoint(room * 1000 + i, (i * 7919) % 100000 - 50000);
+        data.polygons << poly;
+        data.colors << QStringLiteral("#%1").arg(room % 0xffffff, 6, 16, QLatin1Char('0'));
+    }
+    data.doors << (QPolygon() << QPoint(1, 2) << QPoint(3, 4));
+    return data;
+}
+
+void TestProjectIO::compare(const ProjectData &actual, const ProjectData &expected)
+{
+    QCOMPARE(actual.polygons, expected.polygons);
+    QCOMPARE(actual.colors, expected.colors);
+    QCOMPARE(actual.doors, expected.doors);
+}
+
+void TestProjectIO::roundTrip_data()
+{
+    QTest::addColumn<QString>("suffix");
+    QTest::addColumn<bool>("large");
+
+    QTest::newRow("dat") << "dat" << false;
+    QTest::newRow("ofb") << "ofb" << false;
+    QTest::newRow("dat large") << "dat" << true;
+    QTest::newRow("ofb large") << "ofb" << true;
+}
+
+void TestProjectIO::roundTrip()
+{
+    QFETCH(QString, suffix);
+    QFETCH(bool, large);
+    QVERIFY(dir.isValid());
+
+    const ProjectData data = large ? largePlan() : smallPlan();
+    const QString fileName = dir.filePath("plan." + suffix);
+    QString error;
+    QVERIFY2(ProjectIO::write(fileName, data, &error), qPrintable(error));
+
+    ProjectData read;
+    QVERIFY2(ProjectIO::read(fileName, &read, &error), qPrintable(error));
+    compare(read, data);
+}
+
+void TestProjectIO::formatsAgree()
+{
+    QVERIFY(dir.isValid());
+    const QString datFile = dir.filePath("agree.dat");
+    const QString binaryFile = dir.filePath("agree.ofb");
+    QString error;
+
+    // .dat to .ofb and back gives the same file.
+    QVERIFY2(ProjectIO::writeDat(datFile, smallPlan(), &error), qPrintable(error));
+    ProjectData fromDat;
+    QVERIFY2(ProjectIO::readDat(datFile, &fromDat, &error), qPrintable(error));
+    QVERIFY2(ProjectIO::writeBinary(binaryFile, fromDat, &error), qPrintable(error));
+    ProjectData fromBinary;
+    QVERIFY2(ProjectIO::readBinary(binaryFile, &fromBinary, &error), qPrintable(error));
+    compare(fromBinary, smallPlan());
+
+    const QString againFile = dir.filePath("again.dat");
+    QVERIFY2(ProjectIO::writeDat(againFile, fromBinary, &error), qPrintable(error));
+    QFile first(datFile);
+    QFile second(againFile);
+    QVERIFY(first.open(QIODevice::ReadOnly));
+    QVERIFY(second.open(QIODevice::ReadOnly));
+    QCOMPARE(second.readAll(), first.readAll());
+}
+
+void TestProjectIO::truncatedBinaryFails()
+{
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("truncated.ofb");
+    QString error;
+    QVERIFY2(ProjectIO::writeBinary(fileName, smallPlan(), &error), qPrintable(error));
+
+    QFile file(fileName);
+    QVERIFY(file.resize(file.size() - 4));
+    ProjectData read;
+    QVERIFY(!ProjectIO::readBinary(fileName, &read, &error));
+    QVERIFY(!error.isEmpty());
+}
+
+void TestProjectIO::datLines_data()
+{
+    QTest::addColumn<QByteArray>("line");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("plain") << QByteArray("10 20") << true;
+    QTest::newRow("trailing spaces") << QByteArray("10 20 \t ") << true;
+    QTest::newRow("crlf") << QByteArray("10 20\r") << true;
+    QTest::newRow("float") << QByteArray("10.5 20.5") << true;
+    QTest::newRow("third number") << QByteArray("10 20 30") << false;
+    QTest::newRow("trailing text") << QByteArray("10 20 abc") << false;
+    QTest::newRow("comma") << QByteArray("10 20,") << false;
+    QTest::newRow("one number") << QByteArray("10") << false;
+}
+
+void TestProjectIO::datLines()
+{
+    QFETCH(QByteArray, line);
+    QFETCH(bool, valid);
+    QVERIFY(dir.isValid());
+
+    const QString fileName = dir.filePath("line.dat");
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("P, blue, 2\n0 0\n" + line + "\n");
+    file.close();
+
+    ProjectData read;
+    QString error;
+    QCOMPARE(ProjectIO::readDat(fileName, &read, &error), valid);
+    if (valid)
+        QCOMPARE(read.polygons.value(0).value(1), QPoint(10, 20));
+    else
+        QVERIFY2(error.endsWith(QStringLiteral("line.dat:3: expected \"<x> <y>\"")), qPrintable(error));
+}
+
+QTEST_GUILESS_MAIN(TestProjectIO)
+
+#include "tst_projectIO.moc"
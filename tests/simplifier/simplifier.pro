@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_simplifier
+
+SOURCES += \
+    tst_simplifier.cpp
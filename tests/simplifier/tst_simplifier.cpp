@@ -0,0 +1,147 @@
+#include <QtMath>
+#include <QtTest>
+#include <cmath>
+#include "polygonSimplifier.h"
+
+Q_DECLARE_METATYPE(PolygonSimplifier::Method)
+
+class TestSimplifier : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void dropsCollinearPoints_data();
+    void dropsCollinearPoints();
+    void keepsCorners_data();
+    void keepsCorners();
+    void keptPointsAreUnchanged_data();
+    void keptPointsAreUnchanged();
+    void smallPolygonsUnchanged_data();
+    void smallPolygonsUnchanged();
+    void thinRoomKeepsThreePoints_data();
+    void thinRoomKeepsThreePoints();
+
+private:
+    static void addMethods();
+    static QPolygon noisyCircle(int points, double radius, double noise);
+};
+
+void TestSimplifier::addMethods()
+{
+    QTest::addColumn<PolygonSimplifier::Method>("method");
+    QTest::newRow("Douglas-Peucker") << PolygonSimplifier::DouglasPeucker;
+    QTest::newRow("Visvalingam-Whyatt") << PolygonSimplifier::VisvalingamWhyatt;
+}
+
+QPolygon TestSimplifier::noisyCircle(int points, double radius, double noise)
+{
+    QPolygon poly;
+    for (int i = 0; i < points; i++)
+    {
+        const double angle = 2 * M_PI * i / points;
+        const double r = radius + (i % 2 ? noise : -noise);
+        poly << QPoint(qRound(r * std::cos(angle)), qRound(r * std::sin(angle)));
+    }
+    return poly;
+}
+
+void TestSimplifier::dropsCollinearPoints_data()
+{
+    addMethods();
+}
+
+void TestSimplifier::dropsCollinearPoints()
+{
+    QFETCH(PolygonSimplifier::Method, method);
+
+    // A square with points along its walls.
+    QPolygon square;
+    for (int i = 0; i < 10; i++)
+        square << QPoint(i * 10, 0);
+    for (int i = 0; i < 10; i++)
+        square << QPoint(100, i * 10);
+    for (int i = 0; i < 10; i++)
+        square << QPoint(100 - i * 10, 100);
+    for (int i = 0; i < 10; i++)
+        square << QPoint(0, 100 - i * 10);
+
+    const QPolygon result = PolygonSimplifier::simplify(square, method, 1.0);
+    QCOMPARE(result.length(), 4);
+    for (const QPoint &corner : QPolygon() << QPoint(0, 0) << QPoint(100, 0) << QPoint(100, 100) << QPoint(0, 100))
+        QVERIFY(result.contains(corner));
+}
+
+void TestSimplifier::keepsCorners_data()
+{
+    addMethods();
+}
+
+void TestSimplifier::keepsCorners()
+{
+    QFETCH(PolygonSimplifier::Method, method);
+
+    // An L shaped room, every point is a corner well above the tolerance.
+    const QPolygon room = QPolygon() << QPoint(0, 0) << QPoint(200, 0) << QPoint(200, 100)
+                                     << QPoint(100, 100) << QPoint(100, 200) << QPoint(0, 200);
+    QCOMPARE(PolygonSimplifier::simplify(room, method, 2.0), room);
+}
+
+void TestSimplifier::keptPointsAreUnchanged_data()
+{
+    addMethods();
+}
+
+void TestSimplifier::keptPointsAreUnchanged()
+{
+    QFETCH(PolygonSimplifier::Method, method);
+
+    const QPolygon circle = noisyCircle(400, 500, 0.5);
+    const QPolygon result = PolygonSimplifier::simplify(circle, method, 5.0);
+    QVERIFY(result.length() >= 3);
+    QVERIFY(result.length() < circle.length());
+
+    // Points are only dropped, the ones left keep their order.
+    int at = 0;
+    for (const QPoint &point : result)
+    {
+        while (at < circle.length() && circle.at(at) != point)
+            at++;
+        QVERIFY2(at < circle.length(), "point not in the input, or out of order");
+        at++;
+    }
+}
+
+void TestSimplifier::smallPolygonsUnchanged_data()
+{
+    addMethods();
+}
+
+void TestSimplifier::smallPolygonsUnchanged()
+{
+    QFETCH(PolygonSimplifier::Method, method);
+
+    const QPolygon triangle = QPolygon() << QPoint(0, 0) << QPoint(1, 0) << QPoint(0, 1);
+    QCOMPARE(PolygonSimplifier::simplify(triangle, method, 100.0), triangle);
+    QCOMPARE(PolygonSimplifier::simplify(QPolygon(), method, 100.0), QPolygon());
+}
+
+void TestSimplifier::thinRoomKeepsThreePoints_data()
+{
+    addMethods();
+}
+
+void TestSimplifier::thinRoomKeepsThreePoints()
+{
+    QFETCH(PolygonSimplifier::Method, method);
+
+    // Every point is within the tolerance of the chords through the others.
+    const QPolygon room = QPolygon() << QPoint(0, 0) << QPoint(10, 1) << QPoint(20, 0) << QPoint(10, -1);
+    const QPolygon result = PolygonSimplifier::simplify(room, method, 2.0);
+    QVERIFY(result.length() >= 3);
+    for (const QPoint &point : result)
+        QVERIFY(room.contains(point));
+}
+
+QTEST_GUILESS_MAIN(TestSimplifier)
+
+#include "tst_simplifier.moc"
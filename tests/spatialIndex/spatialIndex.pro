@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_spatialIndex
+
+SOURCES += \
+    tst_spatialIndex.cpp
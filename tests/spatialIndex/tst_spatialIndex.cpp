@@ -0,0 +1,143 @@
+#include <QtMath>
+#include <QtTest>
+#include <cmath>
+#include <random>
+#include "pointIndex.h"
+#include "polygonDocument.h"
+#include "segmentIndex.h"
+
+// The document's indexes follow every edit in place. After any sequence of
+// edits they have to answer exactly like indexes built from scratch.
+class TestSpatialIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void randomEdits_data();
+    void randomEdits();
+
+private:
+    static void compareWithRebuilt(const PolygonDocument &document, std::mt19937 &random);
+};
+
+void TestSpatialIndex::compareWithRebuilt(const PolygonDocument &document, std::mt19937 &random)
+{
+    PointIndex rooms;
+    PointIndex doors;
+    SegmentIndex edges;
+    rooms.rebuild(document.polygons(PolygonDocument::Rooms));
+    doors.rebuild(document.polygons(PolygonDocument::Doors));
+    edges.rebuild(document.polygons(PolygonDocument::Rooms));
+
+    QCOMPARE(document.pointIndex(PolygonDocument::Rooms).size(), rooms.size());
+    QCOMPARE(document.pointIndex(PolygonDocument::Doors).size(), doors.size());
+
+    std::uniform_int_distribution<int> coordinate(-100, 1100);
+    for (int i = 0; i < 20; i++)
+    {
+        const QPoint pos(coordinate(random), coordinate(random));
+        // Small enough to go through the grid cells, not a full scan.
+        const QRect rect(pos, QSize(90, 70));
+
+        QCOMPARE(document.pointIndex(PolygonDocument::Rooms).pointsIn(rect), rooms.pointsIn(rect));
+        QCOMPARE(document.pointIndex(PolygonDocument::Doors).pointsIn(rect), doors.pointsIn(rect));
+        QCOMPARE(document.segmentIndex().edgesIn(rect), edges.edgesIn(rect));
+
+        int list = -1, point = -1, expectedList = -1, expectedPoint = -1;
+        QPoint closest, expectedClosest;
+        QCOMPARE(document.pointIndex(PolygonDocument::Rooms).closest(pos, &list, &point, &closest),
+                 rooms.closest(pos, &expectedList, &expectedPoint, &expectedClosest));
+        QCOMPARE(list, expectedList);
+        QCOMPARE(point, expectedPoint);
+
+        int edge = -1, expectedEdge = -1;
+        float distance = 0, expectedDistance = 0;
+        QCOMPARE(document.segmentIndex().nearest(pos, &list, &edge, &distance),
+                 edges.nearest(pos, &expectedList, &expectedEdge, &expectedDistance));
+        QCOMPARE(list, expectedList);
+        QCOMPARE(edge, expectedEdge);
+    }
+}
+
+void TestSpatialIndex::randomEdits_data()
+{
+    QTest::addColumn<quint32>("seed");
+    for (quint32 seed = 1; seed <= 8; seed++)
+        QTest::newRow(qPrintable(QStringLiteral("seed %1").arg(seed))) << seed;
+}
+
+void TestSpatialIndex::randomEdits()
+{
+    QFETCH(quint32, seed);
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> coordinate(0, 1000);
+    std::uniform_int_distribution<int> action(0, 10);
+    auto below = [&random](int n) { return std::uniform_int_distribution<int>(0, n - 1)(random); };
+    auto randomPoint = [&]() { return QPoint(coordinate(random), coordinate(random)); };
+
+    // A frame over the whole area in both layers keeps enough grid cells
+    // occupied for the queries to always go through the cells, where the
+    // index built in place and the rebuilt one could otherwise choose
+    // differently between cells and a full scan.
+    PolygonDocument document;
+    QPolygon frame;
+    for (int i = 0; i < 40; i++)
+        frame << QPoint(500 + qRound(500 * std::cos(i * 2 * M_PI / 40)), 500 + qRound(500 * std::sin(i * 2 * M_PI / 40)));
+    const PolygonDocument::Id frameIds[2] = {
+        document.polygonId(PolygonDocument::Rooms, document.appendPolygon(PolygonDocument::Rooms, frame, "red")),
+        document.polygonId(PolygonDocument::Doors, document.appendPolygon(PolygonDocument::Doors, frame))
+    };
+
+    for (int step = 0; step < 600; step++)
+    {
+        const PolygonDocument::Layer layer = below(4) == 0 ? PolygonDocument::Doors : PolygonDocument::Rooms;
+        const int count = document.count(layer);
+        const int a = action(random);
+        const int index = below(count);
+        if (a != 0 && document.polygonId(layer, index) == frameIds[layer])
+            continue;
+
+        if (a == 0)
+        {
+            QPolygon poly;
+            for (int i = below(6); i > 0; i--)
+                poly << randomPoint();
+            document.insertPolygon(layer, below(count + 1), poly, "blue");
+        }
+        else if (a == 1 && count > 1)
+        {
+            document.removePolygon(layer, index);
+        }
+        else if (a == 10)
+        {
+            QPolygon poly;
+            for (int i = below(6); i > 0; i--)
+                poly << randomPoint();
+            document.replacePolygon(layer, index, poly);
+        }
+        else
+        {
+            const int n = document.polygon(layer, index).length();
+            if (n == 0 || a < 5)
+                document.insertVertex(layer, index, below(n + 1), randomPoint());
+            else if (a < 8)
+                document.moveVertex(layer, index, below(n), randomPoint());
+            else
+                document.removeVertex(layer, index, below(n));
+        }
+
+        if (step % 20 == 0)
+        {
+            compareWithRebuilt(document, random);
+            if (QTest::currentTestFailed())
+            {
+                qWarning("indexes differ after step %d", step);
+                return;
+            }
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(TestSpatialIndex)
+
+#include "tst_spatialIndex.moc"
@@ -0,0 +1,9 @@
+# Every test is a QtTest executable built against the editor's core
+# sources, "make check" runs them all.
+QT += core gui concurrent testlib
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../GUI/core.pri)
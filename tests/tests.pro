@@ -0,0 +1,10 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    autosave \
+    geometryKernels \
+    liveStream \
+    projectIO \
+    simplifier \
+    spatialIndex \
+    validator
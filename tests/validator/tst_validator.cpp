@@ -0,0 +1,170 @@
+#include <QtTest>
+#include "polygonDocument.h"
+#include "polygonValidator.h"
+
+typedef PolygonValidator::Issue Issue;
+
+class TestValidator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanPlan();
+    void selfCrossing();
+    void crossingRooms();
+    void duplicateVertex();
+    void zeroLengthEdge();
+    void overlap();
+    void unfinishedRoomsSkipped();
+    void incrementalMatchesFull();
+    void sweepFromElsewhere();
+
+private:
+    static QPolygon square(int x, int y, int side);
+    static int countOf(const QVector<Issue> &issues, Issue::Kind kind);
+    static QVector<int> kindCounts(const QVector<Issue> &issues);
+};
+
+QPolygon TestValidator::square(int x, int y, int side)
+{
+    return QPolygon() << QPoint(x, y) << QPoint(x + side, y) << QPoint(x + side, y + side) << QPoint(x, y + side);
+}
+
+int TestValidator::countOf(const QVector<Issue> &issues, Issue::Kind kind)
+{
+    int count = 0;
+    for (const Issue &issue : issues)
+        count += issue.kind == kind;
+    return count;
+}
+
+QVector<int> TestValidator::kindCounts(const QVector<Issue> &issues)
+{
+    return QVector<int>() << countOf(issues, Issue::Crossing) << countOf(issues, Issue::Overlap)
+                          << countOf(issues, Issue::DuplicateVertex) << countOf(issues, Issue::ZeroLengthEdge);
+}
+
+void TestValidator::cleanPlan()
+{
+    // Rooms sharing a wall and a corner are fine.
+    const QList<QPolygon> rooms = QList<QPolygon>() << square(0, 0, 10) << square(10, 0, 10) << square(20, 10, 10);
+    QVERIFY(PolygonValidator::validate(rooms).isEmpty());
+}
+
+void TestValidator::selfCrossing()
+{
+    const QPolygon bowtie = QPolygon() << QPoint(0, 0) << QPoint(10, 10) << QPoint(10, 0) << QPoint(0, 10);
+    const QVector<Issue> issues = PolygonValidator::validate(QList<QPolygon>() << bowtie);
+    QCOMPARE(issues.length(), 1);
+    QCOMPARE(issues.first().kind, Issue::Crossing);
+    QCOMPARE(issues.first().polygon, 0);
+    QCOMPARE(issues.first().otherPolygon, 0);
+    QCOMPARE(issues.first().at, QPointF(5, 5));
+}
+
+void TestValidator::crossingRooms()
+{
+    const QList<QPolygon> rooms = QList<QPolygon>() << square(0, 0, 10) << square(5, 5, 10);
+    const QVector<Issue> issues = PolygonValidator::validate(rooms);
+    QCOMPARE(countOf(issues, Issue::Crossing), 2);
+    QCOMPARE(issues.length(), 2);
+    for (const Issue &issue : issues)
+        QVERIFY(issue.polygon != issue.otherPolygon);
+}
+
+void TestValidator::duplicateVertex()
+{
+    // A figure eight through (5, 5).
+    const QPolygon eight = QPolygon() << QPoint(0, 0) << QPoint(10, 0) << QPoint(5, 5)
+                                      << QPoint(10, 10) << QPoint(0, 10) << QPoint(5, 5);
+    const QVector<Issue> issues = PolygonValidator::validate(QList<QPolygon>() << eight);
+    QCOMPARE(countOf(issues, Issue::DuplicateVertex), 1);
+    QCOMPARE(countOf(issues, Issue::Crossing), 0);
+}
+
+void TestValidator::zeroLengthEdge()
+{
+    const QPolygon room = QPolygon() << QPoint(0, 0) << QPoint(10, 0) << QPoint(10, 0)
+                                     << QPoint(10, 10) << QPoint(0, 10);
+    const QVector<Issue> issues = PolygonValidator::validate(QList<QPolygon>() << room);
+    QCOMPARE(issues.length(), 1);
+    QCOMPARE(issues.first().kind, Issue::ZeroLengthEdge);
+    QCOMPARE(issues.first().index, 1);
+}
+
+void TestValidator::overlap()
+{
+    // Runs to (20, 0) and back along the same wall.
+    const QPolygon room = QPolygon() << QPoint(0, 0) << QPoint(20, 0) << QPoint(10, 0) << QPoint(10, 10);
+    const QVector<Issue> issues = PolygonValidator::validate(QList<QPolygon>() << room);
+    QVERIFY(countOf(issues, Issue::Overlap) >= 1);
+}
+
+void TestValidator::unfinishedRoomsSkipped()
+{
+    const QList<QPolygon> rooms = QList<QPolygon>() << QPolygon()
+            << (QPolygon() << QPoint(0, 0) << QPoint(0, 0))
+            << (QPolygon() << QPoint(-5, 5) << QPoint(15, 5));
+    QVERIFY(PolygonValidator::validate(rooms).isEmpty());
+}
+
+void TestValidator::incrementalMatchesFull()
+{
+    PolygonDocument document;
+    PolygonValidator validator(&document);
+    document.appendPolygon(PolygonDocument::Rooms, square(0, 0, 10), "blue");
+    document.appendPolygon(PolygonDocument::Rooms, square(10, 0, 10), "green");
+    QVERIFY(validator.issues().isEmpty());
+
+    // Pulls a corner of the second room into the first one.
+    document.moveVertex(PolygonDocument::Rooms, 1, 3, QPoint(5, 5));
+    QCOMPARE(kindCounts(validator.issues()), kindCounts(PolygonValidator::validate(document.polygons(PolygonDocument::Rooms))));
+    QVERIFY(validator.issueCount() > 0);
+
+    document.insertVertex(PolygonDocument::Rooms, 0, 1, QPoint(5, 0));
+    document.insertVertex(PolygonDocument::Rooms, 0, 1, QPoint(5, 0));
+    QCOMPARE(kindCounts(validator.issues()), kindCounts(PolygonValidator::validate(document.polygons(PolygonDocument::Rooms))));
+
+    // Undoing the edits by hand leaves nothing behind.
+    document.removeVertex(PolygonDocument::Rooms, 0, 1);
+    document.removeVertex(PolygonDocument::Rooms, 0, 1);
+    document.moveVertex(PolygonDocument::Rooms, 1, 3, QPoint(10, 10));
+    QVERIFY(validator.issues().isEmpty());
+    QCOMPARE(validator.issuesOf(1).length(), 0);
+
+    // New points for a room drop the issues of the old ones.
+    document.replacePolygon(PolygonDocument::Rooms, 0, square(2, 2, 10));
+    QCOMPARE(kindCounts(validator.issues()), kindCounts(PolygonValidator::validate(document.polygons(PolygonDocument::Rooms))));
+    document.replacePolygon(PolygonDocument::Rooms, 0, square(0, 0, 10));
+    QVERIFY(validator.issues().isEmpty());
+
+    document.removePolygon(PolygonDocument::Rooms, 0);
+    document.appendPolygon(PolygonDocument::Rooms, square(15, 5, 10), "red");
+    QCOMPARE(kindCounts(validator.issues()), kindCounts(PolygonValidator::validate(document.polygons(PolygonDocument::Rooms))));
+}
+
+void TestValidator::sweepFromElsewhere()
+{
+    PolygonDocument document;
+    PolygonValidator validator(&document);
+    ProjectData data;
+    data.polygons << square(0, 0, 10) << square(5, 5, 10) << square(30, 0, 10);
+    data.colors << "blue" << "green" << "red";
+    document.setProjectData(data);
+    QVERIFY(validator.needsFullCheck());
+
+    // A sweep done on a copy replaces the validator's own one.
+    validator.setValidated(PolygonValidator::validate(data.polygons));
+    QVERIFY(!validator.needsFullCheck());
+    QCOMPARE(validator.issueCount(), 2);
+    QCOMPARE(validator.issuesOf(1).length(), 2);
+    QVERIFY(validator.issuesOf(2).isEmpty());
+
+    // Edits go on from there.
+    document.moveVertex(PolygonDocument::Rooms, 1, 0, QPoint(20, 20));
+    QCOMPARE(kindCounts(validator.issues()), kindCounts(PolygonValidator::validate(document.polygons(PolygonDocument::Rooms))));
+}
+
+QTEST_GUILESS_MAIN(TestValidator)
+
+#include "tst_validator.moc"
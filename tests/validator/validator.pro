@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = tst_validator
+
+SOURCES += \
+    tst_validator.cpp